@@ -0,0 +1,38 @@
+#!/bin/sh
+# The fixed headless workload make pgo trains and measures the software demos
+# with: every mode of every software demo, for the same frames each run. It
+# prints the wall time of each run in milliseconds, one "name ms" line each.
+#
+# usage: scripts/benchmark.sh [frames]
+
+set -e
+
+FRAMES=${1:-120}
+SIZE="-w 640 -h 480"
+
+# No window or GPU needed, SDL draws into memory.
+export SDL_VIDEODRIVER=dummy
+export SDL_RENDER_DRIVER=software
+
+run() {
+    name=$1
+    shift
+    start=$(date +%s%N)
+    "$@" > /dev/null 2>&1
+    end=$(date +%s%N)
+    echo "$name $(((end - start) / 1000000))"
+}
+
+run palette ./palette_plasma $SIZE -B "$FRAMES"
+run palette-16 ./palette_plasma $SIZE -B "$FRAMES" -b 16
+run rgb ./rgb_plasma $SIZE -B "$FRAMES"
+run rgb-interactive ./rgb_plasma $SIZE -B "$FRAMES" -i
+run rgb-checker ./rgb_plasma $SIZE -B "$FRAMES" -c checker
+run rgb-interlace ./rgb_plasma $SIZE -B "$FRAMES" -c interlace
+run rgb-adaptive ./rgb_plasma $SIZE -B "$FRAMES" -a 2
+run rgb-upsample ./rgb_plasma $SIZE -B "$FRAMES" -u 2
+run rgb-16 ./rgb_plasma $SIZE -B "$FRAMES" -b 16
+run rgb-formula ./rgb_plasma $SIZE -B "$FRAMES" -v classic
+run rgb-offline ./rgb_plasma $SIZE -o /dev/null -r "0:$(awk "BEGIN { print $FRAMES / 60 }")"
+run soft-cube ./soft_cube_plasma $SIZE -B "$FRAMES"
+run soft-cube-16 ./soft_cube_plasma $SIZE -B "$FRAMES" -b 16
@@ -0,0 +1,54 @@
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A benchmark run draws a fixed number of frames as fast as it can, without
+// waiting for the next frame time, and quits with a summary of the frame and
+// draw cost. The frames still advance the plasma by one display frame each,
+// so every run draws the same frames. make pgo runs the software demos this
+// way to train and measure profile guided builds.
+
+typedef struct {
+    // The frames to draw, 0 when not benchmarking.
+    int frames;
+    int drawn;
+    Uint64 startCounter;
+    double drawMsSum;
+} Benchmark;
+
+static inline int ParseBenchmarkFrames(const char *arg, Benchmark *benchmark) {
+    char *end;
+    benchmark->frames = strtol(arg, &end, 10);
+    return *end != '\0' || benchmark->frames <= 0 ? -1 : 0;
+}
+
+static inline void StartBenchmark(Benchmark *benchmark) {
+    benchmark->drawn = 0;
+    benchmark->drawMsSum = 0.0;
+    benchmark->startCounter = SDL_GetPerformanceCounter();
+}
+
+// Counts a drawn frame. Returns 1 once the last frame of the run is done.
+static inline int AddBenchmarkFrame(Benchmark *benchmark, double drawMs) {
+    benchmark->drawn++;
+    benchmark->drawMsSum += drawMs;
+    return benchmark->frames > 0 && benchmark->drawn >= benchmark->frames;
+}
+
+static inline void PrintBenchmark(const Benchmark *benchmark) {
+    if (benchmark->frames == 0 || benchmark->drawn == 0) {
+        return;
+    }
+
+    double totalMs = (double)(SDL_GetPerformanceCounter() -
+                              benchmark->startCounter) *
+                     1000.0 / SDL_GetPerformanceFrequency();
+    printf("\nbenchmark: %d frames, %f ms/f, draw ms/f: %f\n",
+           benchmark->drawn, totalMs / benchmark->drawn,
+           benchmark->drawMsSum / benchmark->drawn);
+}
+
+#endif
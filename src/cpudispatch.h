@@ -0,0 +1,134 @@
+#ifndef CPUDISPATCH_H_INCLUDED
+#define CPUDISPATCH_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <string.h>
+
+// Hot kernels are written once as an always inlined body, then stamped out
+// with DEFINE_KERNEL_VARIANTS into one function per instruction set so the
+// compiler can vectorize each copy for its target. The variant is picked once
+// at startup from what the CPU reports.
+
+typedef enum {
+    KERNEL_GENERIC,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_NEON,
+    KERNEL_COUNT
+} Kernel;
+
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_TARGET_SSE2 __attribute__((target("sse2")))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define KERNEL_TARGET_AVX512                                                   \
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma")))
+
+#define DEFINE_KERNEL_VARIANTS(type, name, params, args)                       \
+    static void name##Generic params {                                         \
+        name##Body args;                                                       \
+    }                                                                          \
+    KERNEL_TARGET_SSE2 static void name##SSE2 params {                         \
+        name##Body args;                                                       \
+    }                                                                          \
+    KERNEL_TARGET_AVX2 static void name##AVX2 params {                         \
+        name##Body args;                                                       \
+    }                                                                          \
+    KERNEL_TARGET_AVX512 static void name##AVX512 params {                     \
+        name##Body args;                                                       \
+    }                                                                          \
+    static const type name##Variants[KERNEL_COUNT] = {                         \
+        name##Generic, name##SSE2, name##AVX2, name##AVX512, NULL}
+#elif defined(__arm__) || defined(__aarch64__)
+// NEON is part of the AArch64 baseline, so only 32 bit ARM needs the target
+// attribute to build the NEON copy.
+#if defined(__arm__)
+#define KERNEL_TARGET_NEON __attribute__((target("fpu=neon")))
+#else
+#define KERNEL_TARGET_NEON
+#endif
+
+#define DEFINE_KERNEL_VARIANTS(type, name, params, args)                       \
+    static void name##Generic params {                                         \
+        name##Body args;                                                       \
+    }                                                                          \
+    KERNEL_TARGET_NEON static void name##NEON params {                         \
+        name##Body args;                                                       \
+    }                                                                          \
+    static const type name##Variants[KERNEL_COUNT] = {                         \
+        name##Generic, NULL, NULL, NULL, name##NEON}
+#else
+#define DEFINE_KERNEL_VARIANTS(type, name, params, args)                       \
+    static void name##Generic params {                                         \
+        name##Body args;                                                       \
+    }                                                                          \
+    static const type name##Variants[KERNEL_COUNT] = {name##Generic, NULL,     \
+                                                      NULL, NULL, NULL}
+#endif
+
+static inline int IsKernelSupported(Kernel kernel) {
+    switch (kernel) {
+    case KERNEL_GENERIC:
+        return 1;
+#if defined(__x86_64__) || defined(__i386__)
+    case KERNEL_SSE2:
+        return SDL_HasSSE2();
+    // Every feature a variant is built with has to be checked, as some CPUs
+    // have AVX2 without FMA, or AVX-512F without BW and VL. SDL checks that
+    // the OS saves the wider registers, the builtins cover the rest.
+    case KERNEL_AVX2:
+        return SDL_HasAVX2() && __builtin_cpu_supports("fma");
+    case KERNEL_AVX512:
+        return SDL_HasAVX512F() && SDL_HasAVX2() &&
+               __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("fma");
+#endif
+#if defined(__arm__) || defined(__aarch64__)
+    case KERNEL_NEON:
+        return SDL_HasNEON();
+#endif
+    default:
+        return 0;
+    }
+}
+
+static inline Kernel DetectKernel(void) {
+    for (int kernel = KERNEL_COUNT - 1; kernel > KERNEL_GENERIC; kernel--) {
+        if (IsKernelSupported((Kernel)kernel)) {
+            return (Kernel)kernel;
+        }
+    }
+
+    return KERNEL_GENERIC;
+}
+
+static inline const char *GetKernelName(Kernel kernel) {
+    switch (kernel) {
+    case KERNEL_SSE2:
+        return "sse2";
+    case KERNEL_AVX2:
+        return "avx2";
+    case KERNEL_AVX512:
+        return "avx512";
+    case KERNEL_NEON:
+        return "neon";
+    default:
+        return "generic";
+    }
+}
+
+static inline int ParseKernel(const char *name, Kernel *kernel) {
+    for (int i = 0; i < KERNEL_COUNT; i++) {
+        if (strcmp(name, GetKernelName((Kernel)i)) == 0) {
+            *kernel = (Kernel)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+#endif
@@ -1,4 +1,7 @@
+#include "framequeue.h"
 #include "glmath.h"
+#include "realtime.h"
+#include "trace.h"
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
@@ -6,6 +9,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define WINDOW_TITLE "Cube Plasma"
@@ -15,10 +19,22 @@
 #define PI 3.1415926535897932384626433832795
 #define VERTEX_SHADER_PATH "src/shaders/cube_plasma.vert"
 #define FRAGMENT_SHADER_PATH "src/shaders/cube_plasma.frag"
+#define FXAA_VERTEX_SHADER_PATH "src/shaders/fxaa.vert"
+#define FXAA_FRAGMENT_SHADER_PATH "src/shaders/fxaa.frag"
+#define DEFAULT_SAMPLES 4
+// Timer queries are read back this many frames after they were issued, so
+// reading them doesn't wait for the GPU.
+#define GPU_TIMER_QUERIES 4
 
 #define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 #define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 
+typedef enum {
+    ANTI_ALIASING_NONE,
+    ANTI_ALIASING_MSAA,
+    ANTI_ALIASING_FXAA,
+} AntiAliasingMode;
+
 SDL_DisplayMode gDisplayMode;
 SDL_Window *gWindow = NULL;
 
@@ -35,9 +51,32 @@ GLint gUniformViewPositionLocation = -1;
 Mat4 gView = MAT4_IDENTITY_INIT;
 Mat4 gProj = MAT4_ZERO_INIT;
 
+// Anti-aliased frames are drawn to an offscreen framebuffer first. For MSAA
+// its colour and depth are multisampled renderbuffers resolved to the window
+// with a blit, for FXAA the colour is a texture the FXAA pass samples.
+GLuint gSceneFramebuffer = 0;
+GLuint gSceneColorRenderbuffer = 0;
+GLuint gSceneTexture = 0;
+GLuint gSceneDepthRenderbuffer = 0;
+GLuint gFxaaProgramId = 0;
+GLuint gFxaaVAO = 0;
+GLint gUniformSceneLocation = -1;
+GLint gUniformInverseResolutionLocation = -1;
+
+GLuint gGpuTimerQueries[GPU_TIMER_QUERIES];
+int gGpuTimerFrames = 0;
+double gGpuMsSum = 0.0;
+int gGpuMsFrames = 0;
+
 int gWidth = DEFAULT_WIDTH;
 int gHeight = DEFAULT_HEIGHT;
 int gFullscreen = 0;
+const char *gTracePath = NULL;
+AntiAliasingMode gAntiAliasing = ANTI_ALIASING_MSAA;
+int gSamples = DEFAULT_SAMPLES;
+FrameQueue gFrameQueue = {0};
+Realtime gRealtime = {0};
+JitterHistogram gJitter = {0};
 
 double Min(double value, double min) {
     return value > min ? value : min;
@@ -69,9 +108,6 @@ int InitSDL(void) {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
                         SDL_GL_CONTEXT_PROFILE_CORE);
 
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
-
     if (SDL_GetDesktopDisplayMode(0, &gDisplayMode) != 0) {
         return -1;
     }
@@ -161,22 +197,29 @@ char *ReadFile(const char *filepath) {
         return NULL;
     }
 
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        fileSize = ftell(file);
+    }
+    if (fileSize < 0) {
+        fclose(file);
+        return NULL;
+    }
     rewind(file);
 
     char *buffer = malloc((fileSize + 1) * sizeof(*buffer));
     if (buffer == NULL) {
+        fclose(file);
         return NULL;
     }
 
     size_t result = fread(buffer, 1, fileSize, file);
+    fclose(file);
     if ((long)result != fileSize) {
+        free(buffer);
         return NULL;
     }
 
-    fclose(file);
-
     buffer[fileSize] = 0;
     return buffer;
 }
@@ -198,13 +241,16 @@ GLboolean compileShader(GLenum type, const GLchar *source[],
     return GL_TRUE;
 }
 
-int InitGL(void) {
-    gProgramId = glCreateProgram();
+int LoadProgram(const char *vertexShaderPath, const char *fragmentShaderPath,
+                GLuint *outProgram) {
+    GLuint program = glCreateProgram();
+    *outProgram = program;
 
     GLuint vertexShader;
-    char *vertexShaderSource = ReadFile(VERTEX_SHADER_PATH);
+    char *vertexShaderSource = ReadFile(vertexShaderPath);
     if (vertexShaderSource == NULL) {
-        LogError("could not read file %s", VERTEX_SHADER_PATH);
+        LogError("could not read file %s", vertexShaderPath);
+        return -1;
     }
     if (compileShader(GL_VERTEX_SHADER, (const char **)&vertexShaderSource,
                       &vertexShader) != GL_TRUE) {
@@ -213,9 +259,10 @@ int InitGL(void) {
     }
 
     GLuint fragmentShader;
-    char *fragmentShaderSource = ReadFile(FRAGMENT_SHADER_PATH);
+    char *fragmentShaderSource = ReadFile(fragmentShaderPath);
     if (fragmentShaderSource == NULL) {
-        LogError("could not read file %s", FRAGMENT_SHADER_PATH);
+        LogError("could not read file %s", fragmentShaderPath);
+        return -1;
     }
     if (compileShader(GL_FRAGMENT_SHADER, (const char **)&fragmentShaderSource,
                       &fragmentShader) != GL_TRUE) {
@@ -226,20 +273,133 @@ int InitGL(void) {
     free(fragmentShaderSource);
     free(vertexShaderSource);
 
-    glAttachShader(gProgramId, vertexShader);
-    glAttachShader(gProgramId, fragmentShader);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
 
-    glLinkProgram(gProgramId);
+    glLinkProgram(program);
     GLint programSuccess = GL_TRUE;
-    glGetProgramiv(gProgramId, GL_LINK_STATUS, &programSuccess);
+    glGetProgramiv(program, GL_LINK_STATUS, &programSuccess);
     if (programSuccess != GL_TRUE) {
-        LogProgramError(gProgramId);
+        LogProgramError(program);
         return -1;
     }
 
     glDeleteShader(fragmentShader);
     glDeleteShader(vertexShader);
 
+    return 0;
+}
+
+void DestroySceneTarget(void) {
+    glDeleteFramebuffers(1, &gSceneFramebuffer);
+    glDeleteRenderbuffers(1, &gSceneColorRenderbuffer);
+    glDeleteTextures(1, &gSceneTexture);
+    glDeleteRenderbuffers(1, &gSceneDepthRenderbuffer);
+    gSceneFramebuffer = 0;
+    gSceneColorRenderbuffer = 0;
+    gSceneTexture = 0;
+    gSceneDepthRenderbuffer = 0;
+}
+
+// Creates the offscreen framebuffer for the anti-aliasing mode at the window
+// size. Without anti-aliasing the cube is drawn straight to the window.
+int CreateSceneTarget(void) {
+    if (gAntiAliasing == ANTI_ALIASING_NONE) {
+        return 0;
+    }
+
+    glGenFramebuffers(1, &gSceneFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, gSceneFramebuffer);
+
+    glGenRenderbuffers(1, &gSceneDepthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, gSceneDepthRenderbuffer);
+
+    if (gAntiAliasing == ANTI_ALIASING_MSAA) {
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, gSamples,
+                                         GL_DEPTH_COMPONENT24, gWidth, gHeight);
+
+        glGenRenderbuffers(1, &gSceneColorRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, gSceneColorRenderbuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, gSamples, GL_RGBA8,
+                                         gWidth, gHeight);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  GL_RENDERBUFFER, gSceneColorRenderbuffer);
+    } else {
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, gWidth,
+                              gHeight);
+
+        glGenTextures(1, &gSceneTexture);
+        glBindTexture(GL_TEXTURE_2D, gSceneTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, gWidth, gHeight, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, gSceneTexture, 0);
+    }
+
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, gSceneDepthRenderbuffer);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LogError("offscreen framebuffer of %dx%d incomplete, status 0x%x",
+                 gWidth, gHeight, status);
+        return -1;
+    }
+
+    return 0;
+}
+
+int InitAntiAliasing(void) {
+    if (gAntiAliasing == ANTI_ALIASING_MSAA) {
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        if (gSamples > maxSamples) {
+            LogInfo("%dx MSAA not supported, using %dx", gSamples, maxSamples);
+            gSamples = maxSamples;
+        }
+        LogInfo("anti-aliasing with %dx MSAA", gSamples);
+    } else if (gAntiAliasing == ANTI_ALIASING_FXAA) {
+        if (LoadProgram(FXAA_VERTEX_SHADER_PATH, FXAA_FRAGMENT_SHADER_PATH,
+                        &gFxaaProgramId) != 0) {
+            return -1;
+        }
+
+        gUniformSceneLocation = glGetUniformLocation(gFxaaProgramId, "uScene");
+        if (gUniformSceneLocation == -1) {
+            LogError("could not get uniform location for uScene");
+            return -1;
+        }
+        gUniformInverseResolutionLocation =
+            glGetUniformLocation(gFxaaProgramId, "uInverseResolution");
+        if (gUniformInverseResolutionLocation == -1) {
+            LogError("could not get uniform location for uInverseResolution");
+            return -1;
+        }
+
+        // Core profile draws need a vertex array even when the vertex shader
+        // makes up its own vertices.
+        glGenVertexArrays(1, &gFxaaVAO);
+        LogInfo("anti-aliasing with FXAA");
+    } else {
+        LogInfo("anti-aliasing off");
+    }
+
+    glGenQueries(GPU_TIMER_QUERIES, gGpuTimerQueries);
+
+    return CreateSceneTarget();
+}
+
+int InitGL(void) {
+    if (LoadProgram(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH, &gProgramId) !=
+        0) {
+        return -1;
+    }
+
     gUniformTimeLocation = glGetUniformLocation(gProgramId, "uTime");
     if (gUniformTimeLocation == -1) {
         LogError("could not get uniform location for uTime");
@@ -275,13 +435,15 @@ int InitGL(void) {
 
     glViewport(0, 0, gWidth, gHeight);
     glEnable(GL_DEPTH_TEST);
-    glEnable(GL_MULTISAMPLE);
+    // The camera stays outside the cube, so the faces turned away from it
+    // are always hidden behind the ones facing it.
+    glEnable(GL_CULL_FACE);
 
     GLfloat vertexData[] = {
-        -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f, 0.5f,  -0.5f, -0.5f,
-        0.0f,  0.0f,  -1.0f, 0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f,
-        0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f, -0.5f, 0.5f,  -0.5f,
-        0.0f,  0.0f,  -1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f,
+        -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f, 0.5f,  0.5f,  -0.5f,
+        0.0f,  0.0f,  -1.0f, 0.5f,  -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f,
+        0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f, -0.5f, -0.5f, -0.5f,
+        0.0f,  0.0f,  -1.0f, -0.5f, 0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f,
 
         -0.5f, -0.5f, 0.5f,  0.0f,  0.0f,  1.0f,  0.5f,  -0.5f, 0.5f,
         0.0f,  0.0f,  1.0f,  0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
@@ -293,20 +455,20 @@ int InitGL(void) {
         -0.5f, -0.5f, -0.5f, -1.0f, 0.0f,  0.0f,  -0.5f, -0.5f, 0.5f,
         -1.0f, 0.0f,  0.0f,  -0.5f, 0.5f,  0.5f,  -1.0f, 0.0f,  0.0f,
 
-        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.5f,  0.5f,  -0.5f,
-        1.0f,  0.0f,  0.0f,  0.5f,  -0.5f, -0.5f, 1.0f,  0.0f,  0.0f,
-        0.5f,  -0.5f, -0.5f, 1.0f,  0.0f,  0.0f,  0.5f,  -0.5f, 0.5f,
-        1.0f,  0.0f,  0.0f,  0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.5f,  -0.5f, -0.5f,
+        1.0f,  0.0f,  0.0f,  0.5f,  0.5f,  -0.5f, 1.0f,  0.0f,  0.0f,
+        0.5f,  -0.5f, -0.5f, 1.0f,  0.0f,  0.0f,  0.5f,  0.5f,  0.5f,
+        1.0f,  0.0f,  0.0f,  0.5f,  -0.5f, 0.5f,  1.0f,  0.0f,  0.0f,
 
         -0.5f, -0.5f, -0.5f, 0.0f,  -1.0f, 0.0f,  0.5f,  -0.5f, -0.5f,
         0.0f,  -1.0f, 0.0f,  0.5f,  -0.5f, 0.5f,  0.0f,  -1.0f, 0.0f,
         0.5f,  -0.5f, 0.5f,  0.0f,  -1.0f, 0.0f,  -0.5f, -0.5f, 0.5f,
         0.0f,  -1.0f, 0.0f,  -0.5f, -0.5f, -0.5f, 0.0f,  -1.0f, 0.0f,
 
-        -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  -0.5f,
-        0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  0.5f,
-        0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f};
+        -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  0.5f,
+        0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  -0.5f, 0.0f,  1.0f,  0.0f,
+        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  -0.5f,
+        0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  0.5f,  0.0f,  1.0f,  0.0f};
 
     glGenVertexArrays(1, &gVAO);
     glBindVertexArray(gVAO);
@@ -327,7 +489,30 @@ int InitGL(void) {
     Mat4Perspective(0.785398, (float)gWidth / (float)gHeight, 1.0f, 10.0f,
                     gProj);
 
-    return 0;
+    return InitAntiAliasing();
+}
+
+// Times the GPU work of a frame with a GL_TIME_ELAPSED query, and collects
+// the result of the query issued GPU_TIMER_QUERIES frames earlier. A result
+// that still isn't available is dropped rather than waited for.
+void BeginGpuTimer(void) {
+    GLuint query = gGpuTimerQueries[gGpuTimerFrames % GPU_TIMER_QUERIES];
+    if (gGpuTimerFrames >= GPU_TIMER_QUERIES) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            gGpuMsSum += (double)elapsedNs / 1000000.0;
+            gGpuMsFrames++;
+        }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void EndGpuTimer(void) {
+    glEndQuery(GL_TIME_ELAPSED);
+    gGpuTimerFrames++;
 }
 
 void DrawFrame(double elapsedTimeSecs) {
@@ -352,10 +537,15 @@ void DrawFrame(double elapsedTimeSecs) {
     Mat4 outA;
     Mat4RotateY(out, outA, sinf(t * PI / 4.0) + cosf(t * PI / 2.0));
 
+    BeginGpuTimer();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gSceneFramebuffer);
+    glEnable(GL_DEPTH_TEST);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glUseProgram(gProgramId);
+    glBindVertexArray(gVAO);
 
     glUniformMatrix4fv(gUniformModelLocation, 1, GL_FALSE, outA);
     glUniformMatrix4fv(gUniformViewLocation, 1, GL_FALSE, gView);
@@ -365,9 +555,33 @@ void DrawFrame(double elapsedTimeSecs) {
     glUniform1f(gUniformTimeLocation, elapsedTimeSecs);
 
     glDrawArrays(GL_TRIANGLES, 0, 36);
+
+    if (gAntiAliasing == ANTI_ALIASING_MSAA) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gSceneFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, gWidth, gHeight, 0, 0, gWidth, gHeight,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    } else if (gAntiAliasing == ANTI_ALIASING_FXAA) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(gFxaaProgramId);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gSceneTexture);
+        glUniform1i(gUniformSceneLocation, 0);
+        glUniform2f(gUniformInverseResolutionLocation, 1.0f / gWidth,
+                    1.0f / gHeight);
+        glBindVertexArray(gFxaaVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    EndGpuTimer();
 }
 
 void DestroyGL(void) {
+    glDeleteQueries(GPU_TIMER_QUERIES, gGpuTimerQueries);
+    DestroySceneTarget();
+    glDeleteVertexArrays(1, &gFxaaVAO);
+    glDeleteProgram(gFxaaProgramId);
     glDeleteVertexArrays(1, &gVAO);
     glDeleteBuffers(1, &gVBO);
     glDeleteProgram(gProgramId);
@@ -380,7 +594,7 @@ void DestroySDL(void) {
 
 int main(int argc, char *argv[]) {
     char opt;
-    while ((opt = getopt(argc, argv, ":w:h:f")) != -1) {
+    while ((opt = getopt(argc, argv, ":w:h:ft:q:a:JR:")) != -1) {
         switch (opt) {
         case 'w':
             // Obviously not proper use of strtol, but, thats fine
@@ -401,9 +615,53 @@ int main(int argc, char *argv[]) {
         case 'f':
             gFullscreen = 1;
             break;
+        case 't':
+            gTracePath = optarg;
+            break;
+        case 'J':
+            gJitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &gRealtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            gJitter.enabled = 1;
+            break;
+        case 'a':
+            if (strcmp(optarg, "none") == 0) {
+                gAntiAliasing = ANTI_ALIASING_NONE;
+            } else if (strcmp(optarg, "fxaa") == 0) {
+                gAntiAliasing = ANTI_ALIASING_FXAA;
+            } else if (strncmp(optarg, "msaa", 4) == 0 &&
+                       (strcmp(optarg + 4, "2") == 0 ||
+                        strcmp(optarg + 4, "4") == 0 ||
+                        strcmp(optarg + 4, "8") == 0)) {
+                gAntiAliasing = ANTI_ALIASING_MSAA;
+                gSamples = optarg[4] - '0';
+            } else {
+                fprintf(stderr, "invalid value for anti-aliasing: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            if (ParseFramesInFlight(optarg, &gFrameQueue) != 0) {
+                fprintf(stderr, "invalid value for frames in flight: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         }
     }
 
+    if (gTracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&gRealtime);
+
     if (InitSDL() != 0) {
         fprintf(stderr, "error initializing SDL, %s\n", SDL_GetError());
         return EXIT_FAILURE;
@@ -423,33 +681,47 @@ int main(int argc, char *argv[]) {
     Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
     SDL_Event event;
     int isRunning = 1;
+    StartJitterHistogram(&gJitter, targetSecsPerFrame);
+    LockRealtimeMemory(&gRealtime);
 
     while (isRunning) {
-        SDL_PollEvent(&event);
-        switch (event.type) {
-        case SDL_QUIT:
-            isRunning = 0;
-            break;
-        case SDL_KEYDOWN:
-            if (event.key.keysym.sym == SDLK_ESCAPE) {
+        Uint64 frameStartCounter = SDL_GetPerformanceCounter();
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
                 isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
+                    event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    gWidth = event.window.data1;
+                    gHeight = event.window.data2;
+                    glViewport(0, 0, gWidth, gHeight);
+                    DestroySceneTarget();
+                    if (CreateSceneTarget() != 0) {
+                        isRunning = 0;
+                    }
+                }
+                break;
             }
-            break;
-        case SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
-                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-                gWidth = event.window.data1;
-                gHeight = event.window.data2;
-                glViewport(0, 0, gWidth, gHeight);
-            }
-            break;
         }
+        TraceEnd("poll events", traceStart);
 
         elapsedTimeSecs += targetSecsPerFrame;
 
+        traceStart = TraceBegin();
         DrawFrame(elapsedTimeSecs);
+        TraceEnd("DrawFrame", traceStart);
 
         // Manually cap the frame rate
+        traceStart = TraceBegin();
+        SleepUntilFrameTime(&gRealtime, lastCounter, targetSecsPerFrame);
         while (GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) <
                targetSecsPerFrame) {
         }
@@ -457,8 +729,16 @@ int main(int argc, char *argv[]) {
                targetSecsPerFrame);
 
         Uint64 endCounter = SDL_GetPerformanceCounter();
+        TraceEnd("pacing wait", traceStart);
 
+        traceStart = TraceBegin();
         SDL_GL_SwapWindow(gWindow);
+        TraceEnd("swap", traceStart);
+        AddJitterFrame(&gJitter, SDL_GetPerformanceCounter());
+
+        traceStart = TraceBegin();
+        QueueFrame(&gFrameQueue, frameStartCounter);
+        TraceEnd("fence wait", traceStart);
 
         double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
         double fps = (double)SDL_GetPerformanceFrequency() /
@@ -466,15 +746,33 @@ int main(int argc, char *argv[]) {
 
         if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
             1000.0) {
-            printf("ms/f: %f, fps: %f\r", msPerFrame, fps);
+            char queueStats[128];
+            FormatFrameQueueStats(queueStats, sizeof(queueStats),
+                                  &gFrameQueue);
+            printf("ms/f: %f, fps: %f, gpu ms/f: %f%s\r", msPerFrame, fps,
+                   gGpuMsFrames > 0 ? gGpuMsSum / gGpuMsFrames : 0.0,
+                   queueStats);
+            gGpuMsSum = 0.0;
+            gGpuMsFrames = 0;
             fflush(stdout);
             metricsPrintCounter = SDL_GetPerformanceCounter();
         }
 
         lastCounter = endCounter;
     }
+    PrintJitterHistogram(&gJitter);
 
+    DestroyFrameQueue(&gFrameQueue);
     DestroyGL();
+
+    if (gTracePath != NULL) {
+        if (WriteTrace(gTracePath) != 0) {
+            LogError("failed to write trace to %s", gTracePath);
+        } else {
+            LogInfo("wrote trace to %s", gTracePath);
+        }
+    }
+
     DestroySDL();
 
     return EXIT_SUCCESS;
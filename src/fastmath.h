@@ -0,0 +1,133 @@
+#ifndef FASTMATH_H_INCLUDED
+#define FASTMATH_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+
+// Sine, cosine and square roots without libm calls or branches, so the loops
+// using them can be vectorized. They are always inlined, as a call left in a
+// loop keeps it scalar, and in the larger demos the inliner otherwise gives
+// up on them once they are stamped into several kernel variants. The errors
+// below are the largest seen when sweeping the ranges the demos use against
+// libm.
+//
+// FastSin, FastCos: absolute error below 2e-11 for |x| < 1e6.
+// FastSqrt: relative error below 4e-11.
+// FastSinf, FastCosf, FastTanf: within 1 ulp of the float result.
+// FastRsqrtf: relative error below 5e-6.
+
+#define FAST_MATH_INV_PI 0.31830988618379067154
+// Pi split into a high part with its low 23 bits clear, so k * FAST_MATH_PI_HI
+// is exact for any |k| < 2^22, and the rest of pi.
+#define FAST_MATH_PI_HI 3.14159265160560607910
+#define FAST_MATH_PI_LO 1.98418715936108088e-09
+#define FAST_MATH_HALF_PI 1.57079632679489661923
+// Adding 1.5 * 2^52 rounds a double below 2^51 to the nearest integer and
+// leaves that integer in the low bits of the mantissa.
+#define FAST_MATH_ROUND_SHIFT 6755399441055744.0
+
+// Minimax coefficients of sin(r) = r + r^3 * P(r^2) on [-pi/2, pi/2].
+#define FAST_MATH_SIN_C3 -0.16666666606467023
+#define FAST_MATH_SIN_C5 0.0083333304956724873
+#define FAST_MATH_SIN_C7 -0.00019840804039291995
+#define FAST_MATH_SIN_C9 2.7522618857329507e-06
+#define FAST_MATH_SIN_C11 -2.3846694046197587e-08
+
+#define FAST_MATH_INLINE static inline __attribute__((always_inline))
+
+#define FAST_MATH_RSQRT_MAGIC 0x5fe6eb50c7b537a9ULL
+#define FAST_MATH_RSQRTF_MAGIC 0x5f375a86U
+
+FAST_MATH_INLINE double FastSinPolynomial(double r) {
+    double r2 = r * r;
+
+    return r + r * r2 *
+                   (FAST_MATH_SIN_C3 +
+                    r2 * (FAST_MATH_SIN_C5 +
+                          r2 * (FAST_MATH_SIN_C7 +
+                                r2 * (FAST_MATH_SIN_C9 +
+                                      r2 * FAST_MATH_SIN_C11))));
+}
+
+// Negates the value when the integer left in the low mantissa bits of shifted
+// by FAST_MATH_ROUND_SHIFT is odd.
+FAST_MATH_INLINE double FastNegateOdd(double value, double shifted) {
+    uint64_t shiftedBits, valueBits;
+    memcpy(&shiftedBits, &shifted, sizeof(shiftedBits));
+    memcpy(&valueBits, &value, sizeof(valueBits));
+    valueBits ^= shiftedBits << 63;
+    memcpy(&value, &valueBits, sizeof(value));
+
+    return value;
+}
+
+// sin(x) = (-1)^k * sin(x - k * pi) with k = round(x / pi).
+FAST_MATH_INLINE double FastSin(double x) {
+    double shifted = x * FAST_MATH_INV_PI + FAST_MATH_ROUND_SHIFT;
+    double k = shifted - FAST_MATH_ROUND_SHIFT;
+    double r = (x - k * FAST_MATH_PI_HI) - k * FAST_MATH_PI_LO;
+
+    return FastNegateOdd(FastSinPolynomial(r), shifted);
+}
+
+// cos(x) = (-1)^k * sin(x - k * pi + pi / 2) with k = round(x / pi + 1 / 2).
+FAST_MATH_INLINE double FastCos(double x) {
+    double shifted = (x * FAST_MATH_INV_PI + 0.5) + FAST_MATH_ROUND_SHIFT;
+    double k = shifted - FAST_MATH_ROUND_SHIFT;
+    double r = ((x - k * FAST_MATH_PI_HI) - k * FAST_MATH_PI_LO) +
+               FAST_MATH_HALF_PI;
+
+    return FastNegateOdd(FastSinPolynomial(r), shifted);
+}
+
+// Reciprocal square root from the bit pattern estimate refined by three
+// Newton steps. Inputs must be positive, zero returns a large finite value.
+FAST_MATH_INLINE double FastRsqrt(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    bits = FAST_MATH_RSQRT_MAGIC - (bits >> 1);
+
+    double y;
+    memcpy(&y, &bits, sizeof(y));
+    double halfX = x * 0.5;
+    y = y * (1.5 - halfX * y * y);
+    y = y * (1.5 - halfX * y * y);
+    y = y * (1.5 - halfX * y * y);
+
+    return y;
+}
+
+// Square root of a non negative value, zero included.
+FAST_MATH_INLINE double FastSqrt(double x) {
+    return x * FastRsqrt(x);
+}
+
+FAST_MATH_INLINE float FastSinf(float x) {
+    return (float)FastSin(x);
+}
+
+FAST_MATH_INLINE float FastCosf(float x) {
+    return (float)FastCos(x);
+}
+
+FAST_MATH_INLINE float FastTanf(float x) {
+    return (float)(FastSin(x) / FastCos(x));
+}
+
+// Reciprocal square root from the bit pattern estimate refined by two Newton
+// steps.
+FAST_MATH_INLINE float FastRsqrtf(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    bits = FAST_MATH_RSQRTF_MAGIC - (bits >> 1);
+
+    float y;
+    memcpy(&y, &bits, sizeof(y));
+    float halfX = x * 0.5f;
+    y = y * (1.5f - halfX * y * y);
+    y = y * (1.5f - halfX * y * y);
+
+    return y;
+}
+
+#endif
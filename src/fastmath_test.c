@@ -0,0 +1,305 @@
+#include "fastmath.h"
+#include "generated/plasma_formulas.h"
+#include "plasmashading.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks the functions of fastmath.h against libm over the ranges the demos
+// use, and the maximum errors documented in the header. Then renders frames
+// of rgb_plasma and palette_plasma with the demos' own formulas from
+// plasmashading.h, and again with a libm copy of them, and compares the two
+// by PSNR. Last it compares frames of the kernel plasmagen generates from
+// classic.plasma, which the GL and Vulkan demos draw too, with rgb_plasma's
+// own, so the two can't drift apart. make test builds and runs it, and it
+// exits with a failure when any check does.
+
+#define SWEEP_SAMPLES 4000000
+#define FRAME_WIDTH 640
+#define FRAME_HEIGHT 480
+#define CENTRE_FREQUENCY 0.33
+#define PALETTE_SIZE 256
+#define MIN_FRAME_PSNR 60.0
+
+typedef enum { PLASMA_RGB, PLASMA_PALETTE, PLASMA_CLASSIC } FramePlasma;
+
+typedef struct {
+    double psnr;
+    int maxError;
+} FrameError;
+
+int failures = 0;
+Uint32 formulaFrame[FRAME_WIDTH * FRAME_HEIGHT];
+
+double LibmSin(double x) {
+    return sin(x);
+}
+
+double LibmCos(double x) {
+    return cos(x);
+}
+
+double LibmSqrt(double x) {
+    return sqrt(x);
+}
+
+DEFINE_PLASMA_SHADING(Libm, LibmSin, LibmCos, LibmSqrt)
+
+void Check(const char *name, double error, const char *unit, double limit) {
+    int passed = error < limit;
+    printf("%-4s %-44s %g %s, limit %g\n", passed ? "ok" : "FAIL", name,
+           error, unit, limit);
+    if (!passed) {
+        failures++;
+    }
+}
+
+// Sample i of count, spread evenly over [low, high].
+double GetLinearSample(int i, int count, double low, double high) {
+    return low + (high - low) * i / (count - 1);
+}
+
+// Sample i of count, spread evenly over [low, high] on a log scale.
+double GetLogSample(int i, int count, double low, double high) {
+    return low * pow(high / low, (double)i / (count - 1));
+}
+
+double GetMaxAbsoluteError(double (*fast)(double), double (*exact)(double),
+                           double low, double high) {
+    double maxError = 0.0;
+    for (int i = 0; i < SWEEP_SAMPLES; i++) {
+        double x = GetLinearSample(i, SWEEP_SAMPLES, low, high);
+        double error = fabs(fast(x) - exact(x));
+        if (error > maxError) {
+            maxError = error;
+        }
+    }
+    return maxError;
+}
+
+double GetMaxRelativeError(double (*fast)(double), double (*exact)(double),
+                           double low, double high) {
+    double maxError = 0.0;
+    for (int i = 0; i < SWEEP_SAMPLES; i++) {
+        double x = GetLogSample(i, SWEEP_SAMPLES, low, high);
+        double error = fabs(fast(x) / exact(x) - 1.0);
+        if (error > maxError) {
+            maxError = error;
+        }
+    }
+    return maxError;
+}
+
+double FastRsqrtValue(double x) {
+    return FastRsqrt(x);
+}
+
+double ExactRsqrt(double x) {
+    return 1.0 / sqrt(x);
+}
+
+// Maps a float to an integer that counts ulps, so the difference of two is
+// their distance in ulps, across zero too.
+int64_t GetOrderedFloat(float value) {
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? -(int64_t)(bits & 0x7fffffff) : bits;
+}
+
+double GetMaxUlpError(float (*fast)(float), double (*exact)(double),
+                      double low, double high) {
+    int64_t maxError = 0;
+    for (int i = 0; i < SWEEP_SAMPLES; i++) {
+        float x = (float)GetLinearSample(i, SWEEP_SAMPLES, low, high);
+        int64_t error = llabs(GetOrderedFloat(fast(x)) -
+                              GetOrderedFloat((float)exact(x)));
+        if (error > maxError) {
+            maxError = error;
+        }
+    }
+    return (double)maxError;
+}
+
+double GetMaxRsqrtfError(double low, double high) {
+    double maxError = 0.0;
+    for (int i = 0; i < SWEEP_SAMPLES; i++) {
+        float x = (float)GetLogSample(i, SWEEP_SAMPLES, low, high);
+        double error = fabs(FastRsqrtf(x) * sqrt((double)x) - 1.0);
+        if (error > maxError) {
+            maxError = error;
+        }
+    }
+    return maxError;
+}
+
+void CheckFunctions(void) {
+    // rgb_plasma passes plasma coordinates plus the time, which grows
+    // without bound, and palette_plasma pixel coordinates over 8 or 16.
+    Check("FastSin, |x| < 10", GetMaxAbsoluteError(FastSin, sin, -10.0, 10.0),
+          "abs", 2e-11);
+    Check("FastSin, |x| < 1e6",
+          GetMaxAbsoluteError(FastSin, sin, -1.0e6, 1.0e6), "abs", 2e-11);
+    Check("FastCos, |x| < 10", GetMaxAbsoluteError(FastCos, cos, -10.0, 10.0),
+          "abs", 2e-11);
+    Check("FastCos, |x| < 1e6",
+          GetMaxAbsoluteError(FastCos, cos, -1.0e6, 1.0e6), "abs", 2e-11);
+
+    // Squared distances, from the plasma's few hundred up to the squared
+    // pixel distances of a 32k palette_plasma image.
+    Check("FastSqrt, 1e-6 < x < 1e10",
+          GetMaxRelativeError(FastSqrt, sqrt, 1.0e-6, 1.0e10), "rel", 4e-11);
+    Check("FastRsqrt, 1e-6 < x < 1e10",
+          GetMaxRelativeError(FastRsqrtValue, ExactRsqrt, 1.0e-6, 1.0e10),
+          "rel", 4e-11);
+    Check("FastSqrt(0)", fabs(FastSqrt(0.0)), "abs", 1e-300);
+
+    // Rotation angles of the cube demos, and half the field of view of the
+    // perspective matrix.
+    Check("FastSinf, |x| < 1e4", GetMaxUlpError(FastSinf, sin, -1.0e4, 1.0e4),
+          "ulp", 1.5);
+    Check("FastCosf, |x| < 1e4", GetMaxUlpError(FastCosf, cos, -1.0e4, 1.0e4),
+          "ulp", 1.5);
+    Check("FastTanf, 0.01 < x < 1.5", GetMaxUlpError(FastTanf, tan, 0.01, 1.5),
+          "ulp", 1.5);
+    // Squared lengths of the vectors glmath.h normalizes.
+    Check("FastRsqrtf, 1e-6 < x < 1e6", GetMaxRsqrtfError(1.0e-6, 1.0e6),
+          "rel", 5e-6);
+}
+
+// A pixel of rgb_plasma at time t. The demo takes the centre distance from
+// its radial table, or per pixel in its strip image kernel, rounded to a
+// float either way. The libm reference keeps it exact.
+uint32_t ShadeRGBPlasma(int exact, int xi, int yi, double t) {
+    double x = GetPlasmaCoordinate(xi, FRAME_WIDTH);
+    double y = GetPlasmaCoordinate(yi, FRAME_HEIGHT);
+    double offsetX, offsetY;
+
+    if (exact) {
+        GetCentreOffsetLibm(t, CENTRE_FREQUENCY, &offsetX, &offsetY);
+        double centreX = x + offsetX;
+        double centreY = y + offsetY;
+        double centreDistance =
+            sqrt(centreX * centreX + centreY * centreY + 1.0);
+        return ShadeValueLibm(PlasmaValueLibm(x, y, t, centreDistance));
+    }
+
+    GetCentreOffset(t, CENTRE_FREQUENCY, &offsetX, &offsetY);
+    double centreX = x + offsetX;
+    double centreY = y + offsetY;
+    double centreDistance =
+        (float)FastSqrt(centreX * centreX + centreY * centreY + 1.0);
+    return ShadeValue(PlasmaValue(x, y, t, centreDistance));
+}
+
+// A pixel of the first frame of palette_plasma.
+uint32_t ShadePalettePlasma(int exact, int x, int y) {
+    double halfWidth = FRAME_WIDTH / 2.0;
+    double halfHeight = FRAME_HEIGHT / 2.0;
+
+    if (exact) {
+        return GetPaletteColorLibm(
+            GetPlasmaIndexLibm(x, y, halfWidth, halfHeight) % PALETTE_SIZE);
+    }
+    return GetPaletteColor(GetPlasmaIndex(x, y, halfWidth, halfHeight) %
+                           PALETTE_SIZE);
+}
+
+// Renders a frame of the generated classic formula at time t into
+// formulaFrame.
+void DrawClassicFormula(double t) {
+    const PlasmaFormula *formula =
+        FindPlasmaFormula(plasmaFormulas, PLASMA_FORMULA_COUNT, "classic");
+    double *columns = malloc(FRAME_WIDTH * formula->tableCount *
+                             sizeof(*columns));
+    PlasmaFormulaJob job = {formulaFrame, t, FRAME_WIDTH, FRAME_HEIGHT,
+                            columns};
+
+    formula->setup(&job);
+    formula->rows[KERNEL_GENERIC](&job, 0, FRAME_HEIGHT);
+    free(columns);
+}
+
+// A pixel of a plasma with libm, or with fastmath.h. The generated classic
+// formula is compared with rgb_plasma's fastmath.h pixels instead of libm.
+uint32_t ShadePixel(int exact, FramePlasma plasma, int xi, int yi, double t) {
+    switch (plasma) {
+    case PLASMA_PALETTE:
+        return ShadePalettePlasma(exact, xi, yi);
+    case PLASMA_CLASSIC:
+        return exact ? ShadeRGBPlasma(0, xi, yi, t)
+                     : formulaFrame[yi * FRAME_WIDTH + xi];
+    default:
+        return ShadeRGBPlasma(exact, xi, yi, t);
+    }
+}
+
+// Renders a frame of one of the plasmas both ways. Rows start at y0, so a
+// frame far down a large image can be compared too.
+FrameError CompareFrames(FramePlasma plasma, int y0, double t) {
+    double squaredErrorSum = 0.0;
+    int maxError = 0;
+
+    if (plasma == PLASMA_CLASSIC) {
+        DrawClassicFormula(t);
+    }
+
+    for (int yi = y0; yi < y0 + FRAME_HEIGHT; yi++) {
+        for (int xi = 0; xi < FRAME_WIDTH; xi++) {
+            uint32_t exact = ShadePixel(1, plasma, xi, yi, t);
+            uint32_t fast = ShadePixel(0, plasma, xi, yi, t);
+            for (int shift = 0; shift < 24; shift += 8) {
+                int error = abs((int)((exact >> shift) & 0xff) -
+                                (int)((fast >> shift) & 0xff));
+                squaredErrorSum += (double)error * error;
+                if (error > maxError) {
+                    maxError = error;
+                }
+            }
+        }
+    }
+
+    FrameError result = {INFINITY, maxError};
+    if (squaredErrorSum > 0.0) {
+        double mse = squaredErrorSum / (FRAME_WIDTH * FRAME_HEIGHT * 3.0);
+        result.psnr = 10.0 * log10(255.0 * 255.0 / mse);
+    }
+    return result;
+}
+
+void CheckFrame(const char *name, FramePlasma plasma, int y0, double t) {
+    FrameError error = CompareFrames(plasma, y0, t);
+    int passed = error.psnr >= MIN_FRAME_PSNR;
+    printf("%-4s %-44s psnr %f dB, max error %d, limit %g dB\n",
+           passed ? "ok" : "FAIL", name, error.psnr, error.maxError,
+           MIN_FRAME_PSNR);
+    if (!passed) {
+        failures++;
+    }
+}
+
+void CheckFrames(void) {
+    CheckFrame("rgb_plasma frame, t = 0", PLASMA_RGB, 0, 0.0);
+    CheckFrame("rgb_plasma frame, t = 12.5", PLASMA_RGB, 0, 12.5);
+    CheckFrame("rgb_plasma frame, t = 3600", PLASMA_RGB, 0, 3600.0);
+    CheckFrame("rgb_plasma frame, t = 86400", PLASMA_RGB, 0, 86400.0);
+    CheckFrame("palette_plasma frame", PLASMA_PALETTE, 0, 0.0);
+    CheckFrame("palette_plasma frame, rows from 32000", PLASMA_PALETTE, 32000,
+               0.0);
+    CheckFrame("classic formula frame, t = 0", PLASMA_CLASSIC, 0, 0.0);
+    CheckFrame("classic formula frame, t = 12.5", PLASMA_CLASSIC, 0, 12.5);
+    CheckFrame("classic formula frame, t = 3600", PLASMA_CLASSIC, 0, 3600.0);
+}
+
+int main(void) {
+    CheckFunctions();
+    CheckFrames();
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#ifndef FRAMEBUFFER_H_INCLUDED
+#define FRAMEBUFFER_H_INCLUDED
+
+#include "workers.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define FRAME_MEMORY_ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define MAX_NUMA_NODES 64
+#define NUMA_QUERY_PAGES 1024
+
+// Frame and field buffers are mapped without being touched, then every worker
+// writes zeros into the band it renders. On Linux that first touch decides the
+// NUMA node each page lives on. Placement is only as fine as the page size,
+// so with 2MB pages neighbouring bands can share a page.
+
+typedef enum {
+    FRAME_MEMORY_HEAP,
+    FRAME_MEMORY_HUGE_PAGES,
+    FRAME_MEMORY_TRANSPARENT_HUGE_PAGES
+} FrameMemoryBacking;
+
+typedef struct {
+    void *data;
+    size_t size;
+    size_t rowBytes;
+    FrameMemoryBacking backing;
+} FrameMemory;
+
+typedef struct {
+    unsigned char *data;
+    size_t rowBytes;
+} TouchJob;
+
+static inline const char *
+GetFrameMemoryBackingName(FrameMemoryBacking backing) {
+    switch (backing) {
+    case FRAME_MEMORY_HUGE_PAGES:
+        return "2MB huge pages";
+    case FRAME_MEMORY_TRANSPARENT_HUGE_PAGES:
+        return "transparent huge pages";
+    default:
+        return "heap";
+    }
+}
+
+static inline void TouchBand(void *data, int y0, int y1) {
+    TouchJob *job = data;
+    memset(job->data + y0 * job->rowBytes, 0, (y1 - y0) * job->rowBytes);
+}
+
+// Allocates a zeroed buffer of rows * rowBytes bytes, aligned to at least 64
+// bytes, and first touches each band of rows from the worker that owns it.
+static inline void *AllocFrameMemory(FrameMemory *memory, WorkerPool *pool,
+                                     size_t rowBytes, int rows) {
+    size_t size = rowBytes * rows;
+    memory->data = NULL;
+    memory->rowBytes = rowBytes;
+
+#ifdef __linux__
+    memory->size =
+        (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    memory->backing = FRAME_MEMORY_HUGE_PAGES;
+    void *data = mmap(NULL, memory->size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED) {
+        memory->backing = FRAME_MEMORY_TRANSPARENT_HUGE_PAGES;
+        data = mmap(NULL, memory->size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            return NULL;
+        }
+        madvise(data, memory->size, MADV_HUGEPAGE);
+    }
+    memory->data = data;
+#else
+    memory->size = (size + FRAME_MEMORY_ALIGNMENT - 1) /
+                   FRAME_MEMORY_ALIGNMENT * FRAME_MEMORY_ALIGNMENT;
+    memory->backing = FRAME_MEMORY_HEAP;
+    memory->data = aligned_alloc(FRAME_MEMORY_ALIGNMENT, memory->size);
+    if (memory->data == NULL) {
+        return NULL;
+    }
+#endif
+
+    TouchJob job = {memory->data, rowBytes};
+    RunWorkers(pool, TouchBand, &job, rows);
+
+    return memory->data;
+}
+
+static inline void FreeFrameMemory(FrameMemory *memory) {
+    if (memory->data == NULL) {
+        return;
+    }
+
+#ifdef __linux__
+    munmap(memory->data, memory->size);
+#else
+    free(memory->data);
+#endif
+    memory->data = NULL;
+}
+
+// Logs which NUMA nodes the pages of every worker's band ended up on.
+static inline void ReportFramePlacement(const char *name,
+                                        const FrameMemory *memory,
+                                        const WorkerPool *pool, int rows) {
+    printf("%s: %zu bytes backed by %s\n", name, memory->size,
+           GetFrameMemoryBackingName(memory->backing));
+
+#ifdef __linux__
+    size_t pageSize = memory->backing == FRAME_MEMORY_HUGE_PAGES
+                          ? HUGE_PAGE_SIZE
+                          : (size_t)sysconf(_SC_PAGESIZE);
+
+    for (int band = 0; band < pool->count; band++) {
+        int y0, y1;
+        GetBand(band, pool->count, rows, &y0, &y1);
+        if (y0 >= y1) {
+            continue;
+        }
+
+        unsigned char *base = memory->data;
+        size_t first = (y0 * memory->rowBytes) / pageSize;
+        size_t last = (y1 * memory->rowBytes - 1) / pageSize;
+        int nodePages[MAX_NUMA_NODES] = {0};
+        int unknownPages = 0;
+
+        for (size_t page = first; page <= last; page += NUMA_QUERY_PAGES) {
+            void *pages[NUMA_QUERY_PAGES];
+            int status[NUMA_QUERY_PAGES];
+            size_t count = last - page + 1;
+            if (count > NUMA_QUERY_PAGES) {
+                count = NUMA_QUERY_PAGES;
+            }
+            for (size_t i = 0; i < count; i++) {
+                pages[i] = base + (page + i) * pageSize;
+            }
+
+            if (syscall(SYS_move_pages, 0, count, pages, NULL, status, 0) !=
+                0) {
+                printf("  NUMA placement unavailable on this kernel\n");
+                return;
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (status[i] >= 0 && status[i] < MAX_NUMA_NODES) {
+                    nodePages[status[i]]++;
+                } else {
+                    unknownPages++;
+                }
+            }
+        }
+
+        printf("  band %d rows %d-%d, worker cpu %d:", band, y0, y1 - 1,
+               pool->workers[band].cpu);
+        for (int node = 0; node < MAX_NUMA_NODES; node++) {
+            if (nodePages[node] > 0) {
+                printf(" node %d: %d pages", node, nodePages[node]);
+            }
+        }
+        if (unknownPages > 0) {
+            printf(" unplaced: %d pages", unknownPages);
+        }
+        printf("\n");
+    }
+#else
+    (void)pool;
+    (void)rows;
+    printf("  NUMA placement is only reported on Linux\n");
+#endif
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef FRAMEQUEUE_H_INCLUDED
+#define FRAMEQUEUE_H_INCLUDED
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// SDL_GL_SwapWindow returns as soon as the driver has queued the frame, so
+// the CPU can run several frames ahead of the GPU and every queued frame adds
+// a frame of latency. The GL demos put a fence after each swap and, with a
+// frame limit, wait on the oldest fence before starting a new frame once that
+// many frames are still unfinished. Without a limit the fences only measure
+// latency, the time from starting a frame until the GPU has finished it.
+
+#define MIN_FRAMES_IN_FLIGHT 1
+#define MAX_FRAMES_IN_FLIGHT 3
+// Fences tracked without a limit. Drivers queue fewer frames than this, so
+// only a stalled GPU ever makes the demo wait on the oldest one.
+#define FRAME_QUEUE_SLOTS 8
+
+typedef struct {
+    GLsync fence;
+    Uint64 startCounter;
+} QueuedFrame;
+
+typedef struct {
+    // Frames in flight counting the one just swapped. QueueFrame waits
+    // until fewer than limit are left, so at most limit - 1 earlier frames
+    // are unfinished when a new frame starts. 0 leaves queuing to the driver.
+    int limit;
+    QueuedFrame frames[FRAME_QUEUE_SLOTS];
+    int first;
+    int count;
+    double latencyMsSum;
+    double latencyMsMax;
+    int retired;
+    double waitMsSum;
+    int waits;
+} FrameQueue;
+
+static inline int ParseFramesInFlight(const char *arg, FrameQueue *queue) {
+    char *end;
+    queue->limit = strtol(arg, &end, 10);
+    return *end != '\0' || queue->limit < MIN_FRAMES_IN_FLIGHT ||
+                   queue->limit > MAX_FRAMES_IN_FLIGHT
+               ? -1
+               : 0;
+}
+
+static inline double GetFrameQueueMs(Uint64 start, Uint64 end) {
+    return (double)(end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Retires the oldest frame if its fence signals within timeout nanoseconds.
+// Returns 1 when it did.
+static inline int RetireOldestFrame(FrameQueue *queue, GLuint64 timeout) {
+    QueuedFrame *frame = &queue->frames[queue->first];
+    GLenum result =
+        glClientWaitSync(frame->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        return 0;
+    }
+
+    // A failed wait retires the frame too, so a lost fence can't stall the
+    // demo, but it says nothing about latency.
+    if (result != GL_WAIT_FAILED) {
+        double latencyMs =
+            GetFrameQueueMs(frame->startCounter, SDL_GetPerformanceCounter());
+        queue->latencyMsSum += latencyMs;
+        if (latencyMs > queue->latencyMsMax) {
+            queue->latencyMsMax = latencyMs;
+        }
+        queue->retired++;
+    }
+
+    glDeleteSync(frame->fence);
+    queue->first = (queue->first + 1) % FRAME_QUEUE_SLOTS;
+    queue->count--;
+    return 1;
+}
+
+// Fences the frame just swapped, which started at startCounter, retires the
+// frames the GPU has already finished and then waits until fewer than the
+// limit are left in flight.
+static inline void QueueFrame(FrameQueue *queue, Uint64 startCounter) {
+    int slot = (queue->first + queue->count) % FRAME_QUEUE_SLOTS;
+    queue->frames[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    queue->frames[slot].startCounter = startCounter;
+    queue->count++;
+
+    while (queue->count > 0 && RetireOldestFrame(queue, 0)) {
+    }
+
+    int limit = queue->limit > 0 ? queue->limit : FRAME_QUEUE_SLOTS;
+    Uint64 waitStart = SDL_GetPerformanceCounter();
+    while (queue->count >= limit) {
+        RetireOldestFrame(queue, GL_TIMEOUT_IGNORED);
+    }
+    queue->waitMsSum +=
+        GetFrameQueueMs(waitStart, SDL_GetPerformanceCounter());
+    queue->waits++;
+}
+
+static inline void DestroyFrameQueue(FrameQueue *queue) {
+    while (queue->count > 0) {
+        glDeleteSync(queue->frames[queue->first].fence);
+        queue->first = (queue->first + 1) % FRAME_QUEUE_SLOTS;
+        queue->count--;
+    }
+}
+
+// Formats the average and worst latency and the average fence wait per frame
+// since the last call for the metrics line, and starts a new window.
+static inline void FormatFrameQueueStats(char *text, size_t size,
+                                         FrameQueue *queue) {
+    snprintf(text, size,
+             ", in flight: %d, latency: %f ms (max %f), fence wait: %f ms/f",
+             queue->count,
+             queue->retired > 0 ? queue->latencyMsSum / queue->retired : 0.0,
+             queue->latencyMsMax,
+             queue->waits > 0 ? queue->waitMsSum / queue->waits : 0.0);
+    queue->latencyMsSum = 0.0;
+    queue->latencyMsMax = 0.0;
+    queue->retired = 0;
+    queue->waitMsSum = 0.0;
+    queue->waits = 0;
+}
+
+#endif
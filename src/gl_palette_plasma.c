@@ -0,0 +1,569 @@
+#include "fastmath.h"
+#include "realtime.h"
+#include "trace.h"
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define WINDOW_TITLE "GL Palette Plasma"
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+#define DEFAULT_REFRESH_RATE 60
+#define PALETTE_SIZE 256
+#define PI 3.1415926535897932384626433832795
+#define VERTEX_SHADER_PATH "src/shaders/gl_palette_plasma.vert"
+#define FRAGMENT_SHADER_PATH "src/shaders/gl_palette_plasma.frag"
+
+#define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+#define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+
+SDL_DisplayMode gDisplayMode;
+SDL_Window *gWindow = NULL;
+
+SDL_GLContext *gContext = NULL;
+GLuint gProgramId = 0;
+GLuint gVAO = 0;
+GLuint gVBO = 0;
+GLuint gEBO = 0;
+GLuint gFieldTexture = 0;
+GLuint gPaletteTexture = 0;
+GLint gUniformShiftLocation = -1;
+GLint gUniformResolutionLocation = -1;
+GLint gUniformFieldLocation = -1;
+GLint gUniformPaletteLocation = -1;
+
+int gWidth = DEFAULT_WIDTH;
+int gHeight = DEFAULT_HEIGHT;
+int gFieldWidth = DEFAULT_WIDTH;
+int gFieldHeight = DEFAULT_HEIGHT;
+int gFullscreen = 0;
+const char *gTracePath = NULL;
+Realtime gRealtime = {0};
+JitterHistogram gJitter = {0};
+
+double Max(double value, double max) {
+    return value < max ? value : max;
+}
+
+double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
+    return (double)(end - start) / SDL_GetPerformanceFrequency();
+}
+
+double GetElapsedTimeMs(Uint64 start, Uint64 end) {
+    return (double)((end - start) * 1000.0) / SDL_GetPerformanceFrequency();
+}
+
+int GetDisplayRefreshRate(SDL_DisplayMode gDisplayMode) {
+    int result = gDisplayMode.refresh_rate;
+
+    if (result == 0) {
+        return DEFAULT_REFRESH_RATE;
+    }
+
+    return result;
+}
+
+int InitSDL(void) {
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                        SDL_GL_CONTEXT_PROFILE_CORE);
+
+    if (SDL_GetDesktopDisplayMode(0, &gDisplayMode) != 0) {
+        return -1;
+    }
+
+    gWindow = SDL_CreateWindow(
+        WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, gWidth,
+        gHeight, SDL_WINDOW_SHOWN | SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+    if (gWindow == NULL) {
+        return -1;
+    }
+    LogInfo("window created with size %dx%d", gWidth, gHeight);
+
+    gContext = SDL_GL_CreateContext(gWindow);
+    if (gContext == NULL) {
+        return -1;
+    }
+
+    GLenum glewError = glewInit();
+    if (glewError != GLEW_OK) {
+        LogError("error initializing GLEW! %s", glewGetErrorString(glewError));
+    }
+
+    if (SDL_GL_SetSwapInterval(1) < 0) {
+        LogInfo("warning: unable to set vsync. %s", SDL_GetError());
+    }
+
+    if (gFullscreen) {
+        SDL_SetWindowFullscreen(gWindow, SDL_WINDOW_FULLSCREEN_DESKTOP);
+    }
+
+    SDL_ShowCursor(SDL_DISABLE);
+
+    return 0;
+}
+
+void LogShaderError(GLuint shader) {
+    if (glIsShader(shader)) {
+        int infoLogLength = 0;
+        int maxLength = infoLogLength;
+
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
+
+        char *infoLog = malloc(maxLength * sizeof(*infoLog));
+        if (infoLog == NULL) {
+            LogError("failed to malloc error log for gl shader %d of size %d",
+                     shader, maxLength);
+        }
+
+        glGetShaderInfoLog(shader, maxLength, &infoLogLength, infoLog);
+        if (infoLogLength > 0) {
+            LogError("failed to compile shader %d:\n%s", shader, infoLog);
+        }
+
+        free(infoLog);
+    } else {
+        LogError("name shader %d is not a shader", shader);
+    }
+}
+
+void LogProgramError(GLuint program) {
+    if (glIsProgram(program)) {
+        int infoLogLength = 0;
+        int maxLength = infoLogLength;
+
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+
+        char *infoLog = malloc(maxLength * sizeof(*infoLog));
+        if (infoLog == NULL) {
+            LogError("failed to malloc error log for gl program %d of size %d",
+                     program, maxLength);
+        }
+
+        glGetProgramInfoLog(program, maxLength, &infoLogLength, infoLog);
+        if (infoLogLength > 0) {
+            LogError("failed to link program %d:\n%s", program, infoLog);
+        }
+
+        free(infoLog);
+    } else {
+        LogError("name program %d is not a program", program);
+    }
+}
+
+char *ReadFile(const char *filepath) {
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        fileSize = ftell(file);
+    }
+    if (fileSize < 0) {
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+
+    char *buffer = malloc((fileSize + 1) * sizeof(*buffer));
+    if (buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t result = fread(buffer, 1, fileSize, file);
+    fclose(file);
+    if ((long)result != fileSize) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[fileSize] = 0;
+    return buffer;
+}
+
+GLboolean compileShader(GLenum type, const GLchar *source[],
+                        GLuint *outShader) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, source, NULL);
+    glCompileShader(shader);
+
+    *outShader = shader;
+
+    GLint shaderCompiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &shaderCompiled);
+    if (shaderCompiled != GL_TRUE) {
+        return GL_FALSE;
+    }
+
+    return GL_TRUE;
+}
+
+// The same palette as palette_plasma, as tightly packed RGB bytes.
+void FillPalette(GLubyte *palette) {
+    for (int x = 0; x < PALETTE_SIZE; x++) {
+        GLubyte *entry = &palette[x * 3];
+        entry[0] = (GLubyte)Max(128.0 + 128 * FastSin(PI * x / 32.0), 255);
+        entry[1] = 0;
+        entry[2] = (GLubyte)Max(128.0 + 128 * FastSin(PI * x / 64.0), 255);
+    }
+}
+
+// The same field as palette_plasma, with row 0 at the top of the screen. The
+// values stay below 256, so they fit a single byte.
+void FillField(GLubyte *field) {
+    double halfWidth = gFieldWidth / 2.0;
+    double halfHeight = gFieldHeight / 2.0;
+
+    for (int y = 0; y < gFieldHeight; y++) {
+        for (int x = 0; x < gFieldWidth; x++) {
+            double color = 128.0 + (128.0 * FastSin(x / 16.0));
+            color += 128.0 + (128.0 * FastSin(y / 8.0));
+            color += 128.0 + (128.0 * FastSin((x + y) / 16.0));
+            double centreX = x - halfWidth;
+            double centreY = y - halfHeight;
+            color += 128.0 +
+                     (128.0 *
+                      FastSin(FastSqrt(centreX * centreX + centreY * centreY) /
+                              8.0));
+            double originDistance = FastSqrt((double)(x * x + y * y));
+            color += 128.0 + (128.0 * FastSin(originDistance / 8.0));
+
+            field[y * gFieldWidth + x] = (GLubyte)((Uint32)color / 8);
+        }
+    }
+}
+
+// Uploads the field as an R8 texture and the palette as a 1D texture. Both
+// are only ever written here, every frame after this just moves the shift.
+int InitTextures(void) {
+    GLubyte *field = malloc((size_t)gFieldWidth * gFieldHeight);
+    if (field == NULL) {
+        LogError("failed to allocate field %dx%d", gFieldWidth, gFieldHeight);
+        return -1;
+    }
+    FillField(field);
+
+    GLubyte palette[PALETTE_SIZE * 3];
+    FillPalette(palette);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glGenTextures(1, &gFieldTexture);
+    glBindTexture(GL_TEXTURE_2D, gFieldTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, gFieldWidth, gFieldHeight, 0, GL_RED,
+                 GL_UNSIGNED_BYTE, field);
+
+    glGenTextures(1, &gPaletteTexture);
+    glBindTexture(GL_TEXTURE_1D, gPaletteTexture);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB8, PALETTE_SIZE, 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, palette);
+
+    free(field);
+
+    if (glGetError() != GL_NO_ERROR) {
+        LogError("failed to upload field and palette textures");
+        return -1;
+    }
+    LogInfo("uploaded %dx%d field and %d entry palette", gFieldWidth,
+            gFieldHeight, PALETTE_SIZE);
+
+    return 0;
+}
+
+int InitGL(void) {
+    gProgramId = glCreateProgram();
+
+    GLuint vertexShader;
+    char *vertexShaderSource = ReadFile(VERTEX_SHADER_PATH);
+    if (vertexShaderSource == NULL) {
+        LogError("could not read file %s", VERTEX_SHADER_PATH);
+    }
+    if (compileShader(GL_VERTEX_SHADER, (const char **)&vertexShaderSource,
+                      &vertexShader) != GL_TRUE) {
+        LogShaderError(vertexShader);
+        return -1;
+    }
+
+    GLuint fragmentShader;
+    char *fragmentShaderSource = ReadFile(FRAGMENT_SHADER_PATH);
+    if (fragmentShaderSource == NULL) {
+        LogError("could not read file %s", FRAGMENT_SHADER_PATH);
+    }
+    if (compileShader(GL_FRAGMENT_SHADER, (const char **)&fragmentShaderSource,
+                      &fragmentShader) != GL_TRUE) {
+        LogShaderError(fragmentShader);
+        return -1;
+    }
+
+    free(fragmentShaderSource);
+    free(vertexShaderSource);
+
+    glAttachShader(gProgramId, vertexShader);
+    glAttachShader(gProgramId, fragmentShader);
+
+    glLinkProgram(gProgramId);
+    GLint programSuccess = GL_TRUE;
+    glGetProgramiv(gProgramId, GL_LINK_STATUS, &programSuccess);
+    if (programSuccess != GL_TRUE) {
+        LogProgramError(gProgramId);
+        return -1;
+    }
+
+    glDeleteShader(fragmentShader);
+    glDeleteShader(vertexShader);
+
+    gUniformShiftLocation = glGetUniformLocation(gProgramId, "uShift");
+    if (gUniformShiftLocation == -1) {
+        LogError("could not get uniform location for uShift");
+        return -1;
+    }
+    gUniformResolutionLocation =
+        glGetUniformLocation(gProgramId, "uResolution");
+    if (gUniformResolutionLocation == -1) {
+        LogError("could not get uniform location for uResolution");
+        return -1;
+    }
+    gUniformFieldLocation = glGetUniformLocation(gProgramId, "uField");
+    if (gUniformFieldLocation == -1) {
+        LogError("could not get uniform location for uField");
+        return -1;
+    }
+    gUniformPaletteLocation = glGetUniformLocation(gProgramId, "uPalette");
+    if (gUniformPaletteLocation == -1) {
+        LogError("could not get uniform location for uPalette");
+        return -1;
+    }
+
+    if (InitTextures() != 0) {
+        return -1;
+    }
+
+    glViewport(0, 0, gWidth, gHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    GLfloat vertexData[] = {-1.0f, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f, -1.0f};
+    GLuint elements[] = {0, 1, 2, 2, 3, 0};
+
+    glGenVertexArrays(1, &gVAO);
+    glBindVertexArray(gVAO);
+
+    glGenBuffers(1, &gVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, gVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData,
+                 GL_STATIC_DRAW);
+
+    glGenBuffers(1, &gEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements), elements,
+                 GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
+                          (void *)0);
+    glEnableVertexAttribArray(0);
+
+    return 0;
+}
+
+void DrawFrame(double elapsedTimeSecs) {
+    // The shift advances at the same rate as in palette_plasma, one entry
+    // every 32ms.
+    int paletteShift = (int)(elapsedTimeSecs * 1000.0 / 32.0) % PALETTE_SIZE;
+
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUseProgram(gProgramId);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gFieldTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, gPaletteTexture);
+
+    glUniform1i(gUniformFieldLocation, 0);
+    glUniform1i(gUniformPaletteLocation, 1);
+    glUniform2i(gUniformResolutionLocation, gWidth, gHeight);
+    glUniform1i(gUniformShiftLocation, paletteShift);
+
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
+
+void DestroyGL(void) {
+    glDeleteTextures(1, &gPaletteTexture);
+    glDeleteTextures(1, &gFieldTexture);
+    glDeleteBuffers(1, &gEBO);
+    glDeleteBuffers(1, &gVBO);
+    glDeleteVertexArrays(1, &gVAO);
+    glDeleteProgram(gProgramId);
+}
+
+void DestroySDL(void) {
+    SDL_DestroyWindow(gWindow);
+    SDL_Quit();
+}
+
+int main(int argc, char *argv[]) {
+    char opt;
+    while ((opt = getopt(argc, argv, ":w:h:ft:JR:")) != -1) {
+        switch (opt) {
+        case 'w':
+            // Obviously not proper use of strtol, but, thats fine
+            // for this simple program.
+            gWidth = strtol(optarg, (char **)NULL, 10);
+            if (gWidth == 0) {
+                fprintf(stderr, "invalid value for width: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            gHeight = strtol(optarg, (char **)NULL, 10);
+            if (gHeight == 0) {
+                fprintf(stderr, "invalid value for height: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            gFullscreen = 1;
+            break;
+        case 't':
+            gTracePath = optarg;
+            break;
+        case 'J':
+            gJitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &gRealtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            gJitter.enabled = 1;
+            break;
+        }
+    }
+
+    if (gTracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&gRealtime);
+
+    // The field keeps the size the window was created with and is stretched
+    // over the window when it is resized.
+    gFieldWidth = gWidth;
+    gFieldHeight = gHeight;
+
+    if (InitSDL() != 0) {
+        fprintf(stderr, "error initializing SDL, %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    if (InitGL() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    int refreshRate = GetDisplayRefreshRate(gDisplayMode);
+    const double targetSecsPerFrame = 1.0 / (double)refreshRate;
+    LogInfo("display refresh rate %d, target secs per frame %f", refreshRate,
+            targetSecsPerFrame);
+
+    double elapsedTimeSecs = 0.0;
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+    Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
+    SDL_Event event;
+    int isRunning = 1;
+    StartJitterHistogram(&gJitter, targetSecsPerFrame);
+    LockRealtimeMemory(&gRealtime);
+
+    while (isRunning) {
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
+                isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
+                    event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    gWidth = event.window.data1;
+                    gHeight = event.window.data2;
+                    glViewport(0, 0, gWidth, gHeight);
+                }
+                break;
+            }
+        }
+        TraceEnd("poll events", traceStart);
+
+        elapsedTimeSecs += targetSecsPerFrame;
+
+        traceStart = TraceBegin();
+        DrawFrame(elapsedTimeSecs);
+        TraceEnd("DrawFrame", traceStart);
+
+        // Manually cap the frame rate
+        traceStart = TraceBegin();
+        SleepUntilFrameTime(&gRealtime, lastCounter, targetSecsPerFrame);
+        while (GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) <
+               targetSecsPerFrame) {
+        }
+        assert(GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) >=
+               targetSecsPerFrame);
+
+        Uint64 endCounter = SDL_GetPerformanceCounter();
+        TraceEnd("pacing wait", traceStart);
+
+        traceStart = TraceBegin();
+        SDL_GL_SwapWindow(gWindow);
+        TraceEnd("swap", traceStart);
+        AddJitterFrame(&gJitter, SDL_GetPerformanceCounter());
+
+        double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
+        double fps = (double)SDL_GetPerformanceFrequency() /
+                     (double)(endCounter - lastCounter);
+
+        if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
+            1000.0) {
+            printf("ms/f: %f, fps: %f\r", msPerFrame, fps);
+            fflush(stdout);
+            metricsPrintCounter = SDL_GetPerformanceCounter();
+        }
+
+        lastCounter = endCounter;
+    }
+    PrintJitterHistogram(&gJitter);
+
+    DestroyGL();
+
+    if (gTracePath != NULL) {
+        if (WriteTrace(gTracePath) != 0) {
+            LogError("failed to write trace to %s", gTracePath);
+        } else {
+            LogInfo("wrote trace to %s", gTracePath);
+        }
+    }
+
+    DestroySDL();
+
+    return EXIT_SUCCESS;
+}
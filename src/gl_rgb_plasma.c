@@ -1,3 +1,6 @@
+#include "framequeue.h"
+#include "realtime.h"
+#include "trace.h"
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
@@ -12,7 +15,9 @@
 #define DEFAULT_HEIGHT 480
 #define DEFAULT_REFRESH_RATE 60
 #define VERTEX_SHADER_PATH "src/shaders/gl_rgb_plasma.vert"
-#define FRAGMENT_SHADER_PATH "src/shaders/gl_rgb_plasma.frag"
+#define FORMULA_SHADER_DIRECTORY "src/shaders/generated"
+#define FRAGMENT_SHADER_PATH FORMULA_SHADER_DIRECTORY "/classic.frag"
+#define MAX_SHADER_PATH_SIZE 256
 
 #define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 #define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
@@ -32,6 +37,11 @@ GLint gUniformScaleLocation = -1;
 int gWidth = DEFAULT_WIDTH;
 int gHeight = DEFAULT_HEIGHT;
 int gFullscreen = 0;
+const char *gTracePath = NULL;
+FrameQueue gFrameQueue = {0};
+char gFragmentShaderPath[MAX_SHADER_PATH_SIZE] = FRAGMENT_SHADER_PATH;
+Realtime gRealtime = {0};
+JitterHistogram gJitter = {0};
 
 double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
     return (double)(end - start) / SDL_GetPerformanceFrequency();
@@ -148,22 +158,29 @@ char *ReadFile(const char *filepath) {
         return NULL;
     }
 
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        fileSize = ftell(file);
+    }
+    if (fileSize < 0) {
+        fclose(file);
+        return NULL;
+    }
     rewind(file);
 
     char *buffer = malloc((fileSize + 1) * sizeof(*buffer));
     if (buffer == NULL) {
+        fclose(file);
         return NULL;
     }
 
     size_t result = fread(buffer, 1, fileSize, file);
+    fclose(file);
     if ((long)result != fileSize) {
+        free(buffer);
         return NULL;
     }
 
-    fclose(file);
-
     buffer[fileSize] = 0;
     return buffer;
 }
@@ -200,9 +217,10 @@ int InitGL(void) {
     }
 
     GLuint fragmentShader;
-    char *fragmentShaderSource = ReadFile(FRAGMENT_SHADER_PATH);
+    char *fragmentShaderSource = ReadFile(gFragmentShaderPath);
     if (fragmentShaderSource == NULL) {
-        LogError("could not read file %s", FRAGMENT_SHADER_PATH);
+        LogError("could not read file %s", gFragmentShaderPath);
+        return -1;
     }
     if (compileShader(GL_FRAGMENT_SHADER, (const char **)&fragmentShaderSource,
                       &fragmentShader) != GL_TRUE) {
@@ -296,7 +314,7 @@ void DestroySDL(void) {
 
 int main(int argc, char *argv[]) {
     char opt;
-    while ((opt = getopt(argc, argv, ":w:h:f")) != -1) {
+    while ((opt = getopt(argc, argv, ":w:h:ft:v:q:JR:")) != -1) {
         switch (opt) {
         case 'w':
             // Obviously not proper use of strtol, but, thats fine
@@ -317,9 +335,41 @@ int main(int argc, char *argv[]) {
         case 'f':
             gFullscreen = 1;
             break;
+        case 't':
+            gTracePath = optarg;
+            break;
+        case 'J':
+            gJitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &gRealtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            gJitter.enabled = 1;
+            break;
+        case 'q':
+            if (ParseFramesInFlight(optarg, &gFrameQueue) != 0) {
+                fprintf(stderr, "invalid value for frames in flight: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            // The shaders plasmagen generated from src/plasmas.
+            snprintf(gFragmentShaderPath, sizeof(gFragmentShaderPath),
+                     "%s/%s.frag", FORMULA_SHADER_DIRECTORY, optarg);
+            break;
         }
     }
 
+    if (gTracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&gRealtime);
+
     if (InitSDL() != 0) {
         fprintf(stderr, "error initializing SDL, %s\n", SDL_GetError());
         return EXIT_FAILURE;
@@ -339,33 +389,43 @@ int main(int argc, char *argv[]) {
     Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
     SDL_Event event;
     int isRunning = 1;
+    StartJitterHistogram(&gJitter, targetSecsPerFrame);
+    LockRealtimeMemory(&gRealtime);
 
     while (isRunning) {
-        SDL_PollEvent(&event);
-        switch (event.type) {
-        case SDL_QUIT:
-            isRunning = 0;
-            break;
-        case SDL_KEYDOWN:
-            if (event.key.keysym.sym == SDLK_ESCAPE) {
+        Uint64 frameStartCounter = SDL_GetPerformanceCounter();
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
                 isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
+                    event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    gWidth = event.window.data1;
+                    gHeight = event.window.data2;
+                    glViewport(0, 0, gWidth, gHeight);
+                }
+                break;
             }
-            break;
-        case SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
-                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-                gWidth = event.window.data1;
-                gHeight = event.window.data2;
-                glViewport(0, 0, gWidth, gHeight);
-            }
-            break;
         }
+        TraceEnd("poll events", traceStart);
 
         elapsedTimeSecs += targetSecsPerFrame;
 
+        traceStart = TraceBegin();
         DrawFrame(elapsedTimeSecs);
+        TraceEnd("DrawFrame", traceStart);
 
         // Manually cap the frame rate
+        traceStart = TraceBegin();
+        SleepUntilFrameTime(&gRealtime, lastCounter, targetSecsPerFrame);
         while (GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) <
                targetSecsPerFrame) {
         }
@@ -373,8 +433,16 @@ int main(int argc, char *argv[]) {
                targetSecsPerFrame);
 
         Uint64 endCounter = SDL_GetPerformanceCounter();
+        TraceEnd("pacing wait", traceStart);
 
+        traceStart = TraceBegin();
         SDL_GL_SwapWindow(gWindow);
+        TraceEnd("swap", traceStart);
+        AddJitterFrame(&gJitter, SDL_GetPerformanceCounter());
+
+        traceStart = TraceBegin();
+        QueueFrame(&gFrameQueue, frameStartCounter);
+        TraceEnd("fence wait", traceStart);
 
         double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
         double fps = (double)SDL_GetPerformanceFrequency() /
@@ -382,15 +450,29 @@ int main(int argc, char *argv[]) {
 
         if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
             1000.0) {
-            printf("ms/f: %f, fps: %f\r", msPerFrame, fps);
+            char queueStats[128];
+            FormatFrameQueueStats(queueStats, sizeof(queueStats),
+                                  &gFrameQueue);
+            printf("ms/f: %f, fps: %f%s\r", msPerFrame, fps, queueStats);
             fflush(stdout);
             metricsPrintCounter = SDL_GetPerformanceCounter();
         }
 
         lastCounter = endCounter;
     }
+    PrintJitterHistogram(&gJitter);
 
+    DestroyFrameQueue(&gFrameQueue);
     DestroyGL();
+
+    if (gTracePath != NULL) {
+        if (WriteTrace(gTracePath) != 0) {
+            LogError("failed to write trace to %s", gTracePath);
+        } else {
+            LogInfo("wrote trace to %s", gTracePath);
+        }
+    }
+
     DestroySDL();
 
     return EXIT_SUCCESS;
@@ -1,7 +1,7 @@
 #ifndef GLMATH_H_INCLUDED
 #define GLMATH_H_INCLUDED
 
-#include <math.h>
+#include "fastmath.h"
 
 #define VEC3_ZERO_INIT                                                         \
     { 0.0f, 0.0f, 0.0f }
@@ -28,11 +28,12 @@ static inline void Vec3Sub(Vec3 lhs, Vec3 rhs, Vec3 out) {
 }
 
 static inline void Vec3Norm(Vec3 out) {
-    float length = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+    float inverseLength =
+        FastRsqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
 
-    out[0] /= length;
-    out[1] /= length;
-    out[2] /= length;
+    out[0] *= inverseLength;
+    out[1] *= inverseLength;
+    out[2] *= inverseLength;
 }
 
 static inline void Vec3Cross(Vec3 lhs, Vec3 rhs, Vec3 out) {
@@ -88,12 +89,21 @@ static inline void Mat4Mul(Mat4 lhs, Mat4 rhs, Mat4 out) {
               lhs[15] * rhs[15];
 }
 
+// Transforms a column vector the way GL applies a matrix uploaded with
+// glUniformMatrix4fv and transpose set to GL_FALSE.
+static inline void Mat4MulVec4(Mat4 lhs, const float rhs[4], float out[4]) {
+    for (int row = 0; row < 4; row++) {
+        out[row] = lhs[row] * rhs[0] + lhs[4 + row] * rhs[1] +
+                   lhs[8 + row] * rhs[2] + lhs[12 + row] * rhs[3];
+    }
+}
+
 static inline void Mat4RotateZ(Mat4 in, Mat4 out, float angle) {
     Mat4 transform = MAT4_IDENTITY_INIT;
 
     float c, s;
-    c = cosf(angle);
-    s = sinf(angle);
+    c = FastCosf(angle);
+    s = FastSinf(angle);
 
     transform[0] = c;
     transform[1] = s;
@@ -107,8 +117,8 @@ static inline void Mat4RotateX(Mat4 in, Mat4 out, float angle) {
     Mat4 transform = MAT4_IDENTITY_INIT;
 
     float c, s;
-    c = cosf(angle);
-    s = sinf(angle);
+    c = FastCosf(angle);
+    s = FastSinf(angle);
 
     transform[5] = c;
     transform[6] = s;
@@ -122,8 +132,8 @@ static inline void Mat4RotateY(Mat4 in, Mat4 out, float angle) {
     Mat4 transform = MAT4_IDENTITY_INIT;
 
     float c, s;
-    c = cosf(angle);
-    s = sinf(angle);
+    c = FastCosf(angle);
+    s = FastSinf(angle);
 
     transform[0] = c;
     transform[2] = -s;
@@ -162,7 +172,7 @@ static inline void Mat4Perspective(float fovy, float aspect, float nearVal,
                                    float farVal, Mat4 out) {
     float f, fn;
 
-    f = 1.0f / tanf(fovy * 0.5f);
+    f = 1.0f / FastTanf(fovy * 0.5f);
     fn = 1.0f / (nearVal - farVal);
 
     out[0] = f / aspect;
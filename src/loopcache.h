@@ -0,0 +1,112 @@
+#ifndef LOOPCACHE_H_INCLUDED
+#define LOOPCACHE_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOOP_CACHE_MAGIC "PLASMALP"
+#define LOOP_CACHE_VERSION 1
+#define LOOP_CACHE_PALETTE_SIZE 256
+
+// A loop cache holds every frame of one seamless loop as an 8 bit palette
+// index per pixel, after a header carrying the palette the indices refer to.
+// Playing it back only takes a palette lookup per pixel, straight out of the
+// mapped file.
+
+typedef struct {
+    char magic[8];
+    Uint32 version;
+    Uint32 width;
+    Uint32 height;
+    Uint32 frameCount;
+    Uint32 palette[LOOP_CACHE_PALETTE_SIZE];
+} LoopCacheHeader;
+
+typedef struct {
+    void *data;
+    size_t size;
+    const LoopCacheHeader *header;
+    const Uint8 *frames;
+} LoopCache;
+
+static inline void InitLoopCacheHeader(LoopCacheHeader *header, int width,
+                                       int height, int frameCount) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, LOOP_CACHE_MAGIC, sizeof(header->magic));
+    header->version = LOOP_CACHE_VERSION;
+    header->width = (Uint32)width;
+    header->height = (Uint32)height;
+    header->frameCount = (Uint32)frameCount;
+}
+
+static inline size_t GetLoopCacheFrameSize(const LoopCacheHeader *header) {
+    return (size_t)header->width * header->height;
+}
+
+// The size of a loop cache file of frameCount frames, header included.
+static inline Uint64 GetLoopCacheFileSize(int width, int height,
+                                          int frameCount) {
+    return sizeof(LoopCacheHeader) + (Uint64)width * height * frameCount;
+}
+
+// Maps a loop cache read only. Returns 0 on success, or -1 when the file is
+// missing, truncated or not a loop cache of this version.
+static inline int MapLoopCache(LoopCache *cache, const char *path) {
+    memset(cache, 0, sizeof(*cache));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        (size_t)info.st_size < sizeof(LoopCacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    const LoopCacheHeader *header = data;
+    size_t expectedSize = sizeof(*header) + GetLoopCacheFrameSize(header) *
+                                                header->frameCount;
+    if (memcmp(header->magic, LOOP_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != LOOP_CACHE_VERSION || header->frameCount == 0 ||
+        (size_t)info.st_size != expectedSize) {
+        munmap(data, info.st_size);
+        return -1;
+    }
+
+    cache->data = data;
+    cache->size = info.st_size;
+    cache->header = header;
+    cache->frames = (const Uint8 *)data + sizeof(*header);
+
+    return 0;
+}
+
+static inline const Uint8 *GetLoopCacheFrame(const LoopCache *cache,
+                                             int frame) {
+    return cache->frames + GetLoopCacheFrameSize(cache->header) * frame;
+}
+
+static inline void UnmapLoopCache(LoopCache *cache) {
+    if (cache->data == NULL) {
+        return;
+    }
+
+    munmap(cache->data, cache->size);
+    memset(cache, 0, sizeof(*cache));
+}
+
+#endif
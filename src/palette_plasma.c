@@ -1,3 +1,15 @@
+#include "benchmark.h"
+#include "cpudispatch.h"
+#include "fastmath.h"
+#include "framebuffer.h"
+#include "perfcounters.h"
+#include "plasmashading.h"
+#include "realtime.h"
+#include "rgb565.h"
+#include "shmring.h"
+#include "stripimage.h"
+#include "trace.h"
+#include "workers.h"
 #include <SDL2/SDL.h>
 #include <assert.h>
 #include <math.h>
@@ -15,30 +27,55 @@
 #define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 #define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 
+typedef void (*InitPlasmaRowsKernel)(int y0, int y1);
+typedef void (*DrawRowsKernel)(int paletteShift, int y0, int y1);
+typedef void (*StripRowsKernel)(const ImageStrip *strip, int y0, int y1);
+
 SDL_DisplayMode displayMode;
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
 SDL_Texture *texture = NULL;
 Uint32 *pixelBuffer = NULL;
+Uint16 *pixelBuffer16 = NULL;
 Uint32 *plasmaBuffer = NULL;
 Uint32 palette[PALETTE_SIZE];
+// The palette packed to RGB565 once for every cell of the 4x4 Bayer matrix.
+// The four palettes of a matrix row are interleaved, entry by entry, so the
+// kernel picks a pixel's dithered color with a single lookup.
+Uint16 ditheredPalettes[BAYER_SIZE][PALETTE_SIZE * BAYER_SIZE];
+FrameMemory pixelMemory;
+FrameMemory plasmaMemory;
+WorkerPool workerPool;
+PerfTotals perfCounters;
+ShmRing shmRing;
+UploadStats uploadStats;
+Benchmark benchmark;
+Realtime realtime;
+JitterHistogram jitter;
+StripImage stripImage;
 
 int width = DEFAULT_WIDTH;
 int height = DEFAULT_HEIGHT;
 int fullscreen = 0;
-
-double Max(double value, double max) {
-    return value < max ? value : max;
-}
+int workerCount = 0;
+int reportPlacement = 0;
+int perfEnabled = 0;
+int outputDepth = OUTPUT_DEPTH_32;
+Kernel kernel = KERNEL_GENERIC;
+int kernelOverridden = 0;
+InitPlasmaRowsKernel initPlasmaRows = NULL;
+DrawRowsKernel drawRows = NULL;
+DrawRowsKernel drawRows16 = NULL;
+StripRowsKernel stripRows = NULL;
+const char *tracePath = NULL;
+const char *stripPath = NULL;
+char shmRingName[SHM_RING_NAME_SIZE] = "";
+int shmRingSlots = DEFAULT_SHM_RING_SLOTS;
 
 int Get1DArrayIndex(int x, int y, int width) {
     return (y * width) + x;
 }
 
-Uint32 RGBToUint32(Uint8 r, Uint8 g, Uint8 b) {
-    return (Uint32)((r << 16) + (g << 8) + b);
-}
-
 double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
     return (double)(end - start) / SDL_GetPerformanceFrequency();
 }
@@ -87,7 +124,7 @@ int InitSDL(void) {
 
     SDL_RenderSetLogicalSize(renderer, width, height);
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888,
+    texture = SDL_CreateTexture(renderer, GetOutputFormat(outputDepth),
                                 SDL_TEXTUREACCESS_STREAMING, width, height);
     if (texture == NULL) {
         return -1;
@@ -98,46 +135,187 @@ int InitSDL(void) {
 
 void InitPalette(void) {
     for (int x = 0; x < PALETTE_SIZE; x++) {
-        Uint8 r = (Uint8)Max(128.0 + 128 * sin(PI * x / 32.0), 255);
-        Uint8 b = (Uint8)Max(128.0 + 128 * sin(PI * x / 64.0), 255);
-        palette[x] = RGBToUint32(r, 0, b);
+        palette[x] = GetPaletteColor(x);
+    }
+
+    for (int y = 0; y < BAYER_SIZE; y++) {
+        for (int x = 0; x < PALETTE_SIZE * BAYER_SIZE; x++) {
+            ditheredPalettes[y][x] =
+                PackRGB565(palette[x / BAYER_SIZE],
+                           GetBayerThreshold(x % BAYER_SIZE, y));
+        }
     }
 }
 
-void InitPlasma(void) {
+KERNEL_INLINE void InitPlasmaRowsBody(int y0, int y1) {
+    const int plasmaWidth = width;
+    double halfWidth = width / 2.0;
+    double halfHeight = height / 2.0;
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < plasmaWidth; x++) {
+            int index = Get1DArrayIndex(x, y, plasmaWidth);
+            plasmaBuffer[index] = GetPlasmaIndex(x, y, halfWidth, halfHeight);
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(InitPlasmaRowsKernel, InitPlasmaRows, (int y0, int y1),
+                       (y0, y1));
+
+KERNEL_INLINE void DrawRowsBody(int paletteShift, int y0, int y1) {
+    const int frameWidth = width;
+    const Uint32 *plasma = plasmaBuffer;
+    Uint32 *pixels = pixelBuffer;
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < frameWidth; x++) {
+            int index = Get1DArrayIndex(x, y, frameWidth);
+
+            pixels[index] =
+                palette[(plasma[index] + paletteShift) % PALETTE_SIZE];
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(DrawRowsKernel, DrawRows,
+                       (int paletteShift, int y0, int y1),
+                       (paletteShift, y0, y1));
+
+KERNEL_INLINE void DrawRows16Body(int paletteShift, int y0, int y1) {
+    const int frameWidth = width;
+    const Uint32 *plasma = plasmaBuffer;
+    Uint16 *pixels = pixelBuffer16;
+
+    for (int y = y0; y < y1; y++) {
+        const Uint16 *rowPalettes = ditheredPalettes[y % BAYER_SIZE];
+
+        for (int x = 0; x < frameWidth; x++) {
+            int index = Get1DArrayIndex(x, y, frameWidth);
+            int entry = (plasma[index] + paletteShift) % PALETTE_SIZE;
+
+            pixels[index] = rowPalettes[entry * BAYER_SIZE + x % BAYER_SIZE];
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(DrawRowsKernel, DrawRows16,
+                       (int paletteShift, int y0, int y1),
+                       (paletteShift, y0, y1));
+
+// Evaluates the rows [y0, y1) of a strip of a strip image, the first frame
+// with its palette unshifted, straight to RGB bytes without a plasma buffer.
+KERNEL_INLINE void StripRowsBody(const ImageStrip *strip, int y0, int y1) {
+    const int frameWidth = width;
     double halfWidth = width / 2.0;
     double halfHeight = height / 2.0;
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            double color = 128.0 + (128.0 * sin(x / 16.0));
-            color += 128.0 + (128.0 * sin(y / 8.0));
-            color += 128.0 + (128.0 * sin((x + y) / 16.0));
-            color += 128.0 +
-                     (128.0 *
-                      sin(sqrt((double)((x - halfWidth) * (x - halfWidth) +
-                                        (y - halfHeight) * (y - halfHeight))) /
-                          8.0));
-            // Uncomment for some weird shit
-            // color += 128.0 + (128.0 * sin((x * y) / 128.0));
-            color += 128.0 + (128.0 * sin(sqrt((double)(x * x + y * y)) / 8.0));
-
-            int index = Get1DArrayIndex(x, y, width);
-            plasmaBuffer[index] = (Uint32)color / 8;
+    for (int row = y0; row < y1; row++) {
+        int y = strip->y0 + row;
+        unsigned char *pixels = strip->pixels + row * strip->rowBytes;
+
+        for (int x = 0; x < frameWidth; x++) {
+            Uint32 pixel =
+                palette[GetPlasmaIndex(x, y, halfWidth, halfHeight) %
+                        PALETTE_SIZE];
+            pixels[x * 3 + 0] = (pixel >> 16) & 0xff;
+            pixels[x * 3 + 1] = (pixel >> 8) & 0xff;
+            pixels[x * 3 + 2] = pixel & 0xff;
         }
     }
 }
 
+DEFINE_KERNEL_VARIANTS(StripRowsKernel, StripRows,
+                       (const ImageStrip *strip, int y0, int y1),
+                       (strip, y0, y1));
+
+void InitPlasmaBand(void *data, int y0, int y1) {
+    (void)data;
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    initPlasmaRows(y0, y1);
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&perfCounters, &start, &end);
+    }
+}
+
+void DrawBand(void *data, int y0, int y1) {
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    if (outputDepth == OUTPUT_DEPTH_16) {
+        drawRows16(*(int *)data, y0, y1);
+    } else {
+        drawRows(*(int *)data, y0, y1);
+    }
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&perfCounters, &start, &end);
+    }
+}
+
+void StripBand(void *data, int y0, int y1) {
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    stripRows(data, y0, y1);
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&perfCounters, &start, &end);
+    }
+}
+
+// Renders the first frame as a strip image to stripPath, without a window
+// or any frame sized buffer.
+int RenderStripImage(void) {
+    if (CreateWorkerPool(&workerPool, workerCount) != 0) {
+        LogError("failed to create %d workers, %s", workerCount,
+                 SDL_GetError());
+        return -1;
+    }
+    LogInfo("rendering with %d workers", workerCount);
+
+    InitPalette();
+    stripImage.width = width;
+    stripImage.height = height;
+    int result =
+        WriteStripImage(&stripImage, &workerPool, StripBand, NULL, stripPath);
+    if (result == 0 && perfEnabled) {
+        char counters[256];
+        PerfSample sample;
+        TakePerfTotals(&perfCounters, &sample);
+        FormatPerfCounters(counters, sizeof(counters), &sample, 1,
+                           (double)width * height);
+        LogInfo("strip image counters%s", counters);
+    }
+
+    DestroyWorkerPool(&workerPool);
+    return result;
+}
+
+void InitPlasma(void) {
+    RunWorkers(&workerPool, InitPlasmaBand, NULL, height);
+}
+
 void DrawFrame(double elapsedTimeInMs) {
     int paletteShift = (int)(elapsedTimeInMs / 32.0);
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int index = Get1DArrayIndex(x, y, width);
+    RunWorkers(&workerPool, DrawBand, &paletteShift, height);
+}
 
-            pixelBuffer[index] =
-                palette[(plasmaBuffer[index] + paletteShift) % PALETTE_SIZE];
-        }
+void SaveTrace(void) {
+    if (WriteTrace(tracePath) != 0) {
+        LogError("failed to write trace to %s", tracePath);
+    } else {
+        LogInfo("wrote trace to %s", tracePath);
     }
 }
 
@@ -150,7 +328,7 @@ void DestroySDL(void) {
 
 int main(int argc, char *argv[]) {
     char opt;
-    while ((opt = getopt(argc, argv, ":w:h:f")) != -1) {
+    while ((opt = getopt(argc, argv, ":w:h:fk:j:Npt:m:b:B:JR:o:S:")) != -1) {
         switch (opt) {
         case 'w':
             // Obviously not proper use of strtol, but, thats fine
@@ -171,9 +349,129 @@ int main(int argc, char *argv[]) {
         case 'f':
             fullscreen = 1;
             break;
+        case 'k':
+            if (ParseKernel(optarg, &kernel) != 0) {
+                fprintf(stderr, "invalid value for kernel: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            kernelOverridden = 1;
+            break;
+        case 'j':
+            workerCount = strtol(optarg, (char **)NULL, 10);
+            if (workerCount <= 0 || workerCount > MAX_WORKERS) {
+                fprintf(stderr, "invalid value for j: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'N':
+            reportPlacement = 1;
+            break;
+        case 'p':
+            perfEnabled = 1;
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        case 'J':
+            jitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &realtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            jitter.enabled = 1;
+            break;
+        case 'o':
+            stripPath = optarg;
+            break;
+        case 'S':
+            if (ParseStripRows(optarg, &stripImage) != 0) {
+                fprintf(stderr, "invalid value for strip rows: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm':
+            if (ParseShmRingOption(optarg, shmRingName, sizeof(shmRingName),
+                                   &shmRingSlots) != 0) {
+                fprintf(stderr, "invalid value for shm ring: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'B':
+            if (ParseBenchmarkFrames(optarg, &benchmark) != 0) {
+                fprintf(stderr, "invalid value for benchmark frames: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            outputDepth = strtol(optarg, (char **)NULL, 10);
+            if (outputDepth != OUTPUT_DEPTH_32 &&
+                outputDepth != OUTPUT_DEPTH_16) {
+                fprintf(stderr, "invalid value for b: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         }
     }
 
+    // The ring carries XRGB8888 frames only.
+    if (outputDepth == OUTPUT_DEPTH_16 && shmRingName[0] != '\0') {
+        fprintf(stderr, "16 bit output can not be combined with -m\n");
+        return EXIT_FAILURE;
+    }
+
+    if (stripImage.rows > 0 && stripPath == NULL) {
+        fprintf(stderr, "-S needs -o\n");
+        return EXIT_FAILURE;
+    }
+    if (stripPath != NULL &&
+        (outputDepth == OUTPUT_DEPTH_16 || shmRingName[0] != '\0')) {
+        fprintf(stderr, "a strip image can not be combined with -b 16 or "
+                        "-m\n");
+        return EXIT_FAILURE;
+    }
+    if (stripImage.rows == 0) {
+        stripImage.rows = DEFAULT_STRIP_ROWS;
+    }
+
+    if (tracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&realtime);
+
+    if (ChooseWorkerCount(&realtime, &workerCount, MAX_WORKERS) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (perfEnabled && ProbePerfCounters() != 0) {
+        perfEnabled = 0;
+    }
+
+    if (!kernelOverridden) {
+        kernel = DetectKernel();
+    } else if (!IsKernelSupported(kernel)) {
+        fprintf(stderr, "kernel %s is not supported on this cpu\n",
+                GetKernelName(kernel));
+        return EXIT_FAILURE;
+    }
+    initPlasmaRows = InitPlasmaRowsVariants[kernel];
+    drawRows = DrawRowsVariants[kernel];
+    drawRows16 = DrawRows16Variants[kernel];
+    stripRows = StripRowsVariants[kernel];
+    LogInfo("using %s kernels", GetKernelName(kernel));
+
+    if (stripPath != NULL) {
+        int result = RenderStripImage();
+        if (tracePath != NULL) {
+            SaveTrace();
+        }
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if (InitSDL() != 0) {
         fprintf(stderr, "error initializing SDL, %s\n", SDL_GetError());
         return EXIT_FAILURE;
@@ -184,57 +482,132 @@ int main(int argc, char *argv[]) {
     LogInfo("display refresh rate %d, target secs per frame %f", refreshRate,
             targetSecsPerFrame);
 
-    pixelBuffer = calloc(width * height, sizeof(*pixelBuffer));
-    if (pixelBuffer == NULL) {
-        LogError("failed to calloc pixel buffer %dx%d", width, height);
+    if (CreateWorkerPool(&workerPool, workerCount) != 0) {
+        LogError("failed to create %d workers, %s", workerCount,
+                 SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    LogInfo("rendering with %d workers", workerCount);
+
+    void *pixels =
+        AllocFrameMemory(&pixelMemory, &workerPool,
+                         width * GetOutputBytesPerPixel(outputDepth), height);
+    if (pixels == NULL) {
+        LogError("failed to allocate pixel buffer %dx%d", width, height);
         return EXIT_FAILURE;
     }
-    plasmaBuffer = calloc(width * height, sizeof(*plasmaBuffer));
+    if (outputDepth == OUTPUT_DEPTH_16) {
+        pixelBuffer16 = pixels;
+    } else {
+        pixelBuffer = pixels;
+    }
+    plasmaBuffer = AllocFrameMemory(&plasmaMemory, &workerPool,
+                                    width * sizeof(*plasmaBuffer), height);
     if (plasmaBuffer == NULL) {
-        LogError("failed to calloc plasma buffer %dx%d", width, height);
+        LogError("failed to allocate plasma buffer %dx%d", width, height);
         return EXIT_FAILURE;
     }
+    if (reportPlacement) {
+        ReportWorkerPinning(&workerPool);
+        ReportFramePlacement("pixel buffer", &pixelMemory, &workerPool, height);
+        ReportFramePlacement("plasma buffer", &plasmaMemory, &workerPool,
+                             height);
+    }
+
+    if (shmRingName[0] != '\0') {
+        if (CreateShmRing(&shmRing, shmRingName, shmRingSlots, width,
+                          height) != 0) {
+            LogError("failed to create shm ring %s", shmRingName);
+            return EXIT_FAILURE;
+        }
+        LogInfo("publishing frames to shm ring %s with %d slots", shmRingName,
+                shmRingSlots);
+    }
 
     InitPalette();
     InitPlasma();
+    if (perfEnabled) {
+        char counters[256];
+        PerfSample sample;
+        TakePerfTotals(&perfCounters, &sample);
+        FormatPerfCounters(counters, sizeof(counters), &sample, 1,
+                           (double)width * height);
+        LogInfo("InitPlasma counters%s", counters);
+    }
 
     double elapsedTimeMs = 0.0;
     Uint64 lastCounter = SDL_GetPerformanceCounter();
     Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
+    int metricsFrames = 0;
     SDL_Event event;
     int isRunning = 1;
+    StartJitterHistogram(&jitter, targetSecsPerFrame);
+    LockRealtimeMemory(&realtime);
+    StartBenchmark(&benchmark);
 
     while (isRunning) {
-        SDL_PollEvent(&event);
-        switch (event.type) {
-        case SDL_QUIT:
-            isRunning = 0;
-            break;
-        case SDL_KEYDOWN:
-            if (event.key.keysym.sym == SDLK_ESCAPE) {
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
                 isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
             }
-            break;
         }
+        TraceEnd("poll events", traceStart);
 
         elapsedTimeMs += targetSecsPerFrame * 1000.0;
 
+        Uint64 drawStartCounter = SDL_GetPerformanceCounter();
         DrawFrame(elapsedTimeMs);
+        TraceEnd("DrawFrame", drawStartCounter);
+        double drawMs =
+            GetElapsedTimeMs(drawStartCounter, SDL_GetPerformanceCounter());
+        metricsFrames++;
+
+        if (shmRing.header != NULL) {
+            traceStart = TraceBegin();
+            PublishShmRingFrame(&shmRing, pixelBuffer, width, height,
+                                elapsedTimeMs / 1000.0);
+            TraceEnd("shm publish", traceStart);
+        }
 
-        // Manually cap the frame rate
-        while (GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) <
-               targetSecsPerFrame) {
+        // Manually cap the frame rate, unless benchmarking
+        traceStart = TraceBegin();
+        if (benchmark.frames == 0) {
+            SleepUntilFrameTime(&realtime, lastCounter, targetSecsPerFrame);
+            while (GetElapsedTimeSecs(lastCounter,
+                                      SDL_GetPerformanceCounter()) <
+                   targetSecsPerFrame) {
+            }
+            assert(GetElapsedTimeSecs(lastCounter,
+                                      SDL_GetPerformanceCounter()) >=
+                   targetSecsPerFrame);
         }
-        assert(GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) >=
-               targetSecsPerFrame);
 
         Uint64 endCounter = SDL_GetPerformanceCounter();
-
-        SDL_UpdateTexture(texture, NULL, pixelBuffer,
-                          width * sizeof(*pixelBuffer));
+        TraceEnd("pacing wait", traceStart);
+
+        traceStart = TraceBegin();
+        Uint64 uploadCounter = SDL_GetPerformanceCounter();
+        SDL_UpdateTexture(texture, NULL, pixels,
+                          width * GetOutputBytesPerPixel(outputDepth));
+        AddUploadTime(&uploadStats, GetElapsedTimeMs(
+                                        uploadCounter,
+                                        SDL_GetPerformanceCounter()));
+        TraceEnd("texture upload", traceStart);
+
+        traceStart = TraceBegin();
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
+        TraceEnd("present", traceStart);
+        AddJitterFrame(&jitter, SDL_GetPerformanceCounter());
 
         double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
         double fps = (double)SDL_GetPerformanceFrequency() /
@@ -242,16 +615,42 @@ int main(int argc, char *argv[]) {
 
         if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
             1000.0) {
-            printf("ms/f: %f, fps: %f\r", msPerFrame, fps);
+            char counters[256] = "";
+            if (perfEnabled) {
+                PerfSample sample;
+                TakePerfTotals(&perfCounters, &sample);
+                FormatPerfCounters(counters, sizeof(counters), &sample,
+                                   metricsFrames, (double)width * height);
+            }
+            metricsFrames = 0;
+            char upload[64];
+            FormatUploadStats(upload, sizeof(upload), &uploadStats, width,
+                              height, outputDepth);
+
+            printf("ms/f: %f, fps: %f%s%s\r", msPerFrame, fps, upload,
+                   counters);
             fflush(stdout);
             metricsPrintCounter = SDL_GetPerformanceCounter();
         }
 
+        if (AddBenchmarkFrame(&benchmark, drawMs)) {
+            isRunning = 0;
+        }
+
         lastCounter = endCounter;
     }
+    PrintBenchmark(&benchmark);
+    PrintJitterHistogram(&jitter);
+
+    DestroyShmRing(&shmRing);
+    FreeFrameMemory(&plasmaMemory);
+    FreeFrameMemory(&pixelMemory);
+    DestroyWorkerPool(&workerPool);
+
+    if (tracePath != NULL) {
+        SaveTrace();
+    }
 
-    free(plasmaBuffer);
-    free(pixelBuffer);
     DestroySDL();
 
     return EXIT_SUCCESS;
@@ -0,0 +1,262 @@
+#ifndef PERFCOUNTERS_H_INCLUDED
+#define PERFCOUNTERS_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters opened per thread with perf_event_open. Each worker opens
+// its own counters the first time it samples them, and adds what it counted
+// around a band of work to totals shared by all of the workers. Counters the
+// CPU or kernel does not provide are left out of the report.
+//
+// The counters of a thread are one group led by the cycle counter, so the
+// kernel schedules them onto the PMU together and ratios like IPC hold even
+// when other users multiplex the PMU. The counts are scaled by the time the
+// group was enabled over the time it actually counted. That time is summed
+// into the totals too, so the report says when the group was multiplexed,
+// or never got onto the PMU at all and counted nothing.
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+typedef struct {
+    Uint64 values[PERF_COUNTER_COUNT];
+    int valid[PERF_COUNTER_COUNT];
+    // Nanoseconds the group was enabled and counting. Taken from totals,
+    // they are summed over all of the intervals added.
+    Uint64 enabled;
+    Uint64 running;
+} PerfSample;
+
+typedef struct {
+    atomic_ullong values[PERF_COUNTER_COUNT];
+    atomic_int valid[PERF_COUNTER_COUNT];
+    atomic_ullong enabled;
+    atomic_ullong running;
+} PerfTotals;
+
+static _Thread_local int perfThreadOpened = 0;
+static _Thread_local int perfThreadFds[PERF_COUNTER_COUNT];
+
+#ifdef __linux__
+// What a group read returns with PERF_FORMAT_GROUP and both times, the value
+// of every counter of the group in the order they were opened.
+typedef struct {
+    Uint64 count;
+    Uint64 enabled;
+    Uint64 running;
+    Uint64 values[PERF_COUNTER_COUNT];
+} PerfGroupRead;
+
+// Opens a counter of the calling thread, as the leader of a new group when
+// groupFd is -1 and as a member of the leader's group otherwise.
+static inline int OpenPerfCounter(PerfCounter counter, int groupFd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (counter) {
+    case PERF_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_LLC_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+#endif
+
+// Checks whether the calling thread can open a cycle counter at all. Returns
+// 0 when it can, otherwise logs why not and returns -1.
+static inline int ProbePerfCounters(void) {
+#ifdef __linux__
+    int fd = OpenPerfCounter(PERF_CYCLES, -1);
+    if (fd < 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "hardware counters unavailable, %s", strerror(errno));
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+#else
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "hardware counters are only available on Linux");
+    return -1;
+#endif
+}
+
+static inline void ReadPerfCounters(PerfSample *sample) {
+    memset(sample, 0, sizeof(*sample));
+#ifdef __linux__
+    if (!perfThreadOpened) {
+        perfThreadFds[PERF_CYCLES] = OpenPerfCounter(PERF_CYCLES, -1);
+        for (int i = PERF_CYCLES + 1; i < PERF_COUNTER_COUNT; i++) {
+            perfThreadFds[i] =
+                perfThreadFds[PERF_CYCLES] < 0
+                    ? -1
+                    : OpenPerfCounter((PerfCounter)i,
+                                      perfThreadFds[PERF_CYCLES]);
+        }
+        perfThreadOpened = 1;
+    }
+
+    PerfGroupRead group;
+    ssize_t bytes = perfThreadFds[PERF_CYCLES] < 0
+                        ? -1
+                        : read(perfThreadFds[PERF_CYCLES], &group,
+                               sizeof(group));
+    if (bytes < (ssize_t)(3 * sizeof(Uint64))) {
+        return;
+    }
+
+    // Counters that failed to open are missing from the group, so the
+    // values of the others are packed in the order they were opened.
+    Uint64 member = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (perfThreadFds[i] >= 0 && member < group.count) {
+            sample->values[i] = group.values[member++];
+            sample->valid[i] = 1;
+        }
+    }
+    sample->enabled = group.enabled;
+    sample->running = group.running;
+#endif
+}
+
+// Closes the counters of the calling thread. Workers call it as they exit,
+// and a later ReadPerfCounters on the thread opens them again.
+static inline void ClosePerfCounters(void) {
+#ifdef __linux__
+    if (!perfThreadOpened) {
+        return;
+    }
+
+    for (int i = PERF_COUNTER_COUNT - 1; i >= 0; i--) {
+        if (perfThreadFds[i] >= 0) {
+            close(perfThreadFds[i]);
+        }
+    }
+    perfThreadOpened = 0;
+#endif
+}
+
+// Adds the counts between two samples of the same thread to the totals,
+// scaled up to the whole interval when the group was only on the PMU for
+// part of it. An interval in which the group never counted only adds its
+// time.
+static inline void AddPerfCounters(PerfTotals *totals, const PerfSample *start,
+                                   const PerfSample *end) {
+    Uint64 enabled = end->enabled - start->enabled;
+    Uint64 running = end->running - start->running;
+    atomic_fetch_add(&totals->enabled, enabled);
+    atomic_fetch_add(&totals->running, running);
+    if (running == 0) {
+        return;
+    }
+
+    double scale = running < enabled ? (double)enabled / running : 1.0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (start->valid[i] && end->valid[i]) {
+            Uint64 count = end->values[i] - start->values[i];
+            atomic_fetch_add(&totals->values[i], (Uint64)(count * scale));
+            atomic_store(&totals->valid[i], 1);
+        }
+    }
+}
+
+// Moves the totals into a sample and starts counting from zero again.
+static inline void TakePerfTotals(PerfTotals *totals, PerfSample *sample) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        sample->values[i] = atomic_exchange(&totals->values[i], 0);
+        sample->valid[i] = atomic_load(&totals->valid[i]);
+    }
+    sample->enabled = atomic_exchange(&totals->enabled, 0);
+    sample->running = atomic_exchange(&totals->running, 0);
+}
+
+// Formats IPC, cycles per pixel and the misses per frame of a sample taken
+// over the given number of frames of the given number of pixels each. When
+// the group was multiplexed it adds the share of the time it counted, which
+// the counts were scaled up from, and when it never counted it says so.
+static inline void FormatPerfCounters(char *text, size_t size,
+                                      const PerfSample *sample, double frames,
+                                      double pixelsPerFrame) {
+    const Uint64 *values = sample->values;
+    const int *valid = sample->valid;
+    int length = 0;
+    text[0] = 0;
+
+    if (sample->enabled > 0 && sample->running == 0) {
+        snprintf(text, size, ", counters not scheduled on the pmu");
+        return;
+    }
+    if (sample->running < sample->enabled) {
+        length += snprintf(text, size, ", counted: %.0f%%",
+                           100.0 * sample->running / sample->enabled);
+    }
+
+    if (valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] &&
+        values[PERF_CYCLES] > 0) {
+        length += snprintf(text + length, size - length, ", ipc: %.2f",
+                           (double)values[PERF_INSTRUCTIONS] /
+                               values[PERF_CYCLES]);
+    }
+    if (valid[PERF_CYCLES] && (size_t)length < size) {
+        length += snprintf(text + length, size - length, ", cycles/px: %.1f",
+                           values[PERF_CYCLES] / (frames * pixelsPerFrame));
+    }
+    if (valid[PERF_L1D_MISSES] && (size_t)length < size) {
+        length += snprintf(text + length, size - length, ", l1d miss/f: %.0f",
+                           values[PERF_L1D_MISSES] / frames);
+    }
+    if (valid[PERF_LLC_MISSES] && (size_t)length < size) {
+        length += snprintf(text + length, size - length, ", llc miss/f: %.0f",
+                           values[PERF_LLC_MISSES] / frames);
+    }
+    if (valid[PERF_BRANCH_MISSES] && (size_t)length < size) {
+        snprintf(text + length, size - length, ", branch miss/f: %.0f",
+                 values[PERF_BRANCH_MISSES] / frames);
+    }
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PLASMAFORMULA_H_INCLUDED
+#define PLASMAFORMULA_H_INCLUDED
+
+#include "cpudispatch.h"
+#include "fastmath.h"
+#include <SDL2/SDL.h>
+#include <string.h>
+
+// Kernels generated by plasmagen from the formula descriptions in
+// src/plasmas. A formula's setup fills its column tables once a frame, then
+// its rows kernel evaluates bands of rows from them in parallel.
+
+#define PLASMA_FORMULA_SCALE 20.0
+
+typedef struct {
+    Uint32 *target;
+    double t;
+    int width;
+    int height;
+    // The formula's tableCount tables of width entries each, one after the
+    // other.
+    double *columns;
+} PlasmaFormulaJob;
+
+typedef void (*PlasmaFormulaSetup)(PlasmaFormulaJob *job);
+typedef void (*PlasmaFormulaRowsKernel)(const PlasmaFormulaJob *job, int y0,
+                                        int y1);
+
+typedef struct {
+    const char *name;
+    int tableCount;
+    PlasmaFormulaSetup setup;
+    const PlasmaFormulaRowsKernel *rows;
+} PlasmaFormula;
+
+// The plasma coordinate of pixel i out of size, the same mapping rgb_plasma
+// uses for its own plasma.
+static inline double GetPlasmaFormulaCoordinate(int i, int size) {
+    return (0.5 + i / (double)size - 1.0) * PLASMA_FORMULA_SCALE -
+           PLASMA_FORMULA_SCALE * 0.5;
+}
+
+// Shades pi times a plasma value with the phases of each channel, also in
+// radians.
+KERNEL_INLINE Uint32 ShadePlasmaFormula(double value, double red,
+                                        double green, double blue) {
+    int r = (int)(FastSin(value + red) * 127.5 + 127.5);
+    int g = (int)(FastSin(value + green) * 127.5 + 127.5);
+    int b = (int)(FastSin(value + blue) * 127.5 + 127.5);
+
+    return (Uint32)((r << 16) | (g << 8) | b);
+}
+
+static inline const PlasmaFormula *
+FindPlasmaFormula(const PlasmaFormula *formulas, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(formulas[i].name, name) == 0) {
+            return &formulas[i];
+        }
+    }
+
+    return NULL;
+}
+
+#endif
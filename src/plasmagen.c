@@ -0,0 +1,944 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Compiles plasma formula descriptions into a C header with a kernel for the
+// software demos, and a GLSL fragment shader per formula for GL and another
+// for Vulkan. A description is a text file with one directive per line, #
+// starts a comment:
+//
+//   scale s              the plasma value is s times the sum of the terms
+//   colour r g b         each channel is sin(pi * (value + phase)) * 0.5 + 0.5
+//   wave key=value...    weight * sin(x * X + y * Y + t * T + phase)
+//   radial key=value...  weight * sin(frequency * D + t * T + phase), where D
+//                        is sqrt((X + orbit * sin(orbitx * T))^2 +
+//                        (Y + orbit * cos(orbity * T))^2 + bias)
+//
+// X and Y are the plasma coordinates of the pixel and T the time. Keys that
+// are left out are 0, except for weight and frequency, which are 1. The
+// formula is named after the file.
+//
+// The CPU kernel only evaluates per pixel what really changes per pixel.
+// Terms of the frame alone and of the column alone are summed into one table
+// of width entries once a frame, terms of the row alone once per row. Waves of
+// both x and y are split with sin(a + b) = sin(a) cos(b) + cos(a) sin(b) into
+// per column tables and per row weights, shared by waves of the same x
+// frequency. Radial terms of the same centre share their square root. The
+// scale, the weights and pi are folded into the constants.
+
+#define PI 3.1415926535897932384626433832795
+#define MAX_FORMULAS 32
+#define MAX_TERMS 16
+#define MAX_NAME_SIZE 32
+#define MAX_LINE_SIZE 256
+#define MAX_EXPRESSION_SIZE 512
+#define MAX_PATH_SIZE 4096
+#define NUMBER_SIZE 32
+
+typedef enum { TERM_WAVE, TERM_RADIAL } TermKind;
+
+// What a term depends on, which decides where the kernel evaluates it.
+typedef enum {
+    DEPENDS_ON_NOTHING,
+    DEPENDS_ON_FRAME,
+    DEPENDS_ON_COLUMN,
+    DEPENDS_ON_ROW,
+    DEPENDS_ON_PIXEL
+} Dependence;
+
+typedef struct {
+    TermKind kind;
+    double weight;
+    double x;
+    double y;
+    double t;
+    double phase;
+    double frequency;
+    double bias;
+    double orbit;
+    double orbitX;
+    double orbitY;
+    // The wave or radial group the term was assigned to.
+    int group;
+} Term;
+
+// Waves of x and y with the same x frequency, which share a sin and a cos
+// table.
+typedef struct {
+    double x;
+} WaveGroup;
+
+// Radial terms around the same moving centre, which share a table of squared
+// x distances and a square root per pixel.
+typedef struct {
+    double orbit;
+    double orbitX;
+    double orbitY;
+    double bias;
+} RadialGroup;
+
+typedef struct {
+    char name[MAX_NAME_SIZE];
+    const char *path;
+    double scale;
+    double colour[3];
+    Term terms[MAX_TERMS];
+    int termCount;
+    WaveGroup waves[MAX_TERMS];
+    int waveCount;
+    RadialGroup radials[MAX_TERMS];
+    int radialCount;
+} Formula;
+
+Formula formulas[MAX_FORMULAS];
+int formulaCount = 0;
+const char *headerPath = NULL;
+const char *shaderDirectory = NULL;
+
+// Prints a number so it reads back as a floating point literal in both C and
+// GLSL, with the fewest digits that still read back as the same double, or
+// float for GLSL.
+void FormatNumber(char *text, double value, int glsl) {
+    snprintf(text, NUMBER_SIZE, glsl ? "%.9g" : "%.15g", value);
+    if (!glsl && strtod(text, NULL) != value) {
+        snprintf(text, NUMBER_SIZE, "%.17g", value);
+    }
+    if (strpbrk(text, ".e") == NULL) {
+        strcat(text, ".0");
+    }
+}
+
+// Appends coefficient * factor to the sum in expression, or the coefficient
+// alone when factor is NULL. Zero coefficients are dropped and coefficients of
+// one left out.
+void AppendProduct(char *expression, double coefficient, const char *factor,
+                   int glsl) {
+    if (coefficient == 0.0) {
+        return;
+    }
+
+    size_t length = strlen(expression);
+    char *end = expression + length;
+    size_t size = MAX_EXPRESSION_SIZE - length;
+    const char *sign = "";
+    if (length > 0) {
+        sign = coefficient < 0.0 ? " - " : " + ";
+        coefficient = fabs(coefficient);
+    }
+
+    char number[NUMBER_SIZE];
+    FormatNumber(number, coefficient, glsl);
+    int written;
+    if (factor == NULL) {
+        written = snprintf(end, size, "%s%s", sign, number);
+    } else if (coefficient == 1.0) {
+        written = snprintf(end, size, "%s%s", sign, factor);
+    } else if (coefficient == -1.0) {
+        written = snprintf(end, size, "%s-%s", sign, factor);
+    } else {
+        written = snprintf(end, size, "%s%s * %s", sign, number, factor);
+    }
+
+    // Formulas are small, running out of room means one is malformed.
+    if (written < 0 || (size_t)written >= size) {
+        fprintf(stderr, "expression too long: %s\n", expression);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Turns an empty sum into zero.
+const char *GetSum(const char *expression) {
+    return expression[0] != '\0' ? expression : "0.0";
+}
+
+int IsEmpty(const char *expression) {
+    return expression[0] == '\0';
+}
+
+// The weight of a term with the formula's scale and the pi of the colour
+// mapping folded in, so the kernels sum up pi times the plasma value.
+double GetTermCoefficient(const Formula *formula, const Term *term) {
+    return PI * formula->scale * term->weight;
+}
+
+Dependence GetDependence(const Term *term) {
+    if (term->kind == TERM_RADIAL) {
+        return DEPENDS_ON_PIXEL;
+    }
+    if (term->x != 0.0 && term->y != 0.0) {
+        return DEPENDS_ON_PIXEL;
+    }
+    if (term->x != 0.0) {
+        return DEPENDS_ON_COLUMN;
+    }
+    if (term->y != 0.0) {
+        return DEPENDS_ON_ROW;
+    }
+    return term->t != 0.0 ? DEPENDS_ON_FRAME : DEPENDS_ON_NOTHING;
+}
+
+// Fills expression with the argument of a wave's sine, leaving out the parts
+// named by NULL.
+void FormatWaveArgument(char *expression, const Term *term, const char *x,
+                        const char *y, const char *t, int glsl) {
+    expression[0] = '\0';
+    if (x != NULL) {
+        AppendProduct(expression, term->x, x, glsl);
+    }
+    if (y != NULL) {
+        AppendProduct(expression, term->y, y, glsl);
+    }
+    AppendProduct(expression, term->t, t, glsl);
+    AppendProduct(expression, term->phase, NULL, glsl);
+}
+
+void FormatRadialPhase(char *expression, const Term *term, const char *t,
+                       int glsl) {
+    expression[0] = '\0';
+    AppendProduct(expression, term->t, t, glsl);
+    AppendProduct(expression, term->phase, NULL, glsl);
+}
+
+// Fills expression with the centre's offset along one axis, empty when the
+// centre does not move along it.
+void FormatOrbit(char *expression, const RadialGroup *group, int axis,
+                 const char *t, int glsl) {
+    char factor[MAX_EXPRESSION_SIZE] = "";
+    char argument[MAX_EXPRESSION_SIZE] = "";
+    const char *sin = glsl ? "sin" : "FastSin";
+    const char *cos = glsl ? "cos" : "FastCos";
+
+    expression[0] = '\0';
+    if (axis == 0) {
+        // The sine of a centre that does not orbit is zero.
+        if (group->orbitX == 0.0) {
+            return;
+        }
+        AppendProduct(argument, group->orbitX, t, glsl);
+        snprintf(factor, sizeof(factor), "%s(%s)", sin, argument);
+        AppendProduct(expression, group->orbit, factor, glsl);
+    } else if (group->orbitY == 0.0) {
+        AppendProduct(expression, group->orbit, NULL, glsl);
+    } else {
+        AppendProduct(argument, group->orbitY, t, glsl);
+        snprintf(factor, sizeof(factor), "%s(%s)", cos, argument);
+        AppendProduct(expression, group->orbit, factor, glsl);
+    }
+}
+
+// Builds CamelCase from a lower case name with underscores.
+void FormatTypeName(char *text, const char *name) {
+    int upper = 1;
+    for (; *name != '\0'; name++) {
+        if (*name == '_') {
+            upper = 1;
+            continue;
+        }
+        *text++ = upper ? (char)toupper(*name) : *name;
+        upper = 0;
+    }
+    *text = '\0';
+}
+
+int ParseNumber(const char *text, double *value) {
+    char *end;
+    *value = strtod(text, &end);
+    return end == text || *end != '\0' ? -1 : 0;
+}
+
+int SetTermKey(Term *term, const char *key, double value) {
+    if (strcmp(key, "weight") == 0) {
+        term->weight = value;
+    } else if (strcmp(key, "t") == 0) {
+        term->t = value;
+    } else if (strcmp(key, "phase") == 0) {
+        term->phase = value;
+    } else if (term->kind == TERM_WAVE && strcmp(key, "x") == 0) {
+        term->x = value;
+    } else if (term->kind == TERM_WAVE && strcmp(key, "y") == 0) {
+        term->y = value;
+    } else if (term->kind == TERM_RADIAL && strcmp(key, "frequency") == 0) {
+        term->frequency = value;
+    } else if (term->kind == TERM_RADIAL && strcmp(key, "bias") == 0) {
+        if (value < 0.0) {
+            return -1;
+        }
+        term->bias = value;
+    } else if (term->kind == TERM_RADIAL && strcmp(key, "orbit") == 0) {
+        term->orbit = value;
+    } else if (term->kind == TERM_RADIAL && strcmp(key, "orbitx") == 0) {
+        term->orbitX = value;
+    } else if (term->kind == TERM_RADIAL && strcmp(key, "orbity") == 0) {
+        term->orbitY = value;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+int ParseTerm(Formula *formula, TermKind kind, char *arguments) {
+    if (formula->termCount == MAX_TERMS) {
+        return -1;
+    }
+
+    Term term = {kind, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, -1};
+    for (char *token = strtok(arguments, " \t"); token != NULL;
+         token = strtok(NULL, " \t")) {
+        char *separator = strchr(token, '=');
+        double value;
+        if (separator == NULL) {
+            return -1;
+        }
+        *separator = '\0';
+        if (ParseNumber(separator + 1, &value) != 0 ||
+            SetTermKey(&term, token, value) != 0) {
+            return -1;
+        }
+    }
+
+    // Terms of zero weight vanish here already.
+    if (term.weight != 0.0) {
+        formula->terms[formula->termCount++] = term;
+    }
+
+    return 0;
+}
+
+int ParseLine(Formula *formula, char *line) {
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    char *directive = strtok(line, " \t\r\n");
+    if (directive == NULL) {
+        return 0;
+    }
+    char *arguments = strtok(NULL, "\r\n");
+    if (arguments == NULL) {
+        arguments = "";
+    }
+
+    if (strcmp(directive, "wave") == 0) {
+        return ParseTerm(formula, TERM_WAVE, arguments);
+    }
+    if (strcmp(directive, "radial") == 0) {
+        return ParseTerm(formula, TERM_RADIAL, arguments);
+    }
+    if (strcmp(directive, "scale") == 0) {
+        char extra;
+        return sscanf(arguments, "%lf %c", &formula->scale, &extra) == 1
+                   ? 0
+                   : -1;
+    }
+    if (strcmp(directive, "colour") == 0) {
+        char extra;
+        return sscanf(arguments, "%lf %lf %lf %c", &formula->colour[0],
+                      &formula->colour[1], &formula->colour[2],
+                      &extra) == 3
+                   ? 0
+                   : -1;
+    }
+
+    return -1;
+}
+
+// Names the formula after its file, which has to be lower case letters,
+// digits and underscores, starting with a letter.
+int SetFormulaName(Formula *formula, const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base != NULL ? base + 1 : path;
+    size_t length = strcspn(base, ".");
+
+    if (length == 0 || length >= MAX_NAME_SIZE || base[0] < 'a' ||
+        base[0] > 'z') {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = base[i];
+        if ((c < 'a' || c > 'z') && (c < '0' || c > '9') && c != '_') {
+            return -1;
+        }
+        formula->name[i] = c;
+    }
+    formula->name[length] = '\0';
+
+    return 0;
+}
+
+int ReadFormula(Formula *formula, const char *path) {
+    memset(formula, 0, sizeof(*formula));
+    formula->path = path;
+    formula->scale = 1.0;
+    formula->colour[1] = 0.66;
+    formula->colour[2] = 1.32;
+
+    if (SetFormulaName(formula, path) != 0) {
+        fprintf(stderr, "%s: invalid formula name\n", path);
+        return -1;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "%s: could not open file\n", path);
+        return -1;
+    }
+
+    char line[MAX_LINE_SIZE];
+    int lineNumber = 0;
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        if (ParseLine(formula, line) != 0) {
+            fprintf(stderr, "%s:%d: invalid directive\n", path, lineNumber);
+            result = -1;
+        }
+    }
+    fclose(file);
+
+    if (result == 0 && formula->termCount == 0) {
+        fprintf(stderr, "%s: formula has no terms\n", path);
+        result = -1;
+    }
+
+    return result;
+}
+
+// Assigns the waves of both x and y and the radial terms to the groups that
+// share their tables.
+void GroupTerms(Formula *formula) {
+    for (int i = 0; i < formula->termCount; i++) {
+        Term *term = &formula->terms[i];
+        if (term->kind == TERM_WAVE &&
+            GetDependence(term) == DEPENDS_ON_PIXEL) {
+            int group = 0;
+            while (group < formula->waveCount &&
+                   formula->waves[group].x != term->x) {
+                group++;
+            }
+            if (group == formula->waveCount) {
+                formula->waves[formula->waveCount++].x = term->x;
+            }
+            term->group = group;
+        } else if (term->kind == TERM_RADIAL) {
+            RadialGroup key = {term->orbit, term->orbitX, term->orbitY,
+                               term->bias};
+            int group = 0;
+            while (group < formula->radialCount &&
+                   memcmp(&formula->radials[group], &key, sizeof(key)) != 0) {
+                group++;
+            }
+            if (group == formula->radialCount) {
+                formula->radials[formula->radialCount++] = key;
+            }
+            term->group = group;
+        }
+    }
+}
+
+// Sums the terms that depend on the given dependence and nothing else, with
+// their coefficients folded in. Terms of nothing at all are folded into a
+// single constant.
+void FormatTermSum(char *expression, const Formula *formula,
+                   Dependence dependence, const char *x, const char *y,
+                   const char *t, int glsl) {
+    double constant = 0.0;
+
+    expression[0] = '\0';
+    for (int i = 0; i < formula->termCount; i++) {
+        const Term *term = &formula->terms[i];
+        double coefficient = GetTermCoefficient(formula, term);
+        Dependence termDependence = GetDependence(term);
+
+        if (termDependence == DEPENDS_ON_NOTHING) {
+            constant += coefficient * sin(term->phase);
+        } else if (termDependence == dependence) {
+            char argument[MAX_EXPRESSION_SIZE];
+            char factor[MAX_EXPRESSION_SIZE];
+            FormatWaveArgument(argument, term, x, y, t, glsl);
+            snprintf(factor, sizeof(factor), "%s(%s)",
+                     glsl ? "sin" : "FastSin", argument);
+            AppendProduct(expression, coefficient, factor, glsl);
+        }
+    }
+
+    if (dependence == DEPENDS_ON_FRAME) {
+        AppendProduct(expression, constant, NULL, glsl);
+    }
+}
+
+// Whether the first column table holds anything, so the kernel does not read
+// a table of zeros.
+int HasColumnSum(const Formula *formula) {
+    char expression[MAX_EXPRESSION_SIZE];
+
+    FormatTermSum(expression, formula, DEPENDS_ON_FRAME, NULL, NULL, "t", 0);
+    if (!IsEmpty(expression)) {
+        return 1;
+    }
+    FormatTermSum(expression, formula, DEPENDS_ON_COLUMN, "x", NULL, "t", 0);
+    return !IsEmpty(expression);
+}
+
+// The column tables are the summed column terms first, when there are any,
+// then a sin and a cos table per wave group and a squared distance table per
+// radial group.
+int GetTableCount(const Formula *formula) {
+    return HasColumnSum(formula) + 2 * formula->waveCount +
+           formula->radialCount;
+}
+
+int GetWaveTable(const Formula *formula, int group) {
+    return HasColumnSum(formula) + 2 * group;
+}
+
+int GetRadialTable(const Formula *formula, int group) {
+    return HasColumnSum(formula) + 2 * formula->waveCount + group;
+}
+
+// Formats the index of entry index of column table number table, or of its
+// first entry when index is NULL, as an expression of width.
+void FormatTableIndex(char *text, int table, const char *index) {
+    if (table == 0) {
+        snprintf(text, NUMBER_SIZE, "%s", index != NULL ? index : "0");
+    } else if (index != NULL) {
+        snprintf(text, NUMBER_SIZE, "%d * width + %s", table, index);
+    } else {
+        snprintf(text, NUMBER_SIZE, "%d * width", table);
+    }
+}
+
+void WriteSetup(FILE *file, const Formula *formula, const char *type) {
+    char expression[MAX_EXPRESSION_SIZE];
+    char number[NUMBER_SIZE];
+    char index[NUMBER_SIZE];
+
+    fprintf(file, "static void %sPlasmaSetup(PlasmaFormulaJob *job) {\n", type);
+    fprintf(file, "    const int width = job->width;\n");
+    fprintf(file, "    double *columns = job->columns;\n");
+
+    FormatTermSum(expression, formula, DEPENDS_ON_FRAME, NULL, NULL, "job->t",
+                  0);
+    int hasFrame = !IsEmpty(expression);
+    if (hasFrame) {
+        fprintf(file, "    const double frame = %s;\n", expression);
+    }
+    for (int i = 0; i < formula->radialCount; i++) {
+        FormatOrbit(expression, &formula->radials[i], 0, "job->t", 0);
+        if (!IsEmpty(expression)) {
+            fprintf(file, "    const double orbit%d = %s;\n", i, expression);
+        }
+    }
+
+    fprintf(file, "\n    for (int xi = 0; xi < width; xi++) {\n");
+    FormatTermSum(expression, formula, DEPENDS_ON_COLUMN, "x", NULL, "job->t",
+                  0);
+    if (!IsEmpty(expression) || formula->waveCount > 0 ||
+        formula->radialCount > 0) {
+        fprintf(file, "        double x = GetPlasmaFormulaCoordinate(xi, "
+                      "width);\n");
+    }
+    if (hasFrame) {
+        char sum[MAX_EXPRESSION_SIZE] = "frame";
+        if (!IsEmpty(expression)) {
+            snprintf(sum, sizeof(sum), "frame + %s", expression);
+        }
+        strcpy(expression, sum);
+    }
+    if (!IsEmpty(expression)) {
+        fprintf(file, "        columns[xi] = %s;\n", expression);
+    }
+
+    for (int i = 0; i < formula->waveCount; i++) {
+        int table = GetWaveTable(formula, i);
+        FormatNumber(number, formula->waves[i].x, 0);
+        FormatTableIndex(index, table, "xi");
+        fprintf(file, "        columns[%s] = FastSin(%s * x);\n", index,
+                number);
+        FormatTableIndex(index, table + 1, "xi");
+        fprintf(file, "        columns[%s] = FastCos(%s * x);\n", index,
+                number);
+    }
+    for (int i = 0; i < formula->radialCount; i++) {
+        FormatOrbit(expression, &formula->radials[i], 0, "job->t", 0);
+        FormatTableIndex(index, GetRadialTable(formula, i), "xi");
+        if (IsEmpty(expression)) {
+            fprintf(file, "        columns[%s] = x * x;\n", index);
+        } else {
+            fprintf(file, "        double dx%d = x + orbit%d;\n", i, i);
+            fprintf(file, "        columns[%s] = dx%d * dx%d;\n", index, i,
+                    i);
+        }
+    }
+    fprintf(file, "    }\n}\n\n");
+}
+
+void WriteRowsBody(FILE *file, const Formula *formula, const char *type) {
+    char expression[MAX_EXPRESSION_SIZE];
+    char argument[MAX_EXPRESSION_SIZE];
+    char factor[MAX_EXPRESSION_SIZE];
+    char number[NUMBER_SIZE];
+    char sinIndex[NUMBER_SIZE];
+    char cosIndex[NUMBER_SIZE];
+
+    int hasColumn = HasColumnSum(formula);
+    int indent = (int)(strlen("KERNEL_INLINE void PlasmaRowsBody(") +
+                       strlen(type));
+
+    fprintf(file,
+            "KERNEL_INLINE void %sPlasmaRowsBody(const PlasmaFormulaJob *job,\n"
+            "%*sint y0, int y1) {\n",
+            type, indent, "");
+    fprintf(file, "    const int width = job->width;\n");
+    if (hasColumn) {
+        fprintf(file, "    const double *column = job->columns;\n");
+    }
+    for (int i = 0; i < formula->waveCount; i++) {
+        FormatTableIndex(sinIndex, GetWaveTable(formula, i), NULL);
+        FormatTableIndex(cosIndex, GetWaveTable(formula, i) + 1, NULL);
+        fprintf(file,
+                "    const double *waveSin%d = &job->columns[%s];\n"
+                "    const double *waveCos%d = &job->columns[%s];\n",
+                i, sinIndex, i, cosIndex);
+    }
+    for (int i = 0; i < formula->radialCount; i++) {
+        FormatTableIndex(sinIndex, GetRadialTable(formula, i), NULL);
+        fprintf(file, "    const double *radialX%d = &job->columns[%s];\n", i,
+                sinIndex);
+        FormatOrbit(expression, &formula->radials[i], 1, "job->t", 0);
+        if (!IsEmpty(expression)) {
+            fprintf(file, "    const double orbit%d = %s;\n", i, expression);
+        }
+    }
+    for (int i = 0; i < formula->termCount; i++) {
+        const Term *term = &formula->terms[i];
+        if (term->kind != TERM_RADIAL) {
+            continue;
+        }
+        FormatRadialPhase(expression, term, "job->t", 0);
+        if (!IsEmpty(expression)) {
+            fprintf(file, "    const double radialPhase%d = %s;\n", i,
+                    expression);
+        }
+    }
+
+    fprintf(file, "\n    for (int yi = y0; yi < y1; yi++) {\n");
+    FormatTermSum(expression, formula, DEPENDS_ON_ROW, NULL, "y", "job->t", 0);
+    int hasRow = !IsEmpty(expression);
+    if (hasRow || formula->waveCount > 0 || formula->radialCount > 0) {
+        fprintf(file, "        double y = GetPlasmaFormulaCoordinate(yi, "
+                      "job->height);\n");
+    }
+    if (hasRow) {
+        fprintf(file, "        double row = %s;\n", expression);
+    }
+
+    // sin(a x + b) = sin(a x) cos(b) + cos(a x) sin(b), so each wave adds
+    // its cos(b) to the weight of the sin table and its sin(b) to the weight
+    // of the cos table.
+    for (int group = 0; group < formula->waveCount; group++) {
+        char sinWeight[MAX_EXPRESSION_SIZE] = "";
+        char cosWeight[MAX_EXPRESSION_SIZE] = "";
+        for (int i = 0; i < formula->termCount; i++) {
+            const Term *term = &formula->terms[i];
+            if (term->kind != TERM_WAVE || term->group != group) {
+                continue;
+            }
+            double coefficient = GetTermCoefficient(formula, term);
+            FormatWaveArgument(argument, term, NULL, "y", "job->t", 0);
+            snprintf(factor, sizeof(factor), "FastCos(%s)",
+                     GetSum(argument));
+            AppendProduct(sinWeight, coefficient, factor, 0);
+            snprintf(factor, sizeof(factor), "FastSin(%s)",
+                     GetSum(argument));
+            AppendProduct(cosWeight, coefficient, factor, 0);
+        }
+        fprintf(file, "        double waveSinWeight%d = %s;\n", group,
+                sinWeight);
+        fprintf(file, "        double waveCosWeight%d = %s;\n", group,
+                cosWeight);
+    }
+    for (int i = 0; i < formula->radialCount; i++) {
+        const RadialGroup *group = &formula->radials[i];
+        if (group->orbit != 0.0) {
+            fprintf(file, "        double dy%d = y + orbit%d;\n", i, i);
+        } else {
+            fprintf(file, "        double dy%d = y;\n", i);
+        }
+        expression[0] = '\0';
+        snprintf(factor, sizeof(factor), "dy%d * dy%d", i, i);
+        AppendProduct(expression, 1.0, factor, 0);
+        AppendProduct(expression, group->bias, NULL, 0);
+        fprintf(file, "        double radialY%d = %s;\n", i, expression);
+    }
+    fprintf(file, "        Uint32 *pixels = &job->target[yi * width];\n\n");
+
+    fprintf(file, "        for (int xi = 0; xi < width; xi++) {\n");
+    fprintf(file, "            double value = %s;\n",
+            hasColumn ? (hasRow ? "column[xi] + row" : "column[xi]")
+                      : (hasRow ? "row" : "0.0"));
+    for (int i = 0; i < formula->waveCount; i++) {
+        fprintf(file,
+                "            value += waveSin%d[xi] * waveSinWeight%d +\n"
+                "                     waveCos%d[xi] * waveCosWeight%d;\n",
+                i, i, i, i);
+    }
+    for (int i = 0; i < formula->radialCount; i++) {
+        fprintf(file,
+                "            double distance%d = FastSqrt(radialX%d[xi] + "
+                "radialY%d);\n",
+                i, i, i);
+    }
+    for (int i = 0; i < formula->termCount; i++) {
+        const Term *term = &formula->terms[i];
+        if (term->kind != TERM_RADIAL) {
+            continue;
+        }
+        snprintf(factor, sizeof(factor), "distance%d", term->group);
+        argument[0] = '\0';
+        AppendProduct(argument, term->frequency, factor, 0);
+        FormatRadialPhase(expression, term, "job->t", 0);
+        if (!IsEmpty(expression)) {
+            size_t length = strlen(argument);
+            snprintf(argument + length, sizeof(argument) - length,
+                     " + radialPhase%d", i);
+        }
+        FormatNumber(number, GetTermCoefficient(formula, term), 0);
+        fprintf(file, "            value += %s * FastSin(%s);\n", number,
+                GetSum(argument));
+    }
+
+    char colours[3][NUMBER_SIZE];
+    for (int i = 0; i < 3; i++) {
+        FormatNumber(colours[i], PI * formula->colour[i], 0);
+    }
+    fprintf(file,
+            "            pixels[xi] = ShadePlasmaFormula(value, %s, %s,\n"
+            "                                            %s);\n",
+            colours[0], colours[1], colours[2]);
+    fprintf(file, "        }\n    }\n}\n\n");
+
+    fprintf(file,
+            "DEFINE_KERNEL_VARIANTS(PlasmaFormulaRowsKernel, %sPlasmaRows,\n"
+            "                       (const PlasmaFormulaJob *job, int y0, "
+            "int y1),\n"
+            "                       (job, y0, y1));\n\n",
+            type);
+}
+
+int WriteHeader(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "%s: could not create file\n", path);
+        return -1;
+    }
+
+    fprintf(file, "// Generated by plasmagen, do not edit.\n\n");
+    fprintf(file, "#ifndef PLASMA_FORMULAS_H_INCLUDED\n");
+    fprintf(file, "#define PLASMA_FORMULAS_H_INCLUDED\n\n");
+    fprintf(file, "#include \"../plasmaformula.h\"\n\n");
+
+    for (int i = 0; i < formulaCount; i++) {
+        const Formula *formula = &formulas[i];
+        char type[MAX_NAME_SIZE];
+        FormatTypeName(type, formula->name);
+
+        fprintf(file, "// %s\n\n", formula->path);
+        WriteSetup(file, formula, type);
+        WriteRowsBody(file, formula, type);
+    }
+
+    fprintf(file, "static const PlasmaFormula plasmaFormulas[] = {\n");
+    for (int i = 0; i < formulaCount; i++) {
+        char type[MAX_NAME_SIZE];
+        FormatTypeName(type, formulas[i].name);
+        fprintf(file,
+                "    {\"%s\", %d, %sPlasmaSetup, %sPlasmaRowsVariants},\n",
+                formulas[i].name, GetTableCount(&formulas[i]), type, type);
+    }
+    fprintf(file, "};\n\n");
+    fprintf(file, "#define PLASMA_FORMULA_COUNT %d\n\n", formulaCount);
+    fprintf(file, "#endif\n");
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "%s: could not write file\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// The shader evaluates every term per fragment, the GPU has nowhere to keep
+// tables, but shares the radial square roots and the folded constants with
+// the CPU kernel. It maps fragments to the same plasma coordinates as the
+// software demos, from the top left of the frame. The Vulkan flavour takes
+// the resolution and scale as push constants and the time from a uniform
+// block, the layout vk_rgb_plasma binds, and already has its origin at the
+// top left.
+int WriteShader(const Formula *formula, const char *directory, int vulkan) {
+    char path[MAX_PATH_SIZE];
+    char expression[MAX_EXPRESSION_SIZE];
+    char argument[MAX_EXPRESSION_SIZE];
+    char factor[MAX_EXPRESSION_SIZE];
+    char number[NUMBER_SIZE];
+
+    snprintf(path, sizeof(path), "%s/%s%s.frag", directory, formula->name,
+             vulkan ? ".vk" : "");
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "%s: could not create file\n", path);
+        return -1;
+    }
+
+    fprintf(file, "#version %s\n\n", vulkan ? "450" : "330 core");
+    fprintf(file, "// Generated by plasmagen from %s, do not edit.\n\n",
+            formula->path);
+    if (vulkan) {
+        fprintf(file, "layout (push_constant) uniform PushConstants {\n"
+                      "\tivec2 uResolution;\n\tfloat uScale;\n};\n\n"
+                      "layout (set = 0, binding = 0) uniform FrameUniforms {\n"
+                      "\tfloat uTime;\n};\n\n"
+                      "layout (location = 0) out vec4 fragColor;\n\n");
+    } else {
+        fprintf(file, "uniform float uTime;\nuniform float uScale;\n"
+                      "uniform ivec2 uResolution;\n\n"
+                      "out vec4 fragColor;\n\n");
+    }
+    fprintf(file, "void main() {\n");
+    if (vulkan) {
+        fprintf(file, "\tvec2 pixel = gl_FragCoord.xy - 0.5;\n");
+    } else {
+        fprintf(file, "\tvec2 pixel = vec2(gl_FragCoord.x, "
+                      "float(uResolution.y) - gl_FragCoord.y) - 0.5;\n");
+    }
+    fprintf(file, "\tvec2 coords = (pixel / vec2(uResolution) - 0.5) * uScale "
+                  "- uScale * 0.5;\n");
+    fprintf(file, "\tfloat x = coords.x;\n\tfloat y = coords.y;\n\n");
+
+    double constant = 0.0;
+    for (int i = 0; i < formula->termCount; i++) {
+        const Term *term = &formula->terms[i];
+        if (term->kind == TERM_WAVE &&
+            GetDependence(term) == DEPENDS_ON_NOTHING) {
+            constant += GetTermCoefficient(formula, term) * sin(term->phase);
+        }
+    }
+    FormatNumber(number, constant, 1);
+    fprintf(file, "\tfloat value = %s;\n", number);
+
+    for (int i = 0; i < formula->termCount; i++) {
+        const Term *term = &formula->terms[i];
+        double coefficient = GetTermCoefficient(formula, term);
+        if (term->kind != TERM_WAVE) {
+            continue;
+        }
+        if (GetDependence(term) == DEPENDS_ON_NOTHING) {
+            continue;
+        }
+        FormatWaveArgument(argument, term, "x", "y", "uTime", 1);
+        FormatNumber(number, coefficient, 1);
+        fprintf(file, "\tvalue += %s * sin(%s);\n", number, argument);
+    }
+
+    for (int i = 0; i < formula->radialCount; i++) {
+        const RadialGroup *group = &formula->radials[i];
+        char orbitX[MAX_EXPRESSION_SIZE];
+        char orbitY[MAX_EXPRESSION_SIZE];
+        FormatOrbit(orbitX, group, 0, "uTime", 1);
+        FormatOrbit(orbitY, group, 1, "uTime", 1);
+        fprintf(file, "\tvec2 centre%d = vec2(x%s%s, y%s%s);\n", i,
+                IsEmpty(orbitX) ? "" : " + ", orbitX,
+                IsEmpty(orbitY) ? "" : " + ", orbitY);
+        expression[0] = '\0';
+        snprintf(factor, sizeof(factor), "dot(centre%d, centre%d)", i, i);
+        AppendProduct(expression, 1.0, factor, 1);
+        AppendProduct(expression, group->bias, NULL, 1);
+        fprintf(file, "\tfloat distance%d = sqrt(%s);\n", i, expression);
+    }
+    for (int i = 0; i < formula->termCount; i++) {
+        const Term *term = &formula->terms[i];
+        if (term->kind != TERM_RADIAL) {
+            continue;
+        }
+        snprintf(factor, sizeof(factor), "distance%d", term->group);
+        argument[0] = '\0';
+        AppendProduct(argument, term->frequency, factor, 1);
+        AppendProduct(argument, term->t, "uTime", 1);
+        AppendProduct(argument, term->phase, NULL, 1);
+        FormatNumber(number, GetTermCoefficient(formula, term), 1);
+        fprintf(file, "\tvalue += %s * sin(%s);\n", number,
+                GetSum(argument));
+    }
+
+    char colours[3][NUMBER_SIZE];
+    for (int i = 0; i < 3; i++) {
+        FormatNumber(colours[i], PI * formula->colour[i], 1);
+    }
+    fprintf(file,
+            "\n\tvec3 finalColor = sin(value + vec3(%s, %s, %s));\n"
+            "\tfragColor = vec4(finalColor * 0.5 + 0.5, 1.0);\n}\n",
+            colours[0], colours[1], colours[2]);
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "%s: could not write file\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, ":c:g:")) != -1) {
+        switch (opt) {
+        case 'c':
+            headerPath = optarg;
+            break;
+        case 'g':
+            shaderDirectory = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c header] [-g shader directory] "
+                            "formula...\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc || argc - optind > MAX_FORMULAS) {
+        fprintf(stderr, "expected 1 to %d formula files\n", MAX_FORMULAS);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        Formula *formula = &formulas[formulaCount];
+        if (ReadFormula(formula, argv[i]) != 0) {
+            return EXIT_FAILURE;
+        }
+        for (int j = 0; j < formulaCount; j++) {
+            if (strcmp(formulas[j].name, formula->name) == 0) {
+                fprintf(stderr, "%s: duplicate formula %s\n", argv[i],
+                        formula->name);
+                return EXIT_FAILURE;
+            }
+        }
+        GroupTerms(formula);
+        formulaCount++;
+    }
+
+    if (headerPath != NULL && WriteHeader(headerPath) != 0) {
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; shaderDirectory != NULL && i < formulaCount; i++) {
+        if (WriteShader(&formulas[i], shaderDirectory, 0) != 0 ||
+            WriteShader(&formulas[i], shaderDirectory, 1) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
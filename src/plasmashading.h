@@ -0,0 +1,104 @@
+#ifndef PLASMASHADING_H_INCLUDED
+#define PLASMASHADING_H_INCLUDED
+
+#include "cpudispatch.h"
+#include "fastmath.h"
+#include <SDL2/SDL.h>
+
+// The plasma formulas and colors of rgb_plasma and palette_plasma, written
+// once for any sine, cosine and square root, and stamped out for a set of
+// them with DEFINE_PLASMA_SHADING. The demos use the fastmath.h set stamped
+// out below. fastmath_test stamps out a libm copy too, and compares the frames
+// of both to check that the fast functions leave the demos' frames intact.
+
+#define PLASMA_SHADING_PI 3.1415926535897932384626433832795
+// rgb_plasma spans PLASMA_SCALE plasma units across the frame, centred on 0.
+#define PLASMA_SCALE 20.0
+#define PLASMA_SCALE_HALF (PLASMA_SCALE * 0.5)
+
+// The rgb_plasma coordinate of pixel i of a row or column of size pixels.
+KERNEL_INLINE double GetPlasmaCoordinate(int i, int size) {
+    return (0.5 + i / (double)size - 1.0) * PLASMA_SCALE - PLASMA_SCALE_HALF;
+}
+
+// A color channel as a byte, saturated at 255.
+KERNEL_INLINE Uint8 SaturateChannel(double value) {
+    return (Uint8)(value < 255.0 ? value : 255.0);
+}
+
+// Packs channels in [0, 1] into an XRGB pixel.
+KERNEL_INLINE Uint32 ShadeChannels(double r, double g, double b) {
+    return ((Uint32)SaturateChannel(r * 255) << 16) |
+           ((Uint32)SaturateChannel(g * 255) << 8) | SaturateChannel(b * 255);
+}
+
+// Defines, with suffix appended to their names:
+//
+// GetCentreOffset, the offset of rgb_plasma's moving centre at time t, with
+// frequency the speed of its x term.
+//
+// PlasmaValue, the rgb_plasma value of a point in the range [-2, 2], given
+// its distance from the moving centre.
+//
+// ShadeValue, the rgb_plasma color of a plasma value. Without the interactive
+// mouse terms the color only depends on the value, which is what lets a loop
+// cache store a palette index per pixel.
+//
+// GetPlasmaIndex, the palette_plasma palette index of pixel (x, y) before the
+// palette is shifted. The squares are taken in doubles so they don't overflow
+// in images wider than 32k pixels.
+//
+// GetPaletteColor, the palette_plasma color of a palette index.
+#define DEFINE_PLASMA_SHADING(suffix, sinFn, cosFn, sqrtFn)                    \
+    KERNEL_INLINE void GetCentreOffset##suffix(                                \
+        double t, double frequency, double *offsetX, double *offsetY) {        \
+        *offsetX = PLASMA_SCALE_HALF * sinFn(t * frequency);                   \
+        *offsetY = PLASMA_SCALE_HALF * cosFn(t * 0.5);                         \
+    }                                                                          \
+                                                                               \
+    KERNEL_INLINE double PlasmaValue##suffix(double x, double y, double t,     \
+                                             double centreDistance) {          \
+        double val = sinFn(y + t);                                             \
+        val += sinFn((x + t) * 0.5);                                           \
+        val += sinFn((x + y + t) * 0.5);                                       \
+        val += sinFn(centreDistance + t);                                      \
+        return val * 0.5;                                                      \
+    }                                                                          \
+                                                                               \
+    KERNEL_INLINE Uint32 ShadeValue##suffix(double val) {                      \
+        return ShadeChannels(                                                  \
+            sinFn(val * PLASMA_SHADING_PI) * 0.5 + 0.5,                        \
+            sinFn(val * PLASMA_SHADING_PI + 2.0 * PLASMA_SHADING_PI * 0.33) *  \
+                    0.5 +                                                      \
+                0.5,                                                           \
+            sinFn(val * PLASMA_SHADING_PI + 4.0 * PLASMA_SHADING_PI * 0.33) *  \
+                    0.5 +                                                      \
+                0.5);                                                          \
+    }                                                                          \
+                                                                               \
+    KERNEL_INLINE Uint32 GetPlasmaIndex##suffix(                               \
+        int x, int y, double halfWidth, double halfHeight) {                   \
+        double color = 128.0 + (128.0 * sinFn(x / 16.0));                      \
+        color += 128.0 + (128.0 * sinFn(y / 8.0));                             \
+        color += 128.0 + (128.0 * sinFn((x + y) / 16.0));                      \
+        double centreX = x - halfWidth;                                        \
+        double centreY = y - halfHeight;                                       \
+        double centreDistance =                                                \
+            sqrtFn(centreX * centreX + centreY * centreY);                     \
+        color += 128.0 + (128.0 * sinFn(centreDistance / 8.0));                \
+        double originDistance = sqrtFn((double)x * x + (double)y * y);         \
+        color += 128.0 + (128.0 * sinFn(originDistance / 8.0));               \
+        return (Uint32)color / 8;                                              \
+    }                                                                          \
+                                                                               \
+    KERNEL_INLINE Uint32 GetPaletteColor##suffix(int index) {                  \
+        Uint8 r = SaturateChannel(                                             \
+            128.0 + 128 * sinFn(PLASMA_SHADING_PI * index / 32.0));            \
+        Uint8 b = SaturateChannel(                                             \
+            128.0 + 128 * sinFn(PLASMA_SHADING_PI * index / 64.0));            \
+        return ((Uint32)r << 16) | b;                                          \
+    }
+
+DEFINE_PLASMA_SHADING(, FastSin, FastCos, FastSqrt)
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef REALTIME_H_INCLUDED
+#define REALTIME_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+// Real-time mode keeps the frame loop from being preempted by other work on
+// a shared host. The thread that renders and presents is confined to the
+// chosen cores and asks for SCHED_FIFO, or a raised niceness when that isn't
+// allowed. Threads created afterwards, like the workers, inherit both, so
+// StartRealtime runs before any are created. Memory is locked with mlockall
+// just before the frame loop, once the demo has allocated its buffers, so it
+// can't be paged out mid frame. A SCHED_FIFO thread that spins through the
+// whole pacing wait uses up the kernel's real-time budget, sched_rt_runtime_us,
+// and is throttled for the rest of the second, so in real-time mode the wait
+// sleeps until shortly before the frame time and only spins the rest.
+//
+// Every presented frame is compared with the ideal vsync schedule, one
+// display period after the previous present, and the deviation is kept in a
+// histogram printed when the demo exits.
+
+#define REALTIME_PRIORITY 10
+#define REALTIME_NICE -10
+#define REALTIME_SPIN_MS 1.0
+#define JITTER_BUCKETS 10
+#define JITTER_BAR_WIDTH 40
+
+// Upper bounds of the jitter buckets in ms, the last one is open ended.
+static const double jitterBucketMs[JITTER_BUCKETS - 1] = {
+    0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0};
+
+typedef struct {
+    int enabled;
+#ifdef __linux__
+    cpu_set_t cores;
+#endif
+} Realtime;
+
+typedef struct {
+    int enabled;
+    double periodMs;
+    Uint64 lastCounter;
+    long counts[JITTER_BUCKETS];
+    long frames;
+    double absMsSum;
+    double maxLateMs;
+    double maxEarlyMs;
+    // Frames presented more than half a period late, a missed vsync.
+    long missed;
+} JitterHistogram;
+
+// Parses a list of cores like 2,3 or 4-7 and enables real-time mode.
+static inline int ParseRealtimeCores(const char *arg, Realtime *realtime) {
+#ifdef __linux__
+    CPU_ZERO(&realtime->cores);
+    const char *cursor = arg;
+    for (;;) {
+        char *end;
+        long first = strtol(cursor, &end, 10);
+        long last = first;
+        if (end == cursor) {
+            return -1;
+        }
+        if (*end == '-') {
+            cursor = end + 1;
+            last = strtol(cursor, &end, 10);
+            if (end == cursor) {
+                return -1;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long core = first; core <= last; core++) {
+            CPU_SET(core, &realtime->cores);
+        }
+
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        cursor = end + 1;
+    }
+    realtime->enabled = 1;
+    return 0;
+#else
+    (void)arg;
+    (void)realtime;
+    return -1;
+#endif
+}
+
+// Pins the calling thread and raises its priority. Each step that the host
+// doesn't allow is logged and skipped, so the demo still runs.
+static inline void StartRealtime(const Realtime *realtime) {
+#ifdef __linux__
+    if (!realtime->enabled) {
+        return;
+    }
+
+    if (sched_setaffinity(0, sizeof(realtime->cores), &realtime->cores) !=
+        0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "failed to pin to the real-time cores, %s",
+                     strerror(errno));
+    } else {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "pinned to %d real-time cores",
+                    CPU_COUNT(&realtime->cores));
+    }
+
+    struct sched_param param = {.sched_priority = REALTIME_PRIORITY};
+    if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "scheduling with SCHED_FIFO priority %d",
+                    REALTIME_PRIORITY);
+    } else if (setpriority(PRIO_PROCESS, 0, REALTIME_NICE) == 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "SCHED_FIFO not allowed, scheduling with nice %d",
+                    REALTIME_NICE);
+    } else {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "SCHED_FIFO and nice %d not allowed, scheduling normally",
+                    REALTIME_NICE);
+    }
+#else
+    (void)realtime;
+#endif
+}
+
+static inline void LockRealtimeMemory(const Realtime *realtime) {
+#ifdef __linux__
+    if (!realtime->enabled) {
+        return;
+    }
+
+    if (mlockall(MCL_CURRENT) != 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "failed to lock memory, %s, check ulimit -l",
+                    strerror(errno));
+    } else {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "locked memory");
+    }
+#else
+    (void)realtime;
+#endif
+}
+
+// Picks the number of workers when none was given, one per CPU up to
+// maxWorkers, and in real-time mode at most one per real-time core. The
+// workers inherit SCHED_FIFO and the real-time cores, so more of them would
+// only preempt each other and PinWorker would leave them all unpinned.
+// Returns -1, after logging why, when more workers than real-time cores
+// were asked for.
+static inline int ChooseWorkerCount(const Realtime *realtime, int *count,
+                                    int maxWorkers) {
+    int requested = *count;
+    if (*count == 0) {
+        *count = SDL_GetCPUCount();
+    }
+#ifdef __linux__
+    int cores = CPU_COUNT(&realtime->cores);
+    if (realtime->enabled && *count > cores) {
+        if (requested > 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "%d workers are more than the %d real-time cores",
+                         requested, cores);
+            return -1;
+        }
+        *count = cores;
+    }
+#else
+    (void)realtime;
+#endif
+    if (*count > maxWorkers) {
+        *count = maxWorkers;
+    }
+    return 0;
+}
+
+// Sleeps until REALTIME_SPIN_MS before the frame time, targetSecs after
+// lastCounter, when in real-time mode. The pacing loop spins the rest.
+static inline void SleepUntilFrameTime(const Realtime *realtime,
+                                       Uint64 lastCounter, double targetSecs) {
+#ifdef __linux__
+    if (!realtime->enabled) {
+        return;
+    }
+
+    double remainingMs =
+        targetSecs * 1000.0 -
+        (double)(SDL_GetPerformanceCounter() - lastCounter) * 1000.0 /
+            SDL_GetPerformanceFrequency() -
+        REALTIME_SPIN_MS;
+    if (remainingMs > 0.0) {
+        long long remainingNs = (long long)(remainingMs * 1000000.0);
+        struct timespec duration = {remainingNs / 1000000000,
+                                    remainingNs % 1000000000};
+        nanosleep(&duration, NULL);
+    }
+#else
+    (void)realtime;
+    (void)lastCounter;
+    (void)targetSecs;
+#endif
+}
+
+static inline void StartJitterHistogram(JitterHistogram *jitter,
+                                        double periodSecs) {
+    jitter->periodMs = periodSecs * 1000.0;
+    jitter->lastCounter = 0;
+}
+
+// Records the deviation of a present, taken right after it returned, from
+// one period after the previous present.
+static inline void AddJitterFrame(JitterHistogram *jitter, Uint64 counter) {
+    if (!jitter->enabled) {
+        return;
+    }
+
+    Uint64 lastCounter = jitter->lastCounter;
+    jitter->lastCounter = counter;
+    if (lastCounter == 0) {
+        return;
+    }
+
+    double deviationMs = (double)(counter - lastCounter) * 1000.0 /
+                             SDL_GetPerformanceFrequency() -
+                         jitter->periodMs;
+    double absMs = deviationMs < 0.0 ? -deviationMs : deviationMs;
+
+    int bucket = 0;
+    while (bucket < JITTER_BUCKETS - 1 && absMs >= jitterBucketMs[bucket]) {
+        bucket++;
+    }
+    jitter->counts[bucket]++;
+    jitter->frames++;
+    jitter->absMsSum += absMs;
+    if (deviationMs > jitter->maxLateMs) {
+        jitter->maxLateMs = deviationMs;
+    }
+    if (-deviationMs > jitter->maxEarlyMs) {
+        jitter->maxEarlyMs = -deviationMs;
+    }
+    if (deviationMs > jitter->periodMs * 0.5) {
+        jitter->missed++;
+    }
+}
+
+static inline void PrintJitterHistogram(const JitterHistogram *jitter) {
+    if (!jitter->enabled || jitter->frames == 0) {
+        return;
+    }
+
+    printf("\njitter: %ld frames, mean %f ms, max late %f ms, max early %f "
+           "ms, missed %ld\n",
+           jitter->frames, jitter->absMsSum / jitter->frames,
+           jitter->maxLateMs, jitter->maxEarlyMs, jitter->missed);
+    for (int bucket = 0; bucket < JITTER_BUCKETS; bucket++) {
+        // A space and the bar, or nothing for an empty bucket.
+        char bar[JITTER_BAR_WIDTH + 2] = "";
+        int length = (int)(jitter->counts[bucket] * JITTER_BAR_WIDTH /
+                           jitter->frames);
+        if (length > 0) {
+            bar[0] = ' ';
+            memset(bar + 1, '#', length);
+            bar[length + 1] = '\0';
+        }
+
+        if (bucket < JITTER_BUCKETS - 1) {
+            printf("  < %5.2f ms %8ld %6.2f%%%s\n", jitterBucketMs[bucket],
+                   jitter->counts[bucket],
+                   100.0 * jitter->counts[bucket] / jitter->frames, bar);
+        } else {
+            printf(" >= %5.2f ms %8ld %6.2f%%%s\n",
+                   jitterBucketMs[bucket - 1], jitter->counts[bucket],
+                   100.0 * jitter->counts[bucket] / jitter->frames, bar);
+        }
+    }
+}
+
+#endif
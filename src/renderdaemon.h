@@ -0,0 +1,105 @@
+#ifndef RENDERDAEMON_H_INCLUDED
+#define RENDERDAEMON_H_INCLUDED
+
+#include "shmring.h"
+#include <SDL2/SDL.h>
+
+#define RENDER_DAEMON_MAGIC 0x4d534c50
+#define MAX_RENDER_DAEMON_SIZE 4096
+
+// The protocol between rgb_plasma -d and its clients. A client connects to
+// the daemon's Unix domain stream socket, creates a shared memory ring (see
+// shmring.h) for its frames and sends fixed size requests over the socket.
+// The daemon renders each frame request into the next slot of the named ring
+// and answers every request with a reply of the same id, in no particular
+// order. Both structs are sent as they are, so clients have to be built for
+// the same architecture as the daemon.
+
+typedef enum {
+    RENDER_REQUEST_FRAME = 1,
+    RENDER_REQUEST_STATS = 2
+} RenderRequestKind;
+
+typedef enum {
+    PLASMA_VARIANT_PLAIN,
+    // The plain plasma with the centre's x frequency rounded to 1/3, the way
+    // rgb_plasma -l renders it, so it loops seamlessly every 12 pi seconds.
+    PLASMA_VARIANT_LOOP,
+    // The interactive plasma with the mouse terms, at mouseX and mouseY.
+    PLASMA_VARIANT_MOUSE,
+    PLASMA_VARIANT_COUNT
+} PlasmaVariant;
+
+typedef enum {
+    RENDER_STATUS_OK = 0,
+    RENDER_STATUS_BAD_REQUEST = 1,
+    RENDER_STATUS_BAD_RING = 2,
+    RENDER_STATUS_FAILED = 3
+} RenderStatus;
+
+typedef struct {
+    Uint32 magic;
+    Uint32 kind;
+    Uint64 id;
+    Uint32 width;
+    Uint32 height;
+    Uint32 variant;
+    Uint32 padding;
+    double time;
+    // In the range [-0.5, 0.5), like the window coordinates rgb_plasma -i
+    // maps the mouse position to.
+    double mouseX;
+    double mouseY;
+    char ring[SHM_RING_NAME_SIZE];
+} RenderRequest;
+
+// A client's counters since it connected. Frames are the frame requests that
+// were rendered and published, shared frames the ones among them that were
+// rendered once for several requests in the same batch.
+typedef struct {
+    Uint64 requests;
+    Uint64 frames;
+    Uint64 sharedFrames;
+    Uint64 errors;
+    double latencyMsSum;
+    double latencyMsMax;
+    double connectedSecs;
+} RenderClientStats;
+
+// Answers a frame request with the frame number it was published as in the
+// ring and the time from receiving the request to publishing it, or a stats
+// request with the client's counters.
+typedef struct {
+    Uint32 magic;
+    Uint32 status;
+    Uint64 id;
+    Uint64 frame;
+    double latencyMs;
+    RenderClientStats stats;
+} RenderReply;
+
+static inline const char *GetPlasmaVariantName(PlasmaVariant variant) {
+    switch (variant) {
+    case PLASMA_VARIANT_PLAIN:
+        return "plain";
+    case PLASMA_VARIANT_LOOP:
+        return "loop";
+    case PLASMA_VARIANT_MOUSE:
+        return "mouse";
+    default:
+        return "unknown";
+    }
+}
+
+static inline int ParsePlasmaVariant(const char *name, PlasmaVariant *variant) {
+    for (int i = 0; i < PLASMA_VARIANT_COUNT; i++) {
+        if (strcmp(name, GetPlasmaVariantName((PlasmaVariant)i)) == 0) {
+            *variant = (PlasmaVariant)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RGB565_H_INCLUDED
+#define RGB565_H_INCLUDED
+
+#include "cpudispatch.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+// The software demos upload 32 bit XRGB8888 frames by default. With a 16 bit
+// output depth they pack straight to RGB565 instead, which halves the bytes
+// written and uploaded per frame. 5 and 6 bit channels band visibly on smooth
+// gradients, so each channel gets an ordered dither offset before it is
+// truncated.
+
+#define OUTPUT_DEPTH_32 32
+#define OUTPUT_DEPTH_16 16
+#define BAYER_SIZE 4
+
+typedef struct {
+    double msSum;
+    int frames;
+} UploadStats;
+
+// The 4x4 Bayer matrix, from 0 to 15, built from the low two bits of x and y
+// so kernels compute it instead of loading it from a table per pixel.
+KERNEL_INLINE int GetBayerThreshold(int x, int y) {
+    int mixed = x ^ y;
+    return ((mixed & 1) << 3) | ((y & 1) << 2) | (mixed & 2) | ((y & 2) >> 1);
+}
+
+KERNEL_INLINE int AddDither(int channel, int offset) {
+    channel += offset;
+    return channel < 255 ? channel : 255;
+}
+
+// Packs an XRGB8888 color to RGB565. The threshold adds up to one step less
+// than a full quantization step to each channel, 8 levels for red and blue
+// and 4 for green, so on average the truncated value matches the original.
+KERNEL_INLINE Uint16 PackRGB565(Uint32 color, int threshold) {
+    int red = AddDither((color >> 16) & 0xff, threshold >> 1);
+    int green = AddDither((color >> 8) & 0xff, threshold >> 2);
+    int blue = AddDither(color & 0xff, threshold >> 1);
+
+    return (Uint16)(((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3));
+}
+
+static inline Uint32 GetOutputFormat(int depth) {
+    return depth == OUTPUT_DEPTH_16 ? SDL_PIXELFORMAT_RGB565
+                                    : SDL_PIXELFORMAT_RGB888;
+}
+
+static inline int GetOutputBytesPerPixel(int depth) {
+    return depth == OUTPUT_DEPTH_16 ? sizeof(Uint16) : sizeof(Uint32);
+}
+
+static inline void AddUploadTime(UploadStats *stats, double ms) {
+    stats->msSum += ms;
+    stats->frames++;
+}
+
+// Formats the average texture upload time and size per frame since the last
+// call for the metrics line, and starts a new window.
+static inline void FormatUploadStats(char *text, size_t size,
+                                     UploadStats *stats, int width, int height,
+                                     int depth) {
+    double kibPerFrame =
+        (double)width * height * GetOutputBytesPerPixel(depth) / 1024.0;
+
+    snprintf(text, size, ", upload: %f ms/f, %.0f KiB/f",
+             stats->frames > 0 ? stats->msSum / stats->frames : 0.0,
+             kibPerFrame);
+    stats->msSum = 0.0;
+    stats->frames = 0;
+}
+
+#endif
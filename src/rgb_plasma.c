@@ -1,8 +1,32 @@
+#include "benchmark.h"
+#include "cpudispatch.h"
+#include "fastmath.h"
+#include "framebuffer.h"
+#include "generated/plasma_formulas.h"
+#include "loopcache.h"
+#include "perfcounters.h"
+#include "plasmaformula.h"
+#include "plasmashading.h"
+#include "realtime.h"
+#include "renderdaemon.h"
+#include "rgb565.h"
+#include "shmring.h"
+#include "stripimage.h"
+#include "trace.h"
+#include "workers.h"
 #include <SDL2/SDL.h>
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #define WINDOW_TITLE "RGB Plasma"
@@ -11,140 +35,2307 @@
 #define DEFAULT_SCALE 4
 #define DEFAULT_REFRESH_RATE 60
 #define PI 3.1415926535897932384626433832795
-#define PLASMA_SCALE 20.0
-#define PLASMA_SCALE_HALF PLASMA_SCALE * 0.5
+
+#define MAX_CHANNEL_VALUE 255.0
+#define GOVERNOR_WINDOW_FRAMES 30
+#define GOVERNOR_UPSCALE_HEADROOM 0.8
+#define LATENCY_HISTOGRAM_BUCKETS 100
+#define MAX_PENDING_INPUTS 256
+#define OFFLINE_FRAME_RATE 60
+#define OFFLINE_FRAMES_PER_WORKER 4
+// Batches in flight while rendering offline, one rendered while the writer
+// writes the other, and the most memory all of their frame slots may take.
+#define OFFLINE_BATCHES 2
+#define OFFLINE_SLOT_MEMORY (256 * 1024 * 1024)
+#define CENTRE_FREQUENCY 0.33
+// With the centre's x frequency rounded to 1/3 every time term of the plasma
+// repeats after a multiple of 12 pi, which makes that one seamless loop.
+#define LOOP_CENTRE_FREQUENCY (1.0 / 3.0)
+#define LOOP_PERIOD (12.0 * PI)
+// Every this many frames of a loop cache is also rendered exactly, to measure
+// the error of the palette.
+#define LOOP_ERROR_FRAME_INTERVAL 30
+#define ADAPTIVE_BLOCK_SIZE 16
+#define ADAPTIVE_STACK_SIZE 64
+#define ADAPTIVE_CACHE_SIZE (ADAPTIVE_BLOCK_SIZE + 1)
+#define MAX_UPSAMPLE_FACTOR 8
+#define UPSAMPLE_KEY_FRAMES 3
+#define MAX_DAEMON_CLIENTS 64
+#define MAX_DAEMON_REQUESTS 256
+#define RADIAL_CACHE_ENTRIES 4
+#define DAEMON_REPORT_INTERVAL_MS 1000
 
 #define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 #define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 
-SDL_DisplayMode displayMode;
-SDL_Window *window = NULL;
-SDL_Renderer *renderer = NULL;
-SDL_Texture *texture = NULL;
-Uint32 *pixelBuffer = NULL;
+typedef enum {
+    HALF_RATE_OFF,
+    HALF_RATE_CHECKER,
+    HALF_RATE_INTERLACE
+} HalfRateMode;
+
+typedef struct {
+    double psnr;
+    int maxError;
+} FrameError;
+
+// Distances from a table cell to the centre of the table. The moving centre
+// term needs the distance biased by one, the interactive mouse term needs the
+// plain distance.
+typedef struct {
+    float centre;
+    float mouse;
+} RadialSample;
+
+typedef struct {
+    Uint32 *target;
+    double t;
+    int parity;
+    int withMouse;
+    const RadialSample *centre;
+    const RadialSample *mouse;
+    // Set instead of target when frames are drawn at 16 bits per pixel.
+    Uint16 *target16;
+} FrameJob;
+
+// Pixels shaded and pixels filled in by interpolation in adaptive mode.
+typedef struct {
+    Uint64 evaluated;
+    Uint64 filled;
+} AdaptiveCounts;
+
+// A square block of the adaptive quadtree with the colors at its corners.
+// Blocks on the right and bottom edges of the frame are cut off, and their
+// far corners clamped to the last column and row.
+typedef struct {
+    int x0;
+    int y0;
+    int size;
+    Uint32 corners[4];
+} AdaptiveBlock;
+
+// The samples taken on the lattice of one top level block, its edges
+// included, so the blocks of the quadtree share their corners and edge
+// midpoints with their neighbours instead of shading them again.
+typedef struct {
+    int x0;
+    int y0;
+    Uint8 valid[ADAPTIVE_CACHE_SIZE * ADAPTIVE_CACHE_SIZE];
+    Uint32 colors[ADAPTIVE_CACHE_SIZE * ADAPTIVE_CACHE_SIZE];
+} AdaptiveCache;
+
+// Blends two frames into a third, weight / 256 of the way from one to the
+// other.
+typedef struct {
+    Uint32 *target;
+    const Uint32 *from;
+    const Uint32 *to;
+    int weight;
+} BlendJob;
+
+// Evaluates the rows of a key frame from y0 on, a slice of it at a time.
+typedef struct {
+    FrameJob frame;
+    int y0;
+} KeySliceJob;
+
+// A single frame rendered as a strip image, at time t. Without a radial
+// table the centre distance is taken per pixel, at the same offset, rounded
+// to whole pixels, as the table window of a frame at that time.
+typedef struct {
+    double t;
+    int centreShiftX;
+    int centreShiftY;
+} StripJob;
+
+typedef void (*RowsKernel)(const FrameJob *job, int y0, int y1);
+typedef void (*AdaptiveRowsKernel)(const FrameJob *job, AdaptiveCounts *counts,
+                                   int y0, int y1);
+typedef void (*IndexRowsKernel)(const FrameJob *job, Uint8 *indices, int y0,
+                                int y1);
+typedef void (*BlendRowsKernel)(const BlendJob *job, int y0, int y1);
+typedef void (*StripRowsKernel)(const StripJob *job, const ImageStrip *strip,
+                                int y0, int y1);
+
+typedef struct {
+    int level;
+    int frames;
+    double drawMsSum;
+} Governor;
+
+// A batch of consecutive frames rendered offline, one per slot. Slots past
+// frameCount are left alone in the last batch of a range. Frames are packed
+// RGB, or the indices of a loop cache into palette when it is set.
+typedef struct {
+    unsigned char *slots;
+    size_t slotBytes;
+    const Uint32 *palette;
+    double timeStart;
+    double timeStep;
+    int firstFrame;
+    int frameCount;
+} OfflineBatch;
+
+// The batches rendered offline and the writer thread that writes them out.
+typedef struct {
+    OfflineBatch batches[OFFLINE_BATCHES];
+    FILE *output;
+    const char *name;
+    // Counts the batches rendered and not written yet, and the batches free
+    // to render into.
+    SDL_sem *rendered;
+    SDL_sem *free;
+    atomic_int failed;
+} OfflineWriter;
+
+// A radial table the daemon keeps for one resolution, so serving clients of
+// different resolutions does not rebuild the table on every batch.
+typedef struct {
+    int width;
+    int height;
+    Uint64 lastUsed;
+    RadialSample *table;
+    FrameMemory memory;
+} RadialCacheEntry;
+
+typedef struct {
+    int fd;
+    int number;
+    unsigned char buffer[sizeof(RenderRequest)];
+    size_t filled;
+    ShmRing ring;
+    RenderClientStats stats;
+    Uint64 connectedNs;
+    Uint64 reportFrames;
+    double reportLatencyMsSum;
+} DaemonClient;
+
+typedef struct {
+    DaemonClient *client;
+    RenderRequest request;
+    Uint64 receivedNs;
+    int frame;
+} PendingRequest;
+
+// The distinct frames of one resolution in a daemon batch. Each one is
+// rendered once, into its own slot, however many requests asked for it.
+typedef struct {
+    FrameJob jobs[MAX_DAEMON_REQUESTS];
+    int count;
+} DaemonBatch;
+
+// Internal render resolutions the governor steps through, as a percentage of
+// the resolution given on the command line.
+const int governorLevels[] = {100, 85, 70, 50, 35, 25};
+const int governorLevelCount =
+    sizeof(governorLevels) / sizeof(governorLevels[0]);
+
+SDL_DisplayMode displayMode;
+SDL_Window *window = NULL;
+SDL_Renderer *renderer = NULL;
+SDL_Texture *texture = NULL;
+Uint32 *pixelBuffer = NULL;
+Uint16 *pixelBuffer16 = NULL;
+Uint32 *referenceBuffer = NULL;
+RadialSample *radialTable = NULL;
+FrameMemory pixelMemory;
+FrameMemory referenceMemory;
+FrameMemory keyMemory[UPSAMPLE_KEY_FRAMES];
+// The key frame at the start of the current interval, the one at its end and
+// the one being evaluated for the end of the next interval.
+Uint32 *keyBuffers[UPSAMPLE_KEY_FRAMES];
+double *formulaColumns = NULL;
+FrameMemory radialMemory;
+FrameMemory offlineMemory[OFFLINE_BATCHES];
+FrameMemory formulaMemory;
+LoopCache loopCache;
+ShmRing shmRing;
+RadialCacheEntry radialCache[RADIAL_CACHE_ENTRIES];
+FrameMemory daemonMemory;
+DaemonClient daemonClients[MAX_DAEMON_CLIENTS];
+PendingRequest pendingRequests[MAX_DAEMON_REQUESTS];
+DaemonBatch daemonBatch;
+WorkerPool workerPool;
+PerfTotals drawCounters;
+UploadStats uploadStats;
+Benchmark benchmark;
+Realtime realtime;
+JitterHistogram jitter;
+StripImage stripImage;
+int radialTableWidth = 0;
+int radialTableHeight = 0;
+
+int width = DEFAULT_WIDTH;
+int height = DEFAULT_HEIGHT;
+int scale = DEFAULT_SCALE;
+int baseWidth = DEFAULT_WIDTH;
+int baseHeight = DEFAULT_HEIGHT;
+int fullscreen = 0;
+int interactive = 0;
+int workerCount = 0;
+int reportPlacement = 0;
+int perfEnabled = 0;
+int outputDepth = OUTPUT_DEPTH_32;
+HalfRateMode halfRateMode = HALF_RATE_OFF;
+int halfRateParity = 0;
+int halfRateFrames = 0;
+int adaptiveThreshold = -1;
+atomic_ullong adaptiveEvaluated = 0;
+atomic_ullong adaptiveFilled = 0;
+atomic_ullong loopSquaredError = 0;
+atomic_int loopErrorFrames = 0;
+int upsampleFactor = 0;
+int upsamplePhase = 0;
+int upsampleKeyFrames = 0;
+double upsampleInterval = 0.0;
+double upsampleKeyTime = 0.0;
+int governorEnabled = 0;
+int governorMargin = 0;
+Governor governor = {0, 0, 0.0};
+Kernel kernel = KERNEL_GENERIC;
+int kernelOverridden = 0;
+RowsKernel evaluateRows = NULL;
+RowsKernel evaluateRows16 = NULL;
+RowsKernel reconstructRows = NULL;
+AdaptiveRowsKernel adaptiveRows = NULL;
+BlendRowsKernel blendRows = NULL;
+IndexRowsKernel evaluateIndexRows = NULL;
+StripRowsKernel evaluateStripRows = NULL;
+const PlasmaFormula *plasmaFormula = NULL;
+PlasmaFormulaRowsKernel formulaRows = NULL;
+const char *tracePath = NULL;
+const char *offlinePath = NULL;
+double offlineStart = 0.0;
+double offlineEnd = 10.0;
+int shardIndex = 0;
+int shardCount = 1;
+const char *loopPath = NULL;
+char shmRingName[SHM_RING_NAME_SIZE] = "";
+int shmRingSlots = DEFAULT_SHM_RING_SLOTS;
+const char *daemonPath = NULL;
+int daemonListener = -1;
+int daemonClientNumber = 0;
+int pendingRequestCount = 0;
+Uint64 radialCacheClock = 0;
+volatile sig_atomic_t daemonRunning = 1;
+
+// Timestamps of the input events that have not been presented yet, and the
+// histogram of their input to present latency, one bucket per millisecond.
+Uint32 pendingInputTicks[MAX_PENDING_INPUTS];
+int pendingInputCount = 0;
+Uint64 latencyHistogram[LATENCY_HISTOGRAM_BUCKETS + 1];
+
+double mouseX = -0.5;
+double mouseY = -0.5;
+
+KERNEL_INLINE int Get1DArrayIndex(int x, int y, int width) {
+    return (y * width) + x;
+}
+
+double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
+    return (double)(end - start) / SDL_GetPerformanceFrequency();
+}
+
+double GetElapsedTimeMs(Uint64 start, Uint64 end) {
+    return (double)((end - start) * 1000.0) / SDL_GetPerformanceFrequency();
+}
+
+int GetDisplayRefreshRate(SDL_DisplayMode displayMode) {
+    int result = displayMode.refresh_rate;
+
+    if (result == 0) {
+        return DEFAULT_REFRESH_RATE;
+    }
+
+    return result;
+}
+
+int InitSDL(void) {
+    SDL_Init(SDL_INIT_VIDEO);
+
+    if (SDL_GetDesktopDisplayMode(0, &displayMode) != 0) {
+        return -1;
+    }
+
+    window = SDL_CreateWindow(
+        WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+        width * scale, height * scale, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    if (window == NULL) {
+        return -1;
+    }
+    LogInfo("window created with size %dx%d", width, height);
+
+    if (fullscreen) {
+        SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
+    }
+
+    if (!interactive) {
+        SDL_ShowCursor(SDL_DISABLE);
+    }
+
+    renderer = SDL_CreateRenderer(
+        window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == NULL) {
+        return -1;
+    }
+    LogInfo("renderer created with logical size %dx%d", width, height);
+
+    SDL_RenderSetLogicalSize(renderer, width, height);
+
+    texture = SDL_CreateTexture(renderer, GetOutputFormat(outputDepth),
+                                SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (texture == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+KERNEL_INLINE double GetPlasmaX(int xi) {
+    return GetPlasmaCoordinate(xi, width);
+}
+
+KERNEL_INLINE double GetPlasmaY(int yi) {
+    return GetPlasmaCoordinate(yi, height);
+}
+
+void FillRadialBand(void *data, int v0, int v1) {
+    (void)data;
+
+    for (int v = v0; v < v1; v++) {
+        double y = GetPlasmaY(v - height / 2);
+
+        for (int u = 0; u < radialTableWidth; u++) {
+            double x = GetPlasmaX(u - width / 2);
+            double squaredDistance = x * x + y * y;
+
+            RadialSample *sample =
+                &radialTable[Get1DArrayIndex(u, v, radialTableWidth)];
+            sample->centre = (float)FastSqrt(squaredDistance + 1.0);
+            sample->mouse = (float)FastSqrt(squaredDistance);
+        }
+    }
+}
+
+// Fills a table twice the size of the frame in each dimension with the
+// distance from every cell to the table's centre, in plasma coordinates. Both
+// radial terms only translate over time, so every frame can read them through
+// a frame sized window into the table instead of taking a square root per
+// pixel.
+int CreateRadialTable(FrameMemory *memory) {
+    radialTableWidth = width * 2;
+    radialTableHeight = height * 2;
+
+    radialTable = AllocFrameMemory(memory, &workerPool,
+                                   radialTableWidth * sizeof(*radialTable),
+                                   radialTableHeight);
+    if (radialTable == NULL) {
+        LogError("failed to allocate radial table %dx%d", radialTableWidth,
+                 radialTableHeight);
+        return -1;
+    }
+
+    RunWorkers(&workerPool, FillRadialBand, NULL, radialTableHeight);
+
+    return 0;
+}
+
+int CreateFrameBuffers(void) {
+    void *pixels =
+        AllocFrameMemory(&pixelMemory, &workerPool,
+                         width * GetOutputBytesPerPixel(outputDepth), height);
+    if (pixels == NULL) {
+        LogError("failed to allocate pixel buffer %dx%d", width, height);
+        return -1;
+    }
+    if (outputDepth == OUTPUT_DEPTH_16) {
+        pixelBuffer16 = pixels;
+    } else {
+        pixelBuffer = pixels;
+    }
+    if (halfRateMode != HALF_RATE_OFF || adaptiveThreshold >= 0 ||
+        upsampleFactor > 0) {
+        referenceBuffer =
+            AllocFrameMemory(&referenceMemory, &workerPool,
+                             width * sizeof(*referenceBuffer), height);
+        if (referenceBuffer == NULL) {
+            LogError("failed to allocate reference buffer %dx%d", width,
+                     height);
+            return -1;
+        }
+    }
+    for (int i = 0; upsampleFactor > 0 && i < UPSAMPLE_KEY_FRAMES; i++) {
+        keyBuffers[i] =
+            AllocFrameMemory(&keyMemory[i], &workerPool,
+                             width * sizeof(*keyBuffers[i]), height);
+        if (keyBuffers[i] == NULL) {
+            LogError("failed to allocate key frame buffer %dx%d", width,
+                     height);
+            return -1;
+        }
+    }
+
+    // Generated formulas evaluate their radial terms themselves, from their
+    // own column tables.
+    if (plasmaFormula != NULL) {
+        formulaColumns = AllocFrameMemory(&formulaMemory, &workerPool,
+                                          width * sizeof(*formulaColumns),
+                                          plasmaFormula->tableCount);
+        if (formulaColumns == NULL) {
+            LogError("failed to allocate formula tables %dx%d", width,
+                     plasmaFormula->tableCount);
+            return -1;
+        }
+        return 0;
+    }
+
+    return CreateRadialTable(&radialMemory);
+}
+
+void DestroyFrameBuffers(void) {
+    FreeFrameMemory(&formulaMemory);
+    formulaColumns = NULL;
+    FreeFrameMemory(&radialMemory);
+    FreeFrameMemory(&referenceMemory);
+    FreeFrameMemory(&pixelMemory);
+    for (int i = 0; i < UPSAMPLE_KEY_FRAMES; i++) {
+        FreeFrameMemory(&keyMemory[i]);
+        keyBuffers[i] = NULL;
+    }
+    radialTable = NULL;
+    referenceBuffer = NULL;
+    pixelBuffer = NULL;
+    pixelBuffer16 = NULL;
+}
+
+void ReportPlacement(void) {
+    ReportWorkerPinning(&workerPool);
+    ReportFramePlacement("pixel buffer", &pixelMemory, &workerPool, height);
+    if (referenceBuffer != NULL) {
+        ReportFramePlacement("reference buffer", &referenceMemory, &workerPool,
+                             height);
+    }
+    for (int i = 0; upsampleFactor > 0 && i < UPSAMPLE_KEY_FRAMES; i++) {
+        ReportFramePlacement("key frame buffer", &keyMemory[i], &workerPool,
+                             height);
+    }
+    if (plasmaFormula != NULL) {
+        ReportFramePlacement("formula tables", &formulaMemory, &workerPool,
+                             plasmaFormula->tableCount);
+        return;
+    }
+    ReportFramePlacement("radial table", &radialMemory, &workerPool,
+                         radialTableHeight);
+}
+
+int GetRadialShift(double offset, int size) {
+    int shift = (int)floor(offset * size / PLASMA_SCALE + 0.5);
+
+    if (shift < -size / 2) {
+        return -size / 2;
+    }
+    if (shift > size / 2) {
+        return size / 2;
+    }
+    return shift;
+}
+
+// Returns the sample holding the distance from pixel (0, 0) to a point offset
+// by (offsetX, offsetY), rounded to the nearest pixel. The samples for the
+// rest of the frame follow it with a stride of radialTableWidth.
+const RadialSample *GetRadialWindow(double offsetX, double offsetY) {
+    int u = width / 2 + GetRadialShift(offsetX, width);
+    int v = height / 2 + GetRadialShift(offsetY, height);
+
+    return &radialTable[Get1DArrayIndex(u, v, radialTableWidth)];
+}
+
+KERNEL_INLINE Uint32 ShadePixel(double x, double y, double t,
+                                double centreDistance, double mouseDistance,
+                                int withMouse) {
+    double val = PlasmaValue(x, y, t, centreDistance);
+    if (!withMouse) {
+        return ShadeValue(val);
+    }
+
+    double r = FastSin((val + FastSin(mouseDistance * 2 + t)) * PI) * 0.5 + 0.5;
+    double g = FastSin(val * PI + 2.0 * PI * 0.33) * 0.5 + 0.5;
+    double b = FastSin((val + FastCos(mouseDistance + t * 0.33)) * PI +
+                       4.0 * PI * 0.33) *
+                   0.5 +
+               0.5;
+
+    return ShadeChannels(r, g, b);
+}
+
+// Loop cache palette index i stands for an evenly spaced plasma value.
+KERNEL_INLINE double GetLoopIndexValue(int index) {
+    return -2.0 + index * (4.0 / (LOOP_CACHE_PALETTE_SIZE - 1));
+}
+
+KERNEL_INLINE Uint8 GetLoopIndex(double val) {
+    int index =
+        (int)((val + 2.0) * ((LOOP_CACHE_PALETTE_SIZE - 1) / 4.0) + 0.5);
+
+    if (index < 0) {
+        return 0;
+    }
+    if (index > LOOP_CACHE_PALETTE_SIZE - 1) {
+        return LOOP_CACHE_PALETTE_SIZE - 1;
+    }
+    return (Uint8)index;
+}
+
+// Averages each 8 bit channel of two packed colors without unpacking them.
+KERNEL_INLINE Uint32 AverageRGB(Uint32 a, Uint32 b) {
+    return (a & b) + (((a ^ b) & 0xfefefe) >> 1);
+}
+
+// Shades every step-th pixel of a row from start. Callers pass the step and
+// withMouse as constants, which folds the branch in ShadePixel away and gives
+// the loads a fixed stride, so every copy of the loop vectorizes. The x
+// coordinate comes from the local width, as the stores could alias the
+// global one.
+KERNEL_INLINE void ShadeRow(Uint32 *row, const RadialSample *centreRow,
+                            const RadialSample *mouseRow, int start, int step,
+                            double y, double t, int withMouse) {
+    const int frameWidth = width;
+    const int count = (frameWidth - start + step - 1) / step;
+
+    for (int i = 0; i < count; i++) {
+        int xi = start + i * step;
+        row[xi] = ShadePixel(GetPlasmaCoordinate(xi, frameWidth), y, t,
+                             centreRow[xi].centre, mouseRow[xi].mouse,
+                             withMouse);
+    }
+}
+
+// Evaluates the rows [y0, y1) of a frame. A negative parity evaluates every
+// pixel, otherwise only the half of the pixels selected by the half rate mode
+// for that parity.
+KERNEL_INLINE void EvaluateRowsBody(const FrameJob *job, int y0, int y1) {
+    const int frameWidth = width;
+    const int tableWidth = radialTableWidth;
+    const int withMouse = job->withMouse;
+    const int checker = halfRateMode == HALF_RATE_CHECKER;
+    Uint32 *target = job->target;
+    double t = job->t;
+
+    for (int yi = y0; yi < y1; yi++) {
+        int start = 0;
+        int step = 1;
+        if (job->parity >= 0) {
+            if (checker) {
+                start = (yi + job->parity) & 1;
+                step = 2;
+            } else if (((yi + job->parity) & 1) != 0) {
+                continue;
+            }
+        }
+
+        double y = GetPlasmaY(yi);
+        const RadialSample *centreRow = &job->centre[yi * tableWidth];
+        const RadialSample *mouseRow = &job->mouse[yi * tableWidth];
+        Uint32 *row = &target[Get1DArrayIndex(0, yi, frameWidth)];
+
+        if (step == 1 && withMouse) {
+            ShadeRow(row, centreRow, mouseRow, 0, 1, y, t, 1);
+        } else if (step == 1) {
+            ShadeRow(row, centreRow, mouseRow, 0, 1, y, t, 0);
+        } else if (withMouse) {
+            ShadeRow(row, centreRow, mouseRow, start, 2, y, t, 1);
+        } else {
+            ShadeRow(row, centreRow, mouseRow, start, 2, y, t, 0);
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(RowsKernel, EvaluateRows,
+                       (const FrameJob *job, int y0, int y1), (job, y0, y1));
+
+// Evaluates the rows [y0, y1) of a strip of a strip image straight to the RGB
+// bytes of the image. The distance is rounded to a float like a radial table
+// sample, so the image matches a frame rendered with -o.
+KERNEL_INLINE void EvaluateStripRowsBody(const StripJob *job,
+                                         const ImageStrip *strip, int y0,
+                                         int y1) {
+    const int frameWidth = width;
+    const int shiftX = job->centreShiftX;
+    double t = job->t;
+
+    for (int row = y0; row < y1; row++) {
+        int yi = strip->y0 + row;
+        double y = GetPlasmaY(yi);
+        double centreY = GetPlasmaY(yi + job->centreShiftY);
+        unsigned char *pixels = strip->pixels + row * strip->rowBytes;
+
+        for (int xi = 0; xi < frameWidth; xi++) {
+            double centreX = GetPlasmaX(xi + shiftX);
+            double centreDistance = (float)FastSqrt(
+                centreX * centreX + centreY * centreY + 1.0);
+            Uint32 pixel =
+                ShadeValue(PlasmaValue(GetPlasmaX(xi), y, t, centreDistance));
+            pixels[xi * 3 + 0] = (pixel >> 16) & 0xff;
+            pixels[xi * 3 + 1] = (pixel >> 8) & 0xff;
+            pixels[xi * 3 + 2] = pixel & 0xff;
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(StripRowsKernel, EvaluateStripRows,
+                       (const StripJob *job, const ImageStrip *strip, int y0,
+                        int y1),
+                       (job, strip, y0, y1));
+
+// Shades row yi straight to dithered RGB565. Like ShadeRow it is called with
+// a constant withMouse so the loop vectorizes.
+KERNEL_INLINE void ShadeRow16(Uint16 *row, const RadialSample *centreRow,
+                              const RadialSample *mouseRow, int yi, double y,
+                              double t, int withMouse) {
+    const int frameWidth = width;
+
+    for (int xi = 0; xi < frameWidth; xi++) {
+        Uint32 color = ShadePixel(GetPlasmaCoordinate(xi, frameWidth), y, t,
+                                  centreRow[xi].centre, mouseRow[xi].mouse,
+                                  withMouse);
+        row[xi] = PackRGB565(color, GetBayerThreshold(xi, yi));
+    }
+}
+
+// Evaluates the rows [y0, y1) of a frame and packs them straight to dithered
+// RGB565.
+KERNEL_INLINE void EvaluateRows16Body(const FrameJob *job, int y0, int y1) {
+    const int frameWidth = width;
+    const int tableWidth = radialTableWidth;
+    const int withMouse = job->withMouse;
+    Uint16 *target = job->target16;
+    double t = job->t;
+
+    for (int yi = y0; yi < y1; yi++) {
+        double y = GetPlasmaY(yi);
+        const RadialSample *centreRow = &job->centre[yi * tableWidth];
+        const RadialSample *mouseRow = &job->mouse[yi * tableWidth];
+        Uint16 *row = &target[Get1DArrayIndex(0, yi, frameWidth)];
+
+        if (withMouse) {
+            ShadeRow16(row, centreRow, mouseRow, yi, y, t, 1);
+        } else {
+            ShadeRow16(row, centreRow, mouseRow, yi, y, t, 0);
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(RowsKernel, EvaluateRows16,
+                       (const FrameJob *job, int y0, int y1), (job, y0, y1));
+
+// Evaluates the rows [y0, y1) of a frame as loop cache palette indices.
+KERNEL_INLINE void EvaluateIndexRowsBody(const FrameJob *job, Uint8 *indices,
+                                         int y0, int y1) {
+    const int frameWidth = width;
+    const int tableWidth = radialTableWidth;
+    double t = job->t;
+
+    for (int yi = y0; yi < y1; yi++) {
+        double y = GetPlasmaY(yi);
+        const RadialSample *centreRow = &job->centre[yi * tableWidth];
+        Uint8 *row = &indices[Get1DArrayIndex(0, yi, frameWidth)];
+
+        for (int xi = 0; xi < frameWidth; xi++) {
+            row[xi] = GetLoopIndex(
+                PlasmaValue(GetPlasmaX(xi), y, t, centreRow[xi].centre));
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(IndexRowsKernel, EvaluateIndexRows,
+                       (const FrameJob *job, Uint8 *indices, int y0, int y1),
+                       (job, indices, y0, y1));
+
+// Fills in the pixels of rows [y0, y1) that EvaluateRows skipped for the
+// job's parity, by blending the average of their freshly evaluated neighbours
+// with the value they were given on the previous frame. The skipped pixels
+// never neighbour each other, so the fill can be done in place.
+// The neighbour step pixels from pixel i in a row or column of size pixels.
+// Past an edge it mirrors back inside, and a single pixel is its own
+// neighbour.
+KERNEL_INLINE int GetMirroredNeighbour(int i, int size, int step) {
+    int neighbour = i + step;
+    if (neighbour < 0 || neighbour > size - 1) {
+        neighbour = i - step;
+    }
+    return neighbour < 0 ? 0 : (neighbour < size ? neighbour : size - 1);
+}
+
+KERNEL_INLINE void ReconstructRowsBody(const FrameJob *job, int y0, int y1) {
+    const int frameWidth = width;
+    const int frameHeight = height;
+    const int checker = halfRateMode == HALF_RATE_CHECKER;
+    Uint32 *target = job->target;
+
+    for (int yi = y0; yi < y1; yi++) {
+        int start = 0;
+        int step = 1;
+        if (checker) {
+            start = ((yi + job->parity) & 1) ^ 1;
+            step = 2;
+        } else if (((yi + job->parity) & 1) == 0) {
+            continue;
+        }
+
+        int up = GetMirroredNeighbour(yi, frameHeight, -1);
+        int down = GetMirroredNeighbour(yi, frameHeight, 1);
+        const Uint32 *upRow = &target[Get1DArrayIndex(0, up, frameWidth)];
+        const Uint32 *downRow = &target[Get1DArrayIndex(0, down, frameWidth)];
+        Uint32 *row = &target[Get1DArrayIndex(0, yi, frameWidth)];
+
+        for (int xi = start; xi < frameWidth; xi += step) {
+            Uint32 spatial = AverageRGB(upRow[xi], downRow[xi]);
+            if (checker) {
+                int left = GetMirroredNeighbour(xi, frameWidth, -1);
+                int right = GetMirroredNeighbour(xi, frameWidth, 1);
+                spatial =
+                    AverageRGB(spatial, AverageRGB(row[left], row[right]));
+            }
+
+            row[xi] = AverageRGB(spatial, row[xi]);
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(RowsKernel, ReconstructRows,
+                       (const FrameJob *job, int y0, int y1), (job, y0, y1));
+
+// Shades the pixel nearest to (xi, yi) inside the frame.
+KERNEL_INLINE Uint32 SampleFrame(const FrameJob *job, int xi, int yi,
+                                 AdaptiveCounts *counts) {
+    xi = xi < width - 1 ? xi : width - 1;
+    yi = yi < height - 1 ? yi : height - 1;
+    int index = Get1DArrayIndex(xi, yi, radialTableWidth);
+
+    counts->evaluated++;
+    return ShadePixel(GetPlasmaX(xi), GetPlasmaY(yi), job->t,
+                      job->centre[index].centre, job->mouse[index].mouse,
+                      job->withMouse);
+}
+
+KERNEL_INLINE int GetChannel(Uint32 color, int channel) {
+    return (color >> (channel * 8)) & 0xff;
+}
+
+// How far the color at a block's centre is from the average of its corners,
+// in 8 bit levels of the channel that is furthest off.
+KERNEL_INLINE int GetCornerDisagreement(const Uint32 corners[4],
+                                        Uint32 centre) {
+    int largest = 0;
+
+    for (int channel = 0; channel < 3; channel++) {
+        int sum = 0;
+        for (int i = 0; i < 4; i++) {
+            sum += GetChannel(corners[i], channel);
+        }
+        int error = abs(GetChannel(centre, channel) * 4 - sum) / 4;
+        largest = error > largest ? error : largest;
+    }
+
+    return largest;
+}
+
+// Fills the pixels of a block, up to row y1, by interpolating between the
+// colors at its corners. Channels are interpolated in 16.16 fixed point,
+// which lets the inner loop vectorize.
+KERNEL_INLINE void FillBlock(Uint32 *target, const AdaptiveBlock *block,
+                             int x1, int y1) {
+    const int frameWidth = width;
+    const int count = x1 - block->x0;
+    int spanX = block->x0 + block->size < width ? block->size
+                                                : width - 1 - block->x0;
+    int spanY = block->y0 + block->size < height ? block->size
+                                                 : height - 1 - block->y0;
+    // Blocks inside the frame span a power of two, so these are exact.
+    const int stepX = 65536 / (spanX > 0 ? spanX : 1);
+    const int stepY = 65536 / (spanY > 0 ? spanY : 1);
+    int start[3], step[3], startStep[3], stepStep[3];
+
+    for (int c = 0; c < 3; c++) {
+        int topLeft = GetChannel(block->corners[0], c);
+        int topRight = GetChannel(block->corners[1], c);
+        int bottomLeft = GetChannel(block->corners[2], c);
+        int bottomRight = GetChannel(block->corners[3], c);
+        start[c] = (topLeft << 16) + 0x8000;
+        step[c] = (topRight - topLeft) * stepX;
+        startStep[c] = (bottomLeft - topLeft) * stepY;
+        stepStep[c] = (int)((Sint64)(bottomRight - bottomLeft - topRight +
+                                     topLeft) *
+                                stepX * stepY >>
+                            16);
+    }
+
+    for (int yi = block->y0; yi < y1; yi++) {
+        Uint32 *row = &target[Get1DArrayIndex(block->x0, yi, frameWidth)];
+        for (int i = 0; i < count; i++) {
+            Uint32 b = (Uint32)(start[0] + step[0] * i) >> 16;
+            Uint32 g = (Uint32)(start[1] + step[1] * i) >> 16;
+            Uint32 r = (Uint32)(start[2] + step[2] * i) >> 16;
+            row[i] = (r << 16) | (g << 8) | b;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            start[c] += startStep[c];
+            step[c] += stepStep[c];
+        }
+    }
+}
+
+// Looks up the samples at the given points of the cached block, shading the
+// ones nothing has taken yet. Every sample goes through this one loop, which
+// keeps the shading code inlined once per kernel variant.
+KERNEL_INLINE void SampleBlock(const FrameJob *job, AdaptiveCache *cache,
+                               AdaptiveCounts *counts, const int points[][2],
+                               int count, Uint32 *colors) {
+    for (int i = 0; i < count; i++) {
+        int index = Get1DArrayIndex(points[i][0] - cache->x0,
+                                    points[i][1] - cache->y0,
+                                    ADAPTIVE_CACHE_SIZE);
+        if (!cache->valid[index]) {
+            cache->colors[index] =
+                SampleFrame(job, points[i][0], points[i][1], counts);
+            cache->valid[index] = 1;
+        }
+        colors[i] = cache->colors[index];
+    }
+}
+
+// Moves the cache on to the next block to the right, keeping the samples on
+// the edge the two blocks share.
+KERNEL_INLINE void AdvanceCache(AdaptiveCache *cache, int x0) {
+    for (int row = 0; row < ADAPTIVE_CACHE_SIZE; row++) {
+        int first = row * ADAPTIVE_CACHE_SIZE;
+        int last = first + ADAPTIVE_BLOCK_SIZE;
+        cache->valid[first] = cache->valid[last];
+        cache->colors[first] = cache->colors[last];
+        memset(&cache->valid[first + 1], 0, ADAPTIVE_BLOCK_SIZE);
+    }
+    cache->x0 = x0;
+}
+
+// Renders the rows [y0, y1) as a quadtree of blocks. Each block starts out
+// with its corners evaluated and is evaluated at its centre as well. When the
+// centre agrees with the corners to within the threshold the block is filled
+// by bilinear interpolation, otherwise it is split into four, which only
+// takes the midpoints of its edges as new samples.
+KERNEL_INLINE void AdaptiveRowsBody(const FrameJob *job, AdaptiveCounts *counts,
+                                    int y0, int y1) {
+    const int frameWidth = width;
+    const int threshold = adaptiveThreshold;
+    AdaptiveBlock stack[ADAPTIVE_STACK_SIZE];
+    AdaptiveCache cache;
+
+    for (int by = y0; by < y1; by += ADAPTIVE_BLOCK_SIZE) {
+        memset(cache.valid, 0, sizeof(cache.valid));
+        cache.x0 = 0;
+        cache.y0 = by;
+
+        for (int bx = 0; bx < frameWidth; bx += ADAPTIVE_BLOCK_SIZE) {
+            int right = bx + ADAPTIVE_BLOCK_SIZE;
+            int bottom = by + ADAPTIVE_BLOCK_SIZE;
+            if (bx > 0) {
+                AdvanceCache(&cache, bx);
+            }
+
+            int depth = 0;
+            AdaptiveBlock *root = &stack[depth++];
+            root->x0 = bx;
+            root->y0 = by;
+            root->size = ADAPTIVE_BLOCK_SIZE;
+            const int corners[4][2] = {
+                {bx, by}, {right, by}, {bx, bottom}, {right, bottom}};
+            SampleBlock(job, &cache, counts, corners, 4, root->corners);
+
+            while (depth > 0) {
+                AdaptiveBlock block = stack[--depth];
+                int x1 = block.x0 + block.size;
+                int blockY1 = block.y0 + block.size;
+                x1 = x1 < frameWidth ? x1 : frameWidth;
+                blockY1 = blockY1 < y1 ? blockY1 : y1;
+
+                if (block.size == 1) {
+                    job->target[Get1DArrayIndex(block.x0, block.y0,
+                                                frameWidth)] = block.corners[0];
+                    continue;
+                }
+
+                int half = block.size / 2;
+                int xm = block.x0 + half;
+                int ym = block.y0 + half;
+                int xr = block.x0 + block.size;
+                int yb = block.y0 + block.size;
+                const int points[5][2] = {{xm, ym},
+                                          {xm, block.y0},
+                                          {block.x0, ym},
+                                          {xr, ym},
+                                          {xm, yb}};
+                Uint32 samples[5];
+                SampleBlock(job, &cache, counts, points, 1, samples);
+                Uint32 centre = samples[0];
+                int error = GetCornerDisagreement(block.corners, centre);
+                if (error <= threshold) {
+                    FillBlock(job->target, &block, x1, blockY1);
+                    counts->filled += (x1 - block.x0) * (blockY1 - block.y0);
+                    continue;
+                }
+
+                SampleBlock(job, &cache, counts, &points[1], 4, &samples[1]);
+                Uint32 top = samples[1];
+                Uint32 middleLeft = samples[2];
+                Uint32 middleRight = samples[3];
+                Uint32 lower = samples[4];
+                AdaptiveBlock children[4] = {
+                    {block.x0, block.y0, half,
+                     {block.corners[0], top, middleLeft, centre}},
+                    {xm, block.y0, half,
+                     {top, block.corners[1], centre, middleRight}},
+                    {block.x0, ym, half,
+                     {middleLeft, centre, block.corners[2], lower}},
+                    {xm, ym, half,
+                     {centre, middleRight, lower, block.corners[3]}}};
+                for (int i = 0; i < 4; i++) {
+                    if (children[i].x0 < x1 && children[i].y0 < blockY1) {
+                        stack[depth++] = children[i];
+                    }
+                }
+            }
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(AdaptiveRowsKernel, AdaptiveRows,
+                       (const FrameJob *job, AdaptiveCounts *counts, int y0,
+                        int y1),
+                       (job, counts, y0, y1));
+
+// Blends the rows [y0, y1) of two frames. Red and blue sit 16 bits apart, so
+// they are weighted together in one multiply and green in another, without
+// unpacking the channels.
+KERNEL_INLINE void BlendRowsBody(const BlendJob *job, int y0, int y1) {
+    const int frameWidth = width;
+    const Uint32 weight = (Uint32)job->weight;
+    const Uint32 inverse = 256 - weight;
+    const Uint32 *from = &job->from[Get1DArrayIndex(0, y0, frameWidth)];
+    const Uint32 *to = &job->to[Get1DArrayIndex(0, y0, frameWidth)];
+    Uint32 *target = &job->target[Get1DArrayIndex(0, y0, frameWidth)];
+    const int count = (y1 - y0) * frameWidth;
+
+    for (int i = 0; i < count; i++) {
+        Uint32 redBlue =
+            ((from[i] & 0xff00ff) * inverse + (to[i] & 0xff00ff) * weight) >>
+            8;
+        Uint32 green =
+            ((from[i] & 0x00ff00) * inverse + (to[i] & 0x00ff00) * weight) >>
+            8;
+        target[i] = (redBlue & 0xff00ff) | (green & 0x00ff00);
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(BlendRowsKernel, BlendRows,
+                       (const BlendJob *job, int y0, int y1), (job, y0, y1));
+
+// The offset of the moving centre from the middle of the frame at time t.
+const RadialSample *GetCentreWindow(double t, double frequency) {
+    double offsetX, offsetY;
+    GetCentreOffset(t, frequency, &offsetX, &offsetY);
+    return GetRadialWindow(offsetX, offsetY);
+}
+
+const RadialSample *GetMouseWindow(double x, double y) {
+    return GetRadialWindow(-x, -y);
+}
+
+FrameJob CreateFrameJob(Uint32 *target, double t, int parity) {
+    double frequency =
+        loopPath != NULL ? LOOP_CENTRE_FREQUENCY : CENTRE_FREQUENCY;
+    FrameJob job = {target,
+                    t,
+                    parity,
+                    interactive,
+                    GetCentreWindow(t, frequency),
+                    GetMouseWindow(mouseX, mouseY),
+                    NULL};
+    return job;
+}
+
+void RunCountedRows(RowsKernel rows, const FrameJob *job, int y0, int y1) {
+    if (!perfEnabled) {
+        rows(job, y0, y1);
+        return;
+    }
+
+    PerfSample start, end;
+    ReadPerfCounters(&start);
+    rows(job, y0, y1);
+    ReadPerfCounters(&end);
+    AddPerfCounters(&drawCounters, &start, &end);
+}
+
+void EvaluateBand(void *data, int y0, int y1) {
+    RunCountedRows(evaluateRows, data, y0, y1);
+}
+
+void EvaluateBand16(void *data, int y0, int y1) {
+    RunCountedRows(evaluateRows16, data, y0, y1);
+}
+
+void ReconstructBand(void *data, int y0, int y1) {
+    RunCountedRows(reconstructRows, data, y0, y1);
+}
+
+void AdaptiveBand(void *data, int y0, int y1) {
+    AdaptiveCounts counts = {0, 0};
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    adaptiveRows(data, &counts, y0, y1);
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&drawCounters, &start, &end);
+    }
+
+    atomic_fetch_add(&adaptiveEvaluated, counts.evaluated);
+    atomic_fetch_add(&adaptiveFilled, counts.filled);
+}
+
+void DrawAdaptiveFrame(Uint32 *target, double t) {
+    FrameJob job = CreateFrameJob(target, t, -1);
+    RunWorkers(&workerPool, AdaptiveBand, &job, height);
+}
+
+void DrawFullFrame(Uint32 *target, double t) {
+    FrameJob job = CreateFrameJob(target, t, -1);
+    RunWorkers(&workerPool, EvaluateBand, &job, height);
+}
+
+void FormulaBand(void *data, int y0, int y1) {
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    formulaRows(data, y0, y1);
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&drawCounters, &start, &end);
+    }
+}
+
+void DrawFormulaFrame(Uint32 *target, double t) {
+    PlasmaFormulaJob job = {target, t, width, height, formulaColumns};
+    plasmaFormula->setup(&job);
+    RunWorkers(&workerPool, FormulaBand, &job, height);
+}
+
+void DrawFullFrame16(Uint16 *target, double t) {
+    FrameJob job = CreateFrameJob(NULL, t, -1);
+    job.target16 = target;
+    RunWorkers(&workerPool, EvaluateBand16, &job, height);
+}
+
+void BlendBand(void *data, int y0, int y1) {
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    blendRows(data, y0, y1);
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&drawCounters, &start, &end);
+    }
+}
+
+void KeySliceBand(void *data, int y0, int y1) {
+    KeySliceJob *slice = data;
+    RunCountedRows(evaluateRows, &slice->frame, slice->y0 + y0,
+                   slice->y0 + y1);
+}
+
+// Reconstruction reads the rows either side of a band, so every band has to
+// be evaluated before any of them is reconstructed.
+void DrawHalfFrame(Uint32 *target, double t, int parity) {
+    FrameJob job = CreateFrameJob(target, t, parity);
+    RunWorkers(&workerPool, EvaluateBand, &job, height);
+    RunWorkers(&workerPool, ReconstructBand, &job, height);
+}
+
+// Presents the frame at time t between two key frames that are upsampleFactor
+// frames apart, by blending them. Each frame also evaluates the next slice of
+// the key frame after them, so the cost of a key frame is spread evenly over
+// the interval. The key frames lead the presented time by up to two intervals,
+// which is why upsampling can't follow the mouse.
+void DrawUpsampledFrame(double t) {
+    if (upsampleKeyFrames == 0) {
+        DrawFullFrame(keyBuffers[0], t);
+        DrawFullFrame(keyBuffers[1], t + upsampleInterval);
+        upsampleKeyFrames = 2;
+        upsamplePhase = 0;
+    } else if (upsamplePhase == 0) {
+        Uint32 *first = keyBuffers[0];
+        keyBuffers[0] = keyBuffers[1];
+        keyBuffers[1] = keyBuffers[2];
+        keyBuffers[2] = first;
+        upsampleKeyFrames++;
+    }
+    if (upsamplePhase == 0) {
+        upsampleKeyTime = t + 2.0 * upsampleInterval;
+    }
+
+    int y0 = height * upsamplePhase / upsampleFactor;
+    int y1 = height * (upsamplePhase + 1) / upsampleFactor;
+    KeySliceJob slice = {CreateFrameJob(keyBuffers[2], upsampleKeyTime, -1),
+                         y0};
+    Uint64 traceStart = TraceBegin();
+    RunWorkers(&workerPool, KeySliceBand, &slice, y1 - y0);
+    TraceEnd("key slice", traceStart);
+
+    BlendJob blend = {pixelBuffer, keyBuffers[0], keyBuffers[1],
+                      upsamplePhase * 256 / upsampleFactor};
+    traceStart = TraceBegin();
+    RunWorkers(&workerPool, BlendBand, &blend, height);
+    TraceEnd("blend", traceStart);
+
+    upsamplePhase = (upsamplePhase + 1) % upsampleFactor;
+}
+
+// Recreates the streaming texture and frame buffers at a new internal
+// resolution. The logical size follows it, so SDL takes care of scaling the
+// frame up to the window.
+int ResizeRenderTarget(int newWidth, int newHeight) {
+    SDL_DestroyTexture(texture);
+    texture = SDL_CreateTexture(renderer, GetOutputFormat(outputDepth),
+                                SDL_TEXTUREACCESS_STREAMING, newWidth,
+                                newHeight);
+    if (texture == NULL) {
+        LogError("failed to create texture %dx%d, %s", newWidth, newHeight,
+                 SDL_GetError());
+        return -1;
+    }
+    SDL_RenderSetLogicalSize(renderer, newWidth, newHeight);
+
+    DestroyFrameBuffers();
+    width = newWidth;
+    height = newHeight;
+    if (CreateFrameBuffers() != 0) {
+        return -1;
+    }
+    // The previous frame no longer lines up with the new buffers.
+    halfRateFrames = 0;
+    upsampleKeyFrames = 0;
+
+    return 0;
+}
+
+// Averages the cost of DrawFrame over a window of frames and steps the internal
+// resolution down when it no longer fits into the budget, which is the frame
+// time minus the safety margin. It only steps back up when the cost scaled to
+// the next level would still leave some headroom, so it does not oscillate.
+int UpdateGovernor(double drawMs, double targetMsPerFrame) {
+    governor.drawMsSum += drawMs;
+    governor.frames++;
+    if (governor.frames < GOVERNOR_WINDOW_FRAMES) {
+        return 0;
+    }
+
+    double averageMs = governor.drawMsSum / governor.frames;
+    double budgetMs = targetMsPerFrame * (100 - governorMargin) / 100.0;
+    governor.frames = 0;
+    governor.drawMsSum = 0.0;
+
+    int level = governor.level;
+    if (averageMs > budgetMs && level < governorLevelCount - 1) {
+        level++;
+    } else if (level > 0) {
+        double areaRatio = (double)governorLevels[level - 1] *
+                           governorLevels[level - 1] /
+                           ((double)governorLevels[level] *
+                            governorLevels[level]);
+        if (averageMs * areaRatio < budgetMs * GOVERNOR_UPSCALE_HEADROOM) {
+            level--;
+        }
+    }
+    if (level == governor.level) {
+        return 0;
+    }
+
+    int newWidth = baseWidth * governorLevels[level] / 100;
+    int newHeight = baseHeight * governorLevels[level] / 100;
+    if (newWidth < 1) {
+        newWidth = 1;
+    }
+    if (newHeight < 1) {
+        newHeight = 1;
+    }
+    LogInfo("governor: draw cost %f ms against budget %f ms, resizing %dx%d "
+            "-> %dx%d",
+            averageMs, budgetMs, width, height, newWidth, newHeight);
+
+    governor.level = level;
+    return ResizeRenderTarget(newWidth, newHeight);
+}
+
+void DrawFrame(double elapsedTimeInSecs) {
+    if (plasmaFormula != NULL) {
+        DrawFormulaFrame(pixelBuffer, elapsedTimeInSecs);
+        return;
+    }
+    if (adaptiveThreshold >= 0) {
+        DrawAdaptiveFrame(pixelBuffer, elapsedTimeInSecs);
+        return;
+    }
+    if (upsampleFactor > 0) {
+        DrawUpsampledFrame(elapsedTimeInSecs);
+        return;
+    }
+    if (outputDepth == OUTPUT_DEPTH_16) {
+        DrawFullFrame16(pixelBuffer16, elapsedTimeInSecs);
+        return;
+    }
+
+    // The first frame has no previous frame to reconstruct from, so it is
+    // always fully evaluated.
+    if (halfRateMode == HALF_RATE_OFF || halfRateFrames == 0) {
+        DrawFullFrame(pixelBuffer, elapsedTimeInSecs);
+    } else {
+        DrawHalfFrame(pixelBuffer, elapsedTimeInSecs, halfRateParity);
+    }
+
+    halfRateParity ^= 1;
+    halfRateFrames++;
+}
+
+FrameError CompareFrames(const Uint32 *frame, const Uint32 *reference,
+                         int count) {
+    FrameError result = {INFINITY, 0};
+    double squaredErrorSum = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        for (int shift = 0; shift < 24; shift += 8) {
+            int a = (frame[i] >> shift) & 0xff;
+            int b = (reference[i] >> shift) & 0xff;
+            int error = abs(a - b);
+
+            squaredErrorSum += (double)error * error;
+            if (error > result.maxError) {
+                result.maxError = error;
+            }
+        }
+    }
+
+    double meanSquaredError = squaredErrorSum / (count * 3.0);
+    if (meanSquaredError > 0.0) {
+        result.psnr = 10.0 * log10(MAX_CHANNEL_VALUE * MAX_CHANNEL_VALUE /
+                                   meanSquaredError);
+    }
+
+    return result;
+}
+
+void RecordInputLatency(Uint32 presentTicks) {
+    for (int i = 0; i < pendingInputCount; i++) {
+        Uint32 latency = presentTicks - pendingInputTicks[i];
+        if (latency > LATENCY_HISTOGRAM_BUCKETS) {
+            latency = LATENCY_HISTOGRAM_BUCKETS;
+        }
+        latencyHistogram[latency]++;
+    }
+
+    pendingInputCount = 0;
+}
+
+void PrintLatencyHistogram(void) {
+    Uint64 total = 0;
+    Uint64 largest = 0;
+    for (int i = 0; i <= LATENCY_HISTOGRAM_BUCKETS; i++) {
+        total += latencyHistogram[i];
+        if (latencyHistogram[i] > largest) {
+            largest = latencyHistogram[i];
+        }
+    }
+
+    printf("\ninput to present latency over %llu events:\n",
+           (unsigned long long)total);
+    if (total == 0) {
+        return;
+    }
+
+    Uint64 seen = 0;
+    int p50 = -1, p99 = -1;
+    for (int i = 0; i <= LATENCY_HISTOGRAM_BUCKETS; i++) {
+        if (latencyHistogram[i] == 0) {
+            continue;
+        }
+
+        seen += latencyHistogram[i];
+        if (p50 < 0 && seen * 2 >= total) {
+            p50 = i;
+        }
+        if (p99 < 0 && seen * 100 >= total * 99) {
+            p99 = i;
+        }
+
+        int barLength = (int)(latencyHistogram[i] * 50 / largest);
+        printf("%s%3d ms | %-50.*s %llu\n",
+               i == LATENCY_HISTOGRAM_BUCKETS ? ">=" : "  ", i, barLength,
+               "##################################################",
+               (unsigned long long)latencyHistogram[i]);
+    }
+
+    printf("p50: %d ms, p99: %d ms\n", p50, p99);
+}
+
+// Packs a frame of XRGB pixels into the RGB bytes of a PPM image in place.
+// Every pixel moves to a lower address than the pixels after it are read
+// from, so going forwards never overwrites one that has not been read yet.
+void PackRGB(unsigned char *frame, int count) {
+    const Uint32 *pixels = (const Uint32 *)frame;
+
+    for (int i = 0; i < count; i++) {
+        Uint32 pixel = pixels[i];
+        frame[i * 3 + 0] = (pixel >> 16) & 0xff;
+        frame[i * 3 + 1] = (pixel >> 8) & 0xff;
+        frame[i * 3 + 2] = pixel & 0xff;
+    }
+}
+
+// Renders the frame at t exactly and adds its squared error against the
+// palette colors of its loop cache indices to loopSquaredError.
+void AddLoopCacheError(const Uint8 *indices, const Uint32 *palette, double t) {
+    size_t framePixels = (size_t)width * height;
+    Uint32 *exact = malloc(framePixels * sizeof(Uint32));
+    if (exact == NULL) {
+        return;
+    }
+
+    FrameJob job = CreateFrameJob(exact, t, -1);
+    evaluateRows(&job, 0, height);
+
+    Uint64 squaredError = 0;
+    for (size_t i = 0; i < framePixels; i++) {
+        Uint32 cached = palette[indices[i]];
+        for (int shift = 0; shift < 24; shift += 8) {
+            int error = (int)((exact[i] >> shift) & 0xff) -
+                        (int)((cached >> shift) & 0xff);
+            squaredError += error * error;
+        }
+    }
+    free(exact);
+
+    atomic_fetch_add(&loopSquaredError, squaredError);
+    atomic_fetch_add(&loopErrorFrames, 1);
+}
+
+// Every frame only depends on its time, so each worker renders whole frames
+// into its own slots of the batch instead of a band of a shared frame.
+void RenderOfflineBand(void *data, int s0, int s1) {
+    OfflineBatch *batch = data;
+
+    for (int s = s0; s < s1 && s < batch->frameCount; s++) {
+        unsigned char *slot = batch->slots + s * batch->slotBytes;
+        double t = batch->timeStart + (batch->firstFrame + s) * batch->timeStep;
+
+        if (batch->palette != NULL) {
+            FrameJob job = CreateFrameJob(NULL, t, -1);
+            evaluateIndexRows(&job, slot, 0, height);
+            if ((batch->firstFrame + s) % LOOP_ERROR_FRAME_INTERVAL == 0) {
+                AddLoopCacheError(slot, batch->palette, t);
+            }
+        } else {
+            FrameJob job = CreateFrameJob((Uint32 *)slot, t, -1);
+            RunCountedRows(evaluateRows, &job, 0, height);
+            PackRGB(slot, width * height);
+        }
+    }
+}
+
+int WriteOfflineFrame(FILE *output, const OfflineBatch *batch, int s) {
+    size_t framePixels = (size_t)width * height;
+    const unsigned char *slot = batch->slots + s * batch->slotBytes;
+
+    if (batch->palette != NULL) {
+        return fwrite(slot, 1, framePixels, output) == framePixels ? 0 : -1;
+    }
+    fprintf(output, "P6\n%d %d\n255\n", width, height);
+    return fwrite(slot, 3, framePixels, output) == framePixels ? 0 : -1;
+}
+
+// Writes the rendered batches in order until it is handed an empty one. After
+// a failed write it keeps taking batches without writing them, so the render
+// loop never waits on a batch that won't be freed.
+int WriteOfflineBatches(void *data) {
+    OfflineWriter *writer = data;
+    SetTraceThreadName("frame writer");
+
+    for (int b = 0;; b++) {
+        SDL_SemWait(writer->rendered);
+        const OfflineBatch *batch = &writer->batches[b % OFFLINE_BATCHES];
+        if (batch->frameCount == 0) {
+            break;
+        }
+
+        Uint64 traceStart = TraceBegin();
+        for (int s = 0; s < batch->frameCount && !writer->failed; s++) {
+            if (WriteOfflineFrame(writer->output, batch, s) != 0) {
+                LogError("failed to write frame %d to %s",
+                         batch->firstFrame + s, writer->name);
+                writer->failed = 1;
+            }
+        }
+        TraceEnd("write frames", traceStart);
+        SDL_SemPost(writer->free);
+    }
+
+    return 0;
+}
+
+void FreeOfflineMemory(void) {
+    for (int i = 0; i < OFFLINE_BATCHES; i++) {
+        FreeFrameMemory(&offlineMemory[i]);
+    }
+}
+
+// Renders the frames [firstFrame, endFrame), frame i at timeStart + i *
+// timeStep, and writes them to the output in order. Frames are written either
+// as binary PPM images or, given a palette, as the raw palette indices of a
+// loop cache, one byte per pixel. The workers render one batch while a
+// writer thread writes the batch before it, and all of the batches together
+// stay within OFFLINE_SLOT_MEMORY unless a single frame is larger.
+int WriteFrames(FILE *output, const char *name, const Uint32 *palette,
+                double timeStart, double timeStep, int firstFrame,
+                int endFrame) {
+    size_t framePixels = (size_t)width * height;
+    // RGB frames are rendered as XRGB pixels and packed in place.
+    size_t slotBytes = framePixels * (palette != NULL ? 1 : sizeof(Uint32));
+    size_t budgetSlots = OFFLINE_SLOT_MEMORY / (OFFLINE_BATCHES * slotBytes);
+    int batchSlots = workerCount * OFFLINE_FRAMES_PER_WORKER;
+    if ((size_t)batchSlots > budgetSlots) {
+        batchSlots = budgetSlots > 0 ? (int)budgetSlots : 1;
+    }
+
+    OfflineWriter writer;
+    for (int i = 0; i < OFFLINE_BATCHES; i++) {
+        OfflineBatch *batch = &writer.batches[i];
+        batch->palette = palette;
+        batch->timeStart = timeStart;
+        batch->timeStep = timeStep;
+        batch->slotBytes = slotBytes;
+        batch->slots = AllocFrameMemory(&offlineMemory[i], &workerPool,
+                                        slotBytes, batchSlots);
+        if (batch->slots == NULL) {
+            LogError("failed to allocate %d frame slots %dx%d", batchSlots,
+                     width, height);
+            FreeOfflineMemory();
+            return -1;
+        }
+    }
+    if (reportPlacement && output != stdout) {
+        ReportFramePlacement("frame slots", &offlineMemory[0], &workerPool,
+                             batchSlots);
+    }
+    if (batchSlots < workerCount) {
+        LogInfo("frame slots limited to %d per batch, %d workers are idle",
+                batchSlots, workerCount - batchSlots);
+    }
+
+    writer.output = output;
+    writer.name = name;
+    writer.failed = 0;
+    writer.rendered = SDL_CreateSemaphore(0);
+    writer.free = SDL_CreateSemaphore(OFFLINE_BATCHES);
+    SDL_Thread *thread = NULL;
+    if (writer.rendered != NULL && writer.free != NULL) {
+        thread = SDL_CreateThread(WriteOfflineBatches, "frame writer", &writer);
+    }
+    if (thread == NULL) {
+        LogError("failed to start the frame writer, %s", SDL_GetError());
+        SDL_DestroySemaphore(writer.free);
+        SDL_DestroySemaphore(writer.rendered);
+        FreeOfflineMemory();
+        return -1;
+    }
+
+    // Time spent waiting for the writer to free a batch, which is the part
+    // of the run bound by the output rather than by rendering.
+    double waitSecs = 0.0;
+    Uint64 startCounter = SDL_GetPerformanceCounter();
+    int b = 0;
+    for (int frame = firstFrame; frame < endFrame && !writer.failed;
+         frame += batchSlots) {
+        Uint64 waitCounter = SDL_GetPerformanceCounter();
+        SDL_SemWait(writer.free);
+        TraceEnd("batch wait", waitCounter);
+        waitSecs +=
+            GetElapsedTimeSecs(waitCounter, SDL_GetPerformanceCounter());
+
+        OfflineBatch *batch = &writer.batches[b % OFFLINE_BATCHES];
+        batch->firstFrame = frame;
+        batch->frameCount = endFrame - frame < batchSlots ? endFrame - frame
+                                                          : batchSlots;
+        RunWorkers(&workerPool, RenderOfflineBand, batch, batchSlots);
+        SDL_SemPost(writer.rendered);
+        b++;
+    }
+
+    // An empty batch stops the writer once it has written the others.
+    SDL_SemWait(writer.free);
+    writer.batches[b % OFFLINE_BATCHES].frameCount = 0;
+    SDL_SemPost(writer.rendered);
+    SDL_WaitThread(thread, NULL);
+    double secs = GetElapsedTimeSecs(startCounter, SDL_GetPerformanceCounter());
+    SDL_DestroySemaphore(writer.free);
+    SDL_DestroySemaphore(writer.rendered);
+    FreeOfflineMemory();
+
+    int result = writer.failed ? -1 : 0;
+    if (result == 0) {
+        int frames = endFrame - firstFrame;
+        char counters[256] = "";
+        if (perfEnabled && frames > 0 && palette == NULL) {
+            PerfSample sample;
+            TakePerfTotals(&drawCounters, &sample);
+            FormatPerfCounters(counters, sizeof(counters), &sample, frames,
+                               (double)framePixels);
+        }
+        LogInfo("rendered %d frames in %f s, %f frames/s, waited %f s on the "
+                "writer%s",
+                frames, secs, frames / secs, waitSecs, counters);
+    }
+
+    return result;
+}
+
+// Renders this shard's part of the frames from offlineStart to offlineEnd and
+// writes them, in order, as a stream of binary PPM images. The shards split
+// the range into consecutive runs of frames, so their outputs concatenated in
+// shard order make up the whole range.
+int RenderOffline(void) {
+    int totalFrames =
+        (int)((offlineEnd - offlineStart) * OFFLINE_FRAME_RATE + 0.5);
+    int firstFrame = (int)((long long)totalFrames * shardIndex / shardCount);
+    int endFrame =
+        (int)((long long)totalFrames * (shardIndex + 1) / shardCount);
+
+    FILE *output =
+        strcmp(offlinePath, "-") == 0 ? stdout : fopen(offlinePath, "wb");
+    if (output == NULL) {
+        LogError("failed to open %s for writing", offlinePath);
+        return -1;
+    }
+
+    LogInfo("rendering frames %d-%d of %d, shard %d/%d, at %dx%d", firstFrame,
+            endFrame - 1, totalFrames, shardIndex, shardCount, width, height);
+    int result = WriteFrames(output, offlinePath, NULL, offlineStart,
+                             1.0 / OFFLINE_FRAME_RATE, firstFrame, endFrame);
+
+    if (output == stdout) {
+        fflush(output);
+    } else if (fclose(output) != 0) {
+        LogError("failed to close %s", offlinePath);
+        result = -1;
+    }
+
+    return result;
+}
+
+void StripBand(void *data, int y0, int y1) {
+    const ImageStrip *strip = data;
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    evaluateStripRows(strip->data, strip, y0, y1);
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&drawCounters, &start, &end);
+    }
+}
+
+// Renders the single frame at offlineStart as a strip image, for frames too
+// large for the frame slots and radial table of RenderOffline.
+int RenderStripImage(void) {
+    double offsetX, offsetY;
+    GetCentreOffset(offlineStart, CENTRE_FREQUENCY, &offsetX, &offsetY);
+    StripJob job = {offlineStart, GetRadialShift(offsetX, width),
+                    GetRadialShift(offsetY, height)};
+
+    stripImage.width = width;
+    stripImage.height = height;
+    if (WriteStripImage(&stripImage, &workerPool, StripBand, &job,
+                        offlinePath) != 0) {
+        return -1;
+    }
+
+    if (perfEnabled) {
+        char counters[256];
+        PerfSample sample;
+        TakePerfTotals(&drawCounters, &sample);
+        FormatPerfCounters(counters, sizeof(counters), &sample, 1,
+                           (double)width * height);
+        LogInfo("strip image counters%s", counters);
+    }
+
+    return 0;
+}
+
+int GetLoopFrameCount(void) {
+    return (int)(LOOP_PERIOD * OFFLINE_FRAME_RATE + 0.5);
+}
+
+// Renders one whole loop into a loop cache. It is written under a temporary
+// name and renamed into place once complete, so an interrupted run never
+// leaves a truncated cache behind. A cache that could not stay in memory
+// while it plays, or that does not fit on the disk, is refused up front
+// rather than after rendering gigabytes of it.
+int CreateLoopCache(void) {
+    int frameCount = GetLoopFrameCount();
+    Uint64 size = GetLoopCacheFileSize(width, height, frameCount);
+    double sizeMB = size / (1024.0 * 1024.0);
+
+    long pageCount = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pageCount > 0 && pageSize > 0 &&
+        size > (Uint64)pageCount * (Uint64)pageSize) {
+        LogError("a %dx%d loop cache takes %.0f MB, more than the %.0f MB of "
+                 "memory it has to play from, use a smaller window",
+                 width, height, sizeMB,
+                 (double)pageCount * pageSize / (1024.0 * 1024.0));
+        return -1;
+    }
+
+    char tempPath[4096];
+    if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", loopPath) >=
+        (int)sizeof(tempPath)) {
+        LogError("loop cache path %s is too long", loopPath);
+        return -1;
+    }
+
+    FILE *output = fopen(tempPath, "wb");
+    if (output == NULL) {
+        LogError("failed to open %s for writing", tempPath);
+        return -1;
+    }
+
+    struct statvfs disk;
+    if (fstatvfs(fileno(output), &disk) == 0 &&
+        size > (Uint64)disk.f_bavail * disk.f_frsize) {
+        LogError("a %dx%d loop cache takes %.0f MB, more than the %.0f MB "
+                 "free for %s",
+                 width, height, sizeMB,
+                 (double)disk.f_bavail * disk.f_frsize / (1024.0 * 1024.0),
+                 tempPath);
+        fclose(output);
+        remove(tempPath);
+        return -1;
+    }
+
+    LoopCacheHeader header;
+    InitLoopCacheHeader(&header, width, height, frameCount);
+    for (int i = 0; i < LOOP_CACHE_PALETTE_SIZE; i++) {
+        header.palette[i] = ShadeValue(GetLoopIndexValue(i));
+    }
+
+    LogInfo("rendering %d frame loop cache at %dx%d to %s", frameCount, width,
+            height, loopPath);
+    int result = 0;
+    if (fwrite(&header, sizeof(header), 1, output) != 1) {
+        LogError("failed to write loop cache header to %s", tempPath);
+        result = -1;
+    } else {
+        loopSquaredError = 0;
+        loopErrorFrames = 0;
+        result = WriteFrames(output, tempPath, header.palette, 0.0,
+                             LOOP_PERIOD / frameCount, 0, frameCount);
+    }
+    if (result == 0 && loopErrorFrames > 0) {
+        double samples = (double)loopErrorFrames * width * height * 3;
+        double mse = loopSquaredError / samples;
+        LogInfo("loop cache takes %f MB, palette PSNR %f dB against the exact "
+                "frames over %d of them",
+                sizeMB,
+                mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY,
+                (int)loopErrorFrames);
+    }
+
+    if (fclose(output) != 0) {
+        LogError("failed to close %s", tempPath);
+        result = -1;
+    }
+    if (result == 0 && rename(tempPath, loopPath) != 0) {
+        LogError("failed to rename %s to %s", tempPath, loopPath);
+        result = -1;
+    }
+    if (result != 0) {
+        remove(tempPath);
+    }
+
+    return result;
+}
+
+// Maps the loop cache, rendering it first when it does not exist yet or was
+// rendered at another resolution.
+int OpenLoopCache(void) {
+    if (MapLoopCache(&loopCache, loopPath) == 0) {
+        if (loopCache.header->width == (Uint32)width &&
+            loopCache.header->height == (Uint32)height) {
+            LogInfo("playing %u frame loop cache %s",
+                    loopCache.header->frameCount, loopPath);
+            return 0;
+        }
+        LogInfo("loop cache %s is %ux%u, rendering it again at %dx%d",
+                loopPath, loopCache.header->width, loopCache.header->height,
+                width, height);
+        UnmapLoopCache(&loopCache);
+    }
+
+    if (CreateLoopCache() != 0) {
+        return -1;
+    }
+    if (MapLoopCache(&loopCache, loopPath) != 0) {
+        LogError("failed to map loop cache %s", loopPath);
+        return -1;
+    }
+    LogInfo("playing %u frame loop cache %s", loopCache.header->frameCount,
+            loopPath);
+
+    return 0;
+}
+
+void ExpandLoopBand(void *data, int y0, int y1) {
+    const Uint8 *indices = data;
+    const Uint32 *palette = loopCache.header->palette;
+
+    for (int i = y0 * width; i < y1 * width; i++) {
+        pixelBuffer[i] = palette[indices[i]];
+    }
+}
+
+void DrawLoopFrame(int frame) {
+    const Uint8 *indices =
+        GetLoopCacheFrame(&loopCache, frame % loopCache.header->frameCount);
+    RunWorkers(&workerPool, ExpandLoopBand, (void *)indices, height);
+}
+
+// Makes the radial table for a resolution current, building it the first
+// time the resolution comes up and evicting the least recently used table
+// when the cache is full.
+int SelectRadialTable(int newWidth, int newHeight) {
+    RadialCacheEntry *entry = NULL;
+    for (int i = 0; i < RADIAL_CACHE_ENTRIES && entry == NULL; i++) {
+        if (radialCache[i].table != NULL && radialCache[i].width == newWidth &&
+            radialCache[i].height == newHeight) {
+            entry = &radialCache[i];
+        }
+    }
+
+    width = newWidth;
+    height = newHeight;
+    if (entry == NULL) {
+        entry = &radialCache[0];
+        for (int i = 1; i < RADIAL_CACHE_ENTRIES; i++) {
+            if (radialCache[i].lastUsed < entry->lastUsed) {
+                entry = &radialCache[i];
+            }
+        }
+
+        FreeFrameMemory(&entry->memory);
+        entry->table = NULL;
+        if (CreateRadialTable(&entry->memory) != 0) {
+            return -1;
+        }
+        entry->table = radialTable;
+        entry->width = newWidth;
+        entry->height = newHeight;
+        LogInfo("built radial table for %dx%d", newWidth, newHeight);
+    }
+
+    entry->lastUsed = ++radialCacheClock;
+    radialTable = entry->table;
+    radialTableWidth = newWidth * 2;
+    radialTableHeight = newHeight * 2;
+
+    return 0;
+}
+
+FrameJob CreateRequestJob(Uint32 *target, const RenderRequest *request) {
+    double frequency = request->variant == PLASMA_VARIANT_LOOP
+                           ? LOOP_CENTRE_FREQUENCY
+                           : CENTRE_FREQUENCY;
+    FrameJob job = {target,
+                    request->time,
+                    -1,
+                    request->variant == PLASMA_VARIANT_MOUSE,
+                    GetCentreWindow(request->time, frequency),
+                    GetMouseWindow(request->mouseX, request->mouseY),
+                    NULL};
+    return job;
+}
+
+int CompareValues(double lhs, double rhs) {
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// Orders requests by resolution first and then by everything else the frame
+// depends on, so requests for the same frame end up next to each other.
+int CompareRequests(const void *a, const void *b) {
+    const RenderRequest *lhs = &((const PendingRequest *)a)->request;
+    const RenderRequest *rhs = &((const PendingRequest *)b)->request;
+    const double lhsKeys[] = {lhs->width, lhs->height, lhs->variant,
+                              lhs->time,  lhs->mouseX, lhs->mouseY};
+    const double rhsKeys[] = {rhs->width, rhs->height, rhs->variant,
+                              rhs->time,  rhs->mouseX, rhs->mouseY};
+
+    for (size_t i = 0; i < sizeof(lhsKeys) / sizeof(lhsKeys[0]); i++) {
+        int order = CompareValues(lhsKeys[i], rhsKeys[i]);
+        if (order != 0) {
+            return order;
+        }
+    }
+
+    return 0;
+}
+
+int CreateDaemonSocket(void) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(daemonPath) >= sizeof(address.sun_path)) {
+        LogError("socket path %s is too long", daemonPath);
+        return -1;
+    }
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", daemonPath);
+
+    daemonListener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (daemonListener < 0) {
+        LogError("failed to create socket, %s", strerror(errno));
+        return -1;
+    }
+
+    // A socket left behind by a daemon that did not exit cleanly would make
+    // the bind fail.
+    unlink(daemonPath);
+    if (bind(daemonListener, (struct sockaddr *)&address, sizeof(address)) !=
+            0 ||
+        listen(daemonListener, MAX_DAEMON_CLIENTS) != 0) {
+        LogError("failed to listen on %s, %s", daemonPath, strerror(errno));
+        return -1;
+    }
+    fcntl(daemonListener, F_SETFL, O_NONBLOCK);
+
+    return 0;
+}
+
+void AcceptDaemonClients(void) {
+    int fd;
+    while ((fd = accept(daemonListener, NULL, NULL)) >= 0) {
+        DaemonClient *client = NULL;
+        for (int i = 0; i < MAX_DAEMON_CLIENTS && client == NULL; i++) {
+            if (daemonClients[i].fd < 0) {
+                client = &daemonClients[i];
+            }
+        }
+        if (client == NULL) {
+            LogError("refusing client, %d clients are connected",
+                     MAX_DAEMON_CLIENTS);
+            close(fd);
+            continue;
+        }
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        client->number = ++daemonClientNumber;
+        client->connectedNs = GetShmRingClockNs();
+        LogInfo("client %d connected", client->number);
+    }
+}
 
-int width = DEFAULT_WIDTH;
-int height = DEFAULT_HEIGHT;
-int scale = DEFAULT_SCALE;
-int fullscreen = 0;
-int interactive = 0;
+double GetAverageLatencyMs(const RenderClientStats *stats) {
+    return stats->frames ? stats->latencyMsSum / stats->frames : 0.0;
+}
 
-double mouseX = -0.5;
-double mouseY = -0.5;
+void CloseDaemonClient(DaemonClient *client) {
+    const RenderClientStats *stats = &client->stats;
+    LogInfo("client %d disconnected after %llu requests, %llu frames, %llu "
+            "shared, %llu errors, latency %f ms avg %f ms max",
+            client->number, (unsigned long long)stats->requests,
+            (unsigned long long)stats->frames,
+            (unsigned long long)stats->sharedFrames,
+            (unsigned long long)stats->errors, GetAverageLatencyMs(stats),
+            stats->latencyMsMax);
 
-double Max(double value, double max) {
-    return value < max ? value : max;
+    DestroyShmRing(&client->ring);
+    close(client->fd);
+    client->fd = -1;
 }
 
-int Get1DArrayIndex(int x, int y, int width) {
-    return (y * width) + x;
+// Every reply carries the client's counters. Replies are small, so a client
+// only fills up its socket by not reading them at all, and is dropped then
+// rather than sent a partial reply.
+void SendDaemonReply(DaemonClient *client, Uint64 id, RenderStatus status,
+                     Uint64 frame, double latencyMs) {
+    RenderReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = RENDER_DAEMON_MAGIC;
+    reply.status = status;
+    reply.id = id;
+    reply.frame = frame;
+    reply.latencyMs = latencyMs;
+    reply.stats = client->stats;
+    reply.stats.connectedSecs =
+        (GetShmRingClockNs() - client->connectedNs) / 1e9;
+
+    if (send(client->fd, &reply, sizeof(reply), 0) != (ssize_t)sizeof(reply)) {
+        CloseDaemonClient(client);
+    }
 }
 
-Uint32 RGBToUint32(Uint8 r, Uint8 g, Uint8 b) {
-    return (Uint32)((r << 16) + (g << 8) + b);
+void RejectRequest(DaemonClient *client, Uint64 id, RenderStatus status) {
+    client->stats.errors++;
+    SendDaemonReply(client, id, status, 0, 0.0);
 }
 
-double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
-    return (double)(end - start) / SDL_GetPerformanceFrequency();
+int AttachClientRing(DaemonClient *client, const char *name) {
+    if (client->ring.data != NULL && strcmp(client->ring.name, name) == 0 &&
+        !IsShmRingClosed(&client->ring)) {
+        return 0;
+    }
+
+    DestroyShmRing(&client->ring);
+    if (AttachShmRing(&client->ring, name) != 0) {
+        LogError("client %d: failed to attach shm ring %s", client->number,
+                 name);
+        return -1;
+    }
+    LogInfo("client %d: publishing to shm ring %s, %ux%u", client->number,
+            name, client->ring.width, client->ring.height);
+
+    return 0;
 }
 
-double GetElapsedTimeMs(Uint64 start, Uint64 end) {
-    return (double)((end - start) * 1000.0) / SDL_GetPerformanceFrequency();
+// Stats requests are answered right away. Frame requests are checked and
+// queued for the next batch.
+void HandleRequest(DaemonClient *client, const RenderRequest *request) {
+    if (request->magic != RENDER_DAEMON_MAGIC) {
+        LogError("client %d: not a render request", client->number);
+        CloseDaemonClient(client);
+        return;
+    }
+
+    client->stats.requests++;
+    if (request->kind == RENDER_REQUEST_STATS) {
+        SendDaemonReply(client, request->id, RENDER_STATUS_OK, 0, 0.0);
+        return;
+    }
+    if (request->kind != RENDER_REQUEST_FRAME || request->width == 0 ||
+        request->width > MAX_RENDER_DAEMON_SIZE || request->height == 0 ||
+        request->height > MAX_RENDER_DAEMON_SIZE ||
+        request->variant >= PLASMA_VARIANT_COUNT ||
+        memchr(request->ring, '\0', sizeof(request->ring)) == NULL) {
+        RejectRequest(client, request->id, RENDER_STATUS_BAD_REQUEST);
+        return;
+    }
+    if (AttachClientRing(client, request->ring) != 0 ||
+        request->width > client->ring.width ||
+        request->height > client->ring.height) {
+        RejectRequest(client, request->id, RENDER_STATUS_BAD_RING);
+        return;
+    }
+
+    PendingRequest *pending = &pendingRequests[pendingRequestCount++];
+    pending->client = client;
+    pending->request = *request;
+    pending->receivedNs = GetShmRingClockNs();
+    // Only the mouse variant depends on the mouse, so the others can share a
+    // frame whatever mouse position they were sent with.
+    if (request->variant != PLASMA_VARIANT_MOUSE) {
+        pending->request.mouseX = 0.0;
+        pending->request.mouseY = 0.0;
+    }
 }
 
-int GetDisplayRefreshRate(SDL_DisplayMode displayMode) {
-    int result = displayMode.refresh_rate;
+// Reads as much as the client has sent, but stops once the batch is full and
+// leaves the rest in the socket for the next one.
+void ReadDaemonClient(DaemonClient *client) {
+    while (client->fd >= 0 && pendingRequestCount < MAX_DAEMON_REQUESTS) {
+        ssize_t received =
+            recv(client->fd, client->buffer + client->filled,
+                 sizeof(client->buffer) - client->filled, 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received <= 0) {
+            CloseDaemonClient(client);
+            return;
+        }
 
-    if (result == 0) {
-        return DEFAULT_REFRESH_RATE;
+        client->filled += received;
+        if (client->filled == sizeof(client->buffer)) {
+            RenderRequest request;
+            memcpy(&request, client->buffer, sizeof(request));
+            client->filled = 0;
+            HandleRequest(client, &request);
+        }
     }
+}
 
-    return result;
+void RenderDaemonBand(void *data, int s0, int s1) {
+    DaemonBatch *batch = data;
+
+    for (int s = s0; s < s1; s++) {
+        RunCountedRows(evaluateRows, &batch->jobs[s], 0, height);
+    }
 }
 
-int InitSDL(void) {
-    SDL_Init(SDL_INIT_VIDEO);
+// Renders the queued requests [first, end), which share a resolution, and
+// publishes every frame to the rings of the requests that asked for it.
+void RenderResolution(int first, int end) {
+    const RenderRequest *request = &pendingRequests[first].request;
+    DaemonBatch *batch = &daemonBatch;
+    size_t frameBytes = (size_t)request->width * request->height *
+                        sizeof(Uint32);
 
-    if (SDL_GetDesktopDisplayMode(0, &displayMode) != 0) {
-        return -1;
+    batch->count = 0;
+    for (int i = first; i < end; i++) {
+        if (i == first ||
+            CompareRequests(&pendingRequests[i - 1], &pendingRequests[i]) !=
+                0) {
+            batch->count++;
+        }
+        pendingRequests[i].frame = batch->count - 1;
     }
 
-    window = SDL_CreateWindow(
-        WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        width * scale, height * scale, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-    if (window == NULL) {
-        return -1;
+    int ready = SelectRadialTable(request->width, request->height) == 0;
+    if (ready && (daemonMemory.data == NULL ||
+                  daemonMemory.size < frameBytes * batch->count)) {
+        FreeFrameMemory(&daemonMemory);
+        ready = AllocFrameMemory(&daemonMemory, &workerPool, frameBytes,
+                                 batch->count) != NULL;
+    }
+    if (!ready) {
+        LogError("failed to render %d frames at %dx%d", batch->count, width,
+                 height);
+        for (int i = first; i < end; i++) {
+            if (pendingRequests[i].client->fd >= 0) {
+                RejectRequest(pendingRequests[i].client,
+                              pendingRequests[i].request.id,
+                              RENDER_STATUS_FAILED);
+            }
+        }
+        return;
     }
-    LogInfo("window created with size %dx%d", width, height);
 
-    if (fullscreen) {
-        SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
+    for (int i = first; i < end; i++) {
+        int frame = pendingRequests[i].frame;
+        Uint32 *target =
+            (Uint32 *)((unsigned char *)daemonMemory.data + frame * frameBytes);
+        batch->jobs[frame] =
+            CreateRequestJob(target, &pendingRequests[i].request);
     }
 
-    if (!interactive) {
-        SDL_ShowCursor(SDL_DISABLE);
+    // Small displays make for small frames. Once there are enough of them
+    // each worker renders whole frames, the way offline rendering does,
+    // rather than a band of every frame.
+    if (batch->count >= workerCount) {
+        RunWorkers(&workerPool, RenderDaemonBand, batch, batch->count);
+    } else {
+        for (int s = 0; s < batch->count; s++) {
+            RunWorkers(&workerPool, EvaluateBand, &batch->jobs[s], height);
+        }
     }
 
-    renderer = SDL_CreateRenderer(
-        window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (renderer == NULL) {
-        return -1;
+    for (int i = first; i < end; i++) {
+        PendingRequest *pending = &pendingRequests[i];
+        DaemonClient *client = pending->client;
+        if (client->fd < 0) {
+            continue;
+        }
+
+        // The client may have shrunk its ring since attaching. It is dropped
+        // then, failing the client's other requests in the batch, and
+        // attached afresh by its next request.
+        if (client->ring.data != NULL &&
+            PublishShmRingFrame(&client->ring,
+                                batch->jobs[pending->frame].target, width,
+                                height, pending->request.time) != 0) {
+            LogError("client %d: shm ring %s shrank", client->number,
+                     client->ring.name);
+            DestroyShmRing(&client->ring);
+        }
+        if (client->ring.data == NULL) {
+            RejectRequest(client, pending->request.id, RENDER_STATUS_BAD_RING);
+            continue;
+        }
+        Uint64 frame = atomic_load(&client->ring.header->published) - 1;
+        double latencyMs = (GetShmRingClockNs() - pending->receivedNs) / 1e6;
+
+        RenderClientStats *stats = &client->stats;
+        stats->frames++;
+        if ((i > first && pending[-1].frame == pending->frame) ||
+            (i + 1 < end && pending[1].frame == pending->frame)) {
+            stats->sharedFrames++;
+        }
+        stats->latencyMsSum += latencyMs;
+        if (latencyMs > stats->latencyMsMax) {
+            stats->latencyMsMax = latencyMs;
+        }
+        SendDaemonReply(client, pending->request.id, RENDER_STATUS_OK, frame,
+                        latencyMs);
     }
-    LogInfo("renderer created with logical size %dx%d", width, height);
+}
 
-    SDL_RenderSetLogicalSize(renderer, width, height);
+void RenderPendingRequests(void) {
+    qsort(pendingRequests, pendingRequestCount, sizeof(*pendingRequests),
+          CompareRequests);
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888,
-                                SDL_TEXTUREACCESS_STREAMING, width, height);
-    if (texture == NULL) {
-        return -1;
+    int first = 0;
+    while (first < pendingRequestCount) {
+        const RenderRequest *request = &pendingRequests[first].request;
+        int end = first + 1;
+        while (end < pendingRequestCount &&
+               pendingRequests[end].request.width == request->width &&
+               pendingRequests[end].request.height == request->height) {
+            end++;
+        }
+
+        RenderResolution(first, end);
+        first = end;
     }
 
-    return 0;
+    pendingRequestCount = 0;
 }
 
-void DrawFrame(double elapsedTimeInSecs) {
-    double t = elapsedTimeInSecs;
-
-    for (int yi = 0; yi < height; yi++) {
-        double y = (0.5 + yi / (double)height - 1.0) * PLASMA_SCALE -
-                   PLASMA_SCALE_HALF;
-
-        for (int xi = 0; xi < width; xi++) {
-            double x = (0.5 + xi / (double)width - 1.0) * PLASMA_SCALE -
-                       PLASMA_SCALE_HALF;
-
-            double val = sin(y + t);
-            val += sin((x + t) * 0.5);
-            val += sin((x + y + t) * 0.5);
-            double cx = x + PLASMA_SCALE_HALF * (sin(t * 0.33));
-            double cy = y + PLASMA_SCALE_HALF * (cos(t * 0.5));
-            val += sin(sqrt(cx * cx + cy * cy + 1.0) + t);
-            val *= 0.5;
-
-            double r, g, b;
-            if (interactive) {
-                double dist = sqrt((x - mouseX) * (x - mouseX) +
-                                   (y - mouseY) * (y - mouseY));
-                r = sin((val + sin(dist * 2 + t)) * PI) * 0.5 + 0.5;
-                g = sin(val * PI + 2.0 * PI * 0.33) * 0.5 + 0.5;
-                b = sin((val + cos(dist + t * 0.33)) * PI + 4.0 * PI * 0.33) *
-                        0.5 +
-                    0.5;
-            } else {
-                r = sin(val * PI) * 0.5 + 0.5;
-                g = sin(val * PI + 2.0 * PI * 0.33) * 0.5 + 0.5;
-                b = sin(val * PI + 4.0 * PI * 0.33) * 0.5 + 0.5;
+// Logs the frame rate and latency of every client served since the last
+// report.
+void ReportDaemonClients(double secs) {
+    for (int i = 0; i < MAX_DAEMON_CLIENTS; i++) {
+        DaemonClient *client = &daemonClients[i];
+        if (client->fd < 0 || client->stats.frames == client->reportFrames) {
+            continue;
+        }
+
+        Uint64 frames = client->stats.frames - client->reportFrames;
+        double latencyMsSum =
+            client->stats.latencyMsSum - client->reportLatencyMsSum;
+        LogInfo("client %d: %f frames/s, latency %f ms avg, %llu shared, "
+                "%llu errors",
+                client->number, frames / secs, latencyMsSum / frames,
+                (unsigned long long)client->stats.sharedFrames,
+                (unsigned long long)client->stats.errors);
+
+        client->reportFrames = client->stats.frames;
+        client->reportLatencyMsSum = client->stats.latencyMsSum;
+    }
+}
+
+void StopDaemon(int signal) {
+    (void)signal;
+    daemonRunning = 0;
+}
+
+// Serves render requests until interrupted. Every pass through the loop
+// takes all the requests that arrived since the last one as a batch.
+int RunDaemon(void) {
+    for (int i = 0; i < MAX_DAEMON_CLIENTS; i++) {
+        daemonClients[i].fd = -1;
+    }
+    if (CreateDaemonSocket() != 0) {
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, StopDaemon);
+    signal(SIGTERM, StopDaemon);
+    LogInfo("listening for render requests on %s", daemonPath);
+
+    Uint64 reportNs = GetShmRingClockNs();
+    while (daemonRunning) {
+        struct pollfd fds[MAX_DAEMON_CLIENTS + 1];
+        DaemonClient *polled[MAX_DAEMON_CLIENTS + 1];
+        int count = 0;
+
+        fds[count].fd = daemonListener;
+        fds[count].events = POLLIN;
+        polled[count++] = NULL;
+        for (int i = 0; i < MAX_DAEMON_CLIENTS; i++) {
+            if (daemonClients[i].fd >= 0) {
+                fds[count].fd = daemonClients[i].fd;
+                fds[count].events = POLLIN;
+                polled[count++] = &daemonClients[i];
+            }
+        }
+
+        Uint64 traceStart = TraceBegin();
+        int ready = poll(fds, count, DAEMON_REPORT_INTERVAL_MS);
+        TraceEnd("poll requests", traceStart);
+        if (ready < 0 && errno != EINTR) {
+            LogError("failed to poll the socket, %s", strerror(errno));
+            return -1;
+        }
+
+        // New clients are only accepted before any request is queued, so a
+        // slot freed by a client dropped in this pass is not reused while
+        // its requests are still in the batch.
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            AcceptDaemonClients();
+        }
+        for (int i = 1; ready > 0 && i < count; i++) {
+            if (fds[i].revents != 0) {
+                ReadDaemonClient(polled[i]);
             }
+        }
+
+        if (pendingRequestCount > 0) {
+            traceStart = TraceBegin();
+            RenderPendingRequests();
+            TraceEnd("render batch", traceStart);
+        }
 
-            Uint8 ri = (Uint8)Max(r * 255, 255);
-            Uint8 gi = (Uint8)Max(g * 255, 255);
-            Uint8 bi = (Uint8)Max(b * 255, 255);
+        Uint64 now = GetShmRingClockNs();
+        if (now - reportNs >= DAEMON_REPORT_INTERVAL_MS * 1000000ull) {
+            ReportDaemonClients((now - reportNs) / 1e9);
+            reportNs = now;
+        }
+    }
+    LogInfo("stopped serving render requests");
+
+    return 0;
+}
 
-            pixelBuffer[Get1DArrayIndex(xi, yi, width)] =
-                RGBToUint32(ri, gi, bi);
+void DestroyDaemon(void) {
+    for (int i = 0; i < MAX_DAEMON_CLIENTS; i++) {
+        if (daemonClients[i].fd >= 0) {
+            CloseDaemonClient(&daemonClients[i]);
         }
     }
+    if (daemonListener >= 0) {
+        close(daemonListener);
+        unlink(daemonPath);
+        daemonListener = -1;
+    }
+
+    for (int i = 0; i < RADIAL_CACHE_ENTRIES; i++) {
+        FreeFrameMemory(&radialCache[i].memory);
+        radialCache[i].table = NULL;
+    }
+    FreeFrameMemory(&daemonMemory);
+    radialTable = NULL;
+}
+
+void SaveTrace(void) {
+    if (WriteTrace(tracePath) != 0) {
+        LogError("failed to write trace to %s", tracePath);
+    } else {
+        LogInfo("wrote trace to %s", tracePath);
+    }
 }
 
 void DestroySDL(void) {
@@ -156,7 +2347,9 @@ void DestroySDL(void) {
 
 int main(int argc, char *argv[]) {
     char opt;
-    while ((opt = getopt(argc, argv, ":w:h:s:fi")) != -1) {
+    while ((opt = getopt(argc, argv,
+                         ":w:h:s:fic:g:k:j:Npt:o:r:x:l:m:d:a:u:b:v:B:JR:S:")) !=
+           -1) {
         switch (opt) {
         case 'w':
             // Obviously not proper use of strtol, but, thats fine
@@ -187,7 +2380,274 @@ int main(int argc, char *argv[]) {
         case 'i':
             interactive = 1;
             break;
+        case 'c':
+            if (strcmp(optarg, "checker") == 0) {
+                halfRateMode = HALF_RATE_CHECKER;
+            } else if (strcmp(optarg, "interlace") == 0) {
+                halfRateMode = HALF_RATE_INTERLACE;
+            } else {
+                fprintf(stderr, "invalid value for half rate mode: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'g':
+            governorMargin = strtol(optarg, (char **)NULL, 10);
+            if (governorMargin < 0 || governorMargin >= 100) {
+                fprintf(stderr, "invalid value for governor margin: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            governorEnabled = 1;
+            break;
+        case 'k':
+            if (ParseKernel(optarg, &kernel) != 0) {
+                fprintf(stderr, "invalid value for kernel: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            kernelOverridden = 1;
+            break;
+        case 'j':
+            workerCount = strtol(optarg, (char **)NULL, 10);
+            if (workerCount <= 0 || workerCount > MAX_WORKERS) {
+                fprintf(stderr, "invalid value for workers: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'N':
+            reportPlacement = 1;
+            break;
+        case 'p':
+            perfEnabled = 1;
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        case 'J':
+            jitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &realtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            jitter.enabled = 1;
+            break;
+        case 'o':
+            offlinePath = optarg;
+            break;
+        case 'S':
+            if (ParseStripRows(optarg, &stripImage) != 0) {
+                fprintf(stderr, "invalid value for strip rows: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            if (sscanf(optarg, "%lf:%lf", &offlineStart, &offlineEnd) != 2 ||
+                offlineEnd <= offlineStart) {
+                fprintf(stderr, "invalid value for time range: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'x':
+            if (sscanf(optarg, "%d/%d", &shardIndex, &shardCount) != 2 ||
+                shardCount <= 0 || shardIndex < 0 ||
+                shardIndex >= shardCount) {
+                fprintf(stderr, "invalid value for shard: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'l':
+            loopPath = optarg;
+            break;
+        case 'm':
+            if (ParseShmRingOption(optarg, shmRingName, sizeof(shmRingName),
+                                   &shmRingSlots) != 0) {
+                fprintf(stderr, "invalid value for shm ring: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            daemonPath = optarg;
+            break;
+        case 'a':
+            adaptiveThreshold = strtol(optarg, (char **)NULL, 10);
+            if (adaptiveThreshold < 0 || adaptiveThreshold > 255) {
+                fprintf(stderr, "invalid value for adaptive threshold: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'u':
+            upsampleFactor = strtol(optarg, (char **)NULL, 10);
+            if (upsampleFactor < 2 || upsampleFactor > MAX_UPSAMPLE_FACTOR) {
+                fprintf(stderr, "invalid value for upsample factor: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            outputDepth = strtol(optarg, (char **)NULL, 10);
+            if (outputDepth != OUTPUT_DEPTH_32 &&
+                outputDepth != OUTPUT_DEPTH_16) {
+                fprintf(stderr, "invalid value for output depth: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'B':
+            if (ParseBenchmarkFrames(optarg, &benchmark) != 0) {
+                fprintf(stderr, "invalid value for benchmark frames: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            plasmaFormula = FindPlasmaFormula(plasmaFormulas,
+                                              PLASMA_FORMULA_COUNT, optarg);
+            if (plasmaFormula == NULL) {
+                fprintf(stderr, "invalid value for formula: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+
+    if (loopPath != NULL && (interactive || governorEnabled ||
+                             halfRateMode != HALF_RATE_OFF || offlinePath)) {
+        fprintf(stderr, "a loop cache can not be combined with -i, -g, -c "
+                        "or -o\n");
+        return EXIT_FAILURE;
+    }
+
+    if (adaptiveThreshold >= 0 && (halfRateMode != HALF_RATE_OFF ||
+                                   offlinePath || loopPath || daemonPath)) {
+        fprintf(stderr, "adaptive sampling can not be combined with -c, -o, "
+                        "-l or -d\n");
+        return EXIT_FAILURE;
+    }
+
+    if (upsampleFactor > 0 &&
+        (interactive || halfRateMode != HALF_RATE_OFF ||
+         adaptiveThreshold >= 0 || offlinePath || loopPath || daemonPath)) {
+        fprintf(stderr, "upsampling can not be combined with -i, -c, -a, -o, "
+                        "-l or -d\n");
+        return EXIT_FAILURE;
+    }
+
+    if (outputDepth == OUTPUT_DEPTH_16 &&
+        (halfRateMode != HALF_RATE_OFF || adaptiveThreshold >= 0 ||
+         upsampleFactor > 0 || offlinePath || loopPath || daemonPath ||
+         shmRingName[0] != '\0')) {
+        fprintf(stderr, "16 bit output can not be combined with -c, -a, -u, "
+                        "-o, -l, -d or -m\n");
+        return EXIT_FAILURE;
+    }
+
+    if (plasmaFormula != NULL &&
+        (interactive || halfRateMode != HALF_RATE_OFF ||
+         adaptiveThreshold >= 0 || upsampleFactor > 0 ||
+         outputDepth == OUTPUT_DEPTH_16 || offlinePath || loopPath ||
+         daemonPath)) {
+        fprintf(stderr, "a formula can not be combined with -i, -c, -a, -u, "
+                        "-b 16, -o, -l or -d\n");
+        return EXIT_FAILURE;
+    }
+
+    if (daemonPath != NULL &&
+        (interactive || governorEnabled || halfRateMode != HALF_RATE_OFF ||
+         offlinePath || loopPath || shmRingName[0] != '\0')) {
+        fprintf(stderr, "daemon mode can not be combined with -i, -g, -c, "
+                        "-o, -l or -m\n");
+        return EXIT_FAILURE;
+    }
+
+    if (stripImage.rows > 0 &&
+        (offlinePath == NULL || interactive || shardCount > 1)) {
+        fprintf(stderr, "a strip image needs -o and can not be combined with "
+                        "-i or -x\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&realtime);
+
+    baseWidth = width;
+    baseHeight = height;
+    if (ChooseWorkerCount(&realtime, &workerCount, MAX_WORKERS) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (perfEnabled && ProbePerfCounters() != 0) {
+        perfEnabled = 0;
+    }
+
+    if (!kernelOverridden) {
+        kernel = DetectKernel();
+    } else if (!IsKernelSupported(kernel)) {
+        fprintf(stderr, "kernel %s is not supported on this cpu\n",
+                GetKernelName(kernel));
+        return EXIT_FAILURE;
+    }
+    evaluateRows = EvaluateRowsVariants[kernel];
+    evaluateRows16 = EvaluateRows16Variants[kernel];
+    reconstructRows = ReconstructRowsVariants[kernel];
+    adaptiveRows = AdaptiveRowsVariants[kernel];
+    blendRows = BlendRowsVariants[kernel];
+    evaluateIndexRows = EvaluateIndexRowsVariants[kernel];
+    evaluateStripRows = EvaluateStripRowsVariants[kernel];
+    LogInfo("using %s kernels", GetKernelName(kernel));
+    if (plasmaFormula != NULL) {
+        formulaRows = plasmaFormula->rows[kernel];
+        LogInfo("drawing the generated %s formula", plasmaFormula->name);
+    }
+
+    // Offline rendering needs neither a window nor the per frame buffers,
+    // only the workers and the radial table, which a strip image does
+    // without.
+    if (offlinePath != NULL) {
+        int result = -1;
+        if (CreateWorkerPool(&workerPool, workerCount) != 0) {
+            LogError("failed to create %d workers, %s", workerCount,
+                     SDL_GetError());
+        } else if (stripImage.rows > 0) {
+            result = RenderStripImage();
+        } else if (CreateRadialTable(&radialMemory) == 0) {
+            result = RenderOffline();
+        }
+
+        DestroyFrameBuffers();
+        DestroyWorkerPool(&workerPool);
+        if (tracePath != NULL) {
+            SaveTrace();
+        }
+
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // The daemon renders at whatever resolution its clients ask for, into
+    // their own rings, so it needs no window either.
+    if (daemonPath != NULL) {
+        int result = -1;
+        if (CreateWorkerPool(&workerPool, workerCount) != 0) {
+            LogError("failed to create %d workers, %s", workerCount,
+                     SDL_GetError());
+        } else {
+            LogInfo("rendering with %d workers", workerCount);
+            result = RunDaemon();
+        }
+
+        DestroyDaemon();
+        DestroyWorkerPool(&workerPool);
+        if (tracePath != NULL) {
+            SaveTrace();
         }
+
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     if (InitSDL() != 0) {
@@ -199,57 +2659,135 @@ int main(int argc, char *argv[]) {
     const double targetSecsPerFrame = 1.0 / (double)refreshRate;
     LogInfo("display refresh rate %d, target secs per frame %f", refreshRate,
             targetSecsPerFrame);
+    if (upsampleFactor > 0) {
+        upsampleInterval = upsampleFactor * targetSecsPerFrame;
+        LogInfo("evaluating key frames at %f Hz, upsampled %dx",
+                (double)refreshRate / upsampleFactor, upsampleFactor);
+    }
+
+    if (CreateWorkerPool(&workerPool, workerCount) != 0) {
+        LogError("failed to create %d workers, %s", workerCount,
+                 SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    LogInfo("rendering with %d workers", workerCount);
 
-    pixelBuffer = calloc(width * height, sizeof(*pixelBuffer));
-    if (pixelBuffer == NULL) {
-        LogError("failed to calloc pixel buffer %dx%d", width, height);
+    if (CreateFrameBuffers() != 0) {
+        return EXIT_FAILURE;
+    }
+    if (reportPlacement) {
+        ReportPlacement();
+    }
+    if (loopPath != NULL && OpenLoopCache() != 0) {
         return EXIT_FAILURE;
     }
+    // The governor only ever lowers the resolution, so a ring sized for the
+    // base resolution fits every frame.
+    if (shmRingName[0] != '\0') {
+        if (CreateShmRing(&shmRing, shmRingName, shmRingSlots, baseWidth,
+                          baseHeight) != 0) {
+            LogError("failed to create shm ring %s", shmRingName);
+            return EXIT_FAILURE;
+        }
+        LogInfo("publishing frames to shm ring %s with %d slots", shmRingName,
+                shmRingSlots);
+    }
 
     double elapsedTimeMs = 0.0;
     Uint64 lastCounter = SDL_GetPerformanceCounter();
     Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
+    int metricsFrames = 0;
     SDL_Event event;
     int isRunning = 1;
+    StartJitterHistogram(&jitter, targetSecsPerFrame);
+    LockRealtimeMemory(&realtime);
+    StartBenchmark(&benchmark);
 
     while (isRunning) {
-        SDL_PollEvent(&event);
-        switch (event.type) {
-        case SDL_QUIT:
-            isRunning = 0;
-            break;
-        case SDL_KEYDOWN:
-            if (event.key.keysym.sym == SDLK_ESCAPE) {
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
                 isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
+            case SDL_MOUSEMOTION:
+                if (interactive && pendingInputCount < MAX_PENDING_INPUTS) {
+                    pendingInputTicks[pendingInputCount++] =
+                        event.motion.timestamp;
+                }
+                break;
             }
-            break;
-        case SDL_MOUSEMOTION: {
+        }
+        TraceEnd("poll events", traceStart);
+
+        // Sample the mouse once, after all pending motion has been drained,
+        // so the frame reflects the newest position.
+        if (interactive) {
             int x, y;
             SDL_GetMouseState(&x, &y);
             mouseX = 0.5 + x / (double)width - 1.0;
             mouseY = 0.5 + y / (double)height - 1.0;
-            break;
-        }
         }
 
         elapsedTimeMs += targetSecsPerFrame;
 
-        DrawFrame(elapsedTimeMs);
+        Uint64 drawStartCounter = SDL_GetPerformanceCounter();
+        if (loopPath != NULL) {
+            DrawLoopFrame((int)(elapsedTimeMs * OFFLINE_FRAME_RATE + 0.5));
+        } else {
+            DrawFrame(elapsedTimeMs);
+        }
+        TraceEnd("DrawFrame", drawStartCounter);
+        double drawMs =
+            GetElapsedTimeMs(drawStartCounter, SDL_GetPerformanceCounter());
+        metricsFrames++;
+
+        if (shmRing.header != NULL) {
+            traceStart = TraceBegin();
+            PublishShmRingFrame(&shmRing, pixelBuffer, width, height,
+                                elapsedTimeMs);
+            TraceEnd("shm publish", traceStart);
+        }
 
-        // Manually cap the frame rate
-        while (GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) <
-               targetSecsPerFrame) {
+        // Manually cap the frame rate, unless benchmarking
+        traceStart = TraceBegin();
+        if (benchmark.frames == 0) {
+            SleepUntilFrameTime(&realtime, lastCounter, targetSecsPerFrame);
+            while (GetElapsedTimeSecs(lastCounter,
+                                      SDL_GetPerformanceCounter()) <
+                   targetSecsPerFrame) {
+            }
+            assert(GetElapsedTimeSecs(lastCounter,
+                                      SDL_GetPerformanceCounter()) >=
+                   targetSecsPerFrame);
         }
-        assert(GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) >=
-               targetSecsPerFrame);
 
         Uint64 endCounter = SDL_GetPerformanceCounter();
+        TraceEnd("pacing wait", traceStart);
 
-        SDL_UpdateTexture(texture, NULL, pixelBuffer,
-                          width * sizeof(*pixelBuffer));
+        traceStart = TraceBegin();
+        Uint64 uploadCounter = SDL_GetPerformanceCounter();
+        SDL_UpdateTexture(texture, NULL,
+                          outputDepth == OUTPUT_DEPTH_16 ? (void *)pixelBuffer16
+                                                         : pixelBuffer,
+                          width * GetOutputBytesPerPixel(outputDepth));
+        AddUploadTime(&uploadStats, GetElapsedTimeMs(
+                                        uploadCounter,
+                                        SDL_GetPerformanceCounter()));
+        TraceEnd("texture upload", traceStart);
+
+        traceStart = TraceBegin();
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
+        TraceEnd("present", traceStart);
+        AddJitterFrame(&jitter, SDL_GetPerformanceCounter());
+        RecordInputLatency(SDL_GetTicks());
 
         double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
         double fps = (double)SDL_GetPerformanceFrequency() /
@@ -257,15 +2795,71 @@ int main(int argc, char *argv[]) {
 
         if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
             1000.0) {
-            printf("ms/f: %f, fps: %f\r", msPerFrame, fps);
+            char counters[256] = "";
+            if (perfEnabled) {
+                PerfSample sample;
+                TakePerfTotals(&drawCounters, &sample);
+                FormatPerfCounters(counters, sizeof(counters), &sample,
+                                   metricsFrames, (double)width * height);
+            }
+            char samples[128] = "";
+            if (adaptiveThreshold >= 0) {
+                snprintf(samples, sizeof(samples),
+                         ", evaluated: %llu px/f, filled: %llu px/f",
+                         atomic_exchange(&adaptiveEvaluated, 0) / metricsFrames,
+                         atomic_exchange(&adaptiveFilled, 0) / metricsFrames);
+            }
+            metricsFrames = 0;
+            char upload[64];
+            FormatUploadStats(upload, sizeof(upload), &uploadStats, width,
+                              height, outputDepth);
+
+            if (referenceBuffer != NULL) {
+                DrawFullFrame(referenceBuffer, elapsedTimeMs);
+                FrameError error = CompareFrames(pixelBuffer, referenceBuffer,
+                                                 width * height);
+                printf("ms/f: %f, fps: %f, psnr: %f dB, max error: %d%s%s%s\r",
+                       msPerFrame, fps, error.psnr, error.maxError, samples,
+                       upload, counters);
+
+                // The reference frame is not part of the draw cost.
+                PerfSample reference;
+                TakePerfTotals(&drawCounters, &reference);
+            } else {
+                printf("ms/f: %f, fps: %f%s%s\r", msPerFrame, fps, upload,
+                       counters);
+            }
             fflush(stdout);
             metricsPrintCounter = SDL_GetPerformanceCounter();
         }
 
+        if (governorEnabled &&
+            UpdateGovernor(drawMs, targetSecsPerFrame * 1000.0) != 0) {
+            isRunning = 0;
+        }
+
+        if (AddBenchmarkFrame(&benchmark, drawMs)) {
+            isRunning = 0;
+        }
+
         lastCounter = endCounter;
     }
+    PrintBenchmark(&benchmark);
+    PrintJitterHistogram(&jitter);
+
+    if (interactive) {
+        PrintLatencyHistogram();
+    }
+
+    DestroyShmRing(&shmRing);
+    UnmapLoopCache(&loopCache);
+    DestroyFrameBuffers();
+    DestroyWorkerPool(&workerPool);
+
+    if (tracePath != NULL) {
+        SaveTrace();
+    }
 
-    free(pixelBuffer);
     DestroySDL();
 
     return EXIT_SUCCESS;
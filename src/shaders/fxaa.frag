@@ -0,0 +1,45 @@
+#version 330 core
+
+in vec2 TextureCoords;
+
+uniform sampler2D uScene;
+uniform vec2 uInverseResolution;
+
+out vec4 fragColor;
+
+// A single pass of FXAA in the spirit of Timothy Lottes' original: estimate
+// the edge direction from the luma of the diagonal neighbours, then blend
+// samples along the edge, falling back to the shorter blend when the longer
+// one crosses into a different surface.
+const float REDUCE_MIN = 1.0 / 128.0;
+const float REDUCE_MUL = 1.0 / 8.0;
+const float SPAN_MAX = 8.0;
+const vec3 LUMA = vec3(0.299, 0.587, 0.114);
+
+void main() {
+	vec2 texel = uInverseResolution;
+	vec3 rgbM = texture(uScene, TextureCoords).rgb;
+	float lumaNW = dot(texture(uScene, TextureCoords + vec2(-1.0, -1.0) * texel).rgb, LUMA);
+	float lumaNE = dot(texture(uScene, TextureCoords + vec2(1.0, -1.0) * texel).rgb, LUMA);
+	float lumaSW = dot(texture(uScene, TextureCoords + vec2(-1.0, 1.0) * texel).rgb, LUMA);
+	float lumaSE = dot(texture(uScene, TextureCoords + vec2(1.0, 1.0) * texel).rgb, LUMA);
+	float lumaM = dot(rgbM, LUMA);
+
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+	vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)),
+	                      (lumaNW + lumaSW) - (lumaNE + lumaSE));
+	float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * REDUCE_MUL,
+	                   REDUCE_MIN);
+	float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+	direction = clamp(direction * scale, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * texel;
+
+	vec3 rgbA = 0.5 * (texture(uScene, TextureCoords + direction * (1.0 / 3.0 - 0.5)).rgb +
+	                   texture(uScene, TextureCoords + direction * (2.0 / 3.0 - 0.5)).rgb);
+	vec3 rgbB = rgbA * 0.5 + 0.25 * (texture(uScene, TextureCoords - direction * 0.5).rgb +
+	                                 texture(uScene, TextureCoords + direction * 0.5).rgb);
+
+	float lumaB = dot(rgbB, LUMA);
+	fragColor = vec4(lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB, 1.0);
+}
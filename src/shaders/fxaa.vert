@@ -0,0 +1,11 @@
+#version 330 core
+
+out vec2 TextureCoords;
+
+// One triangle that covers the screen, so the pass needs no vertex buffer.
+void main() {
+	vec2 position = vec2(float((gl_VertexID & 1) << 2) - 1.0,
+	                     float((gl_VertexID & 2) << 1) - 1.0);
+	TextureCoords = position * 0.5 + 0.5;
+	gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+uniform sampler2D uField;
+uniform sampler1D uPalette;
+uniform int uShift;
+uniform ivec2 uResolution;
+
+out vec4 fragColor;
+
+const int PALETTE_SIZE = 256;
+
+void main() {
+	// Row 0 of the field is the top of the screen, like the software demo.
+	vec2 resolution = vec2(uResolution);
+	vec2 uv = vec2(gl_FragCoord.x, resolution.y - gl_FragCoord.y) / resolution;
+	ivec2 fieldSize = textureSize(uField, 0);
+	ivec2 texel = min(ivec2(uv * vec2(fieldSize)), fieldSize - 1);
+
+	int value = int(texelFetch(uField, texel, 0).r * 255.0 + 0.5);
+	int index = (value + uShift) % PALETTE_SIZE;
+
+	fragColor = vec4(texelFetch(uPalette, index, 0).rgb, 1.0);
+}
@@ -0,0 +1,8 @@
+#version 450
+
+// A single triangle covering the whole viewport, made from the vertex index so
+// the pipeline needs no vertex buffers.
+void main() {
+	vec2 pos = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
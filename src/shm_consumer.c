@@ -0,0 +1,437 @@
+#include "renderdaemon.h"
+#include "shmring.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_POLL_INTERVAL_US 1000
+#define DEFAULT_WIDTH 128
+#define DEFAULT_HEIGHT 128
+#define DEFAULT_FRAME_RATE 60
+#define MAX_FRAME_RATE 1000
+#define NS_PER_SEC 1000000000ull
+#define REPORT_INTERVAL_NS 1000000000ull
+#define PI 3.1415926535897932384626433832795
+
+#define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+#define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+
+// A reference consumer for the frame ring the software demos publish with -m.
+// It maps the ring read only and works on the newest frame where it lies, so
+// besides the poll interval it makes no syscalls while frames are flowing.
+//
+// With -d it is also a reference client of rgb_plasma -d. It then creates
+// the ring itself and requests a frame into it from the daemon on every tick
+// of a frame clock shared by all clients on the machine, so clients running
+// at the same rate and resolution ask for the same frames.
+
+typedef struct {
+    int frames;
+    Uint64 skipped;
+    int torn;
+    int invalid;
+    int failed;
+    double ageMsSum;
+    double ageMsMax;
+    double mean[3];
+} ConsumerStats;
+
+ShmRing ring;
+ConsumerStats stats;
+
+char ringName[SHM_RING_NAME_SIZE];
+int ringSlots = DEFAULT_SHM_RING_SLOTS;
+int pollIntervalUs = DEFAULT_POLL_INTERVAL_US;
+int frameLimit = 0;
+const char *outputPath = NULL;
+const char *daemonPath = NULL;
+int daemonSocket = -1;
+int width = DEFAULT_WIDTH;
+int height = DEFAULT_HEIGHT;
+int frameRate = DEFAULT_FRAME_RATE;
+PlasmaVariant variant = PLASMA_VARIANT_PLAIN;
+
+Uint64 lastFrame = 0;
+int haveFrame = 0;
+int totalFrames = 0;
+
+void Sleep(int microseconds) {
+    struct timespec interval = {microseconds / 1000000,
+                                (microseconds % 1000000) * 1000L};
+    nanosleep(&interval, NULL);
+}
+
+// Stands in for real work on the frame, like encoding or compositing it,
+// and reads every pixel straight out of the slot.
+void MeasureFrame(const ShmRingFrameSize *size, const Uint8 *pixels,
+                  double mean[3]) {
+    Uint64 sums[3] = {0, 0, 0};
+
+    for (Uint32 y = 0; y < size->height; y++) {
+        const Uint32 *row = (const Uint32 *)(pixels + (size_t)size->pitch * y);
+        for (Uint32 x = 0; x < size->width; x++) {
+            sums[0] += (row[x] >> 16) & 0xff;
+            sums[1] += (row[x] >> 8) & 0xff;
+            sums[2] += row[x] & 0xff;
+        }
+    }
+
+    double count = (double)size->width * size->height;
+    for (int i = 0; i < 3; i++) {
+        mean[i] = sums[i] / count;
+    }
+}
+
+int WriteFrame(const char *path, const ShmRingFrameSize *size,
+               const Uint8 *pixels) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", size->width, size->height);
+    for (Uint32 y = 0; y < size->height; y++) {
+        const Uint32 *row = (const Uint32 *)(pixels + (size_t)size->pitch * y);
+        for (Uint32 x = 0; x < size->width; x++) {
+            Uint8 rgb[3] = {(row[x] >> 16) & 0xff, (row[x] >> 8) & 0xff,
+                            row[x] & 0xff};
+            fwrite(rgb, sizeof(rgb), 1, file);
+        }
+    }
+
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Writes the newest frame out again until a copy comes through intact.
+int SaveNewestFrame(const char *path) {
+    for (;;) {
+        Uint64 sequence;
+        int index;
+        const ShmRingSlot *slot = AcquireShmRingFrame(&ring, &sequence, &index);
+        if (slot == NULL) {
+            if (IsShmRingClosed(&ring)) {
+                return -1;
+            }
+            Sleep(pollIntervalUs);
+            continue;
+        }
+
+        ShmRingFrameSize size;
+        if (GetShmRingFrameSize(&ring, slot, &size) != 0 ||
+            WriteFrame(path, &size, GetShmRingSlotPixels(&ring, index)) != 0) {
+            return -1;
+        }
+        if (ValidateShmRingFrame(slot, sequence)) {
+            return 0;
+        }
+    }
+}
+
+// Measures the newest frame in the ring if it is one it has not seen yet.
+// Returns 1 when it was new and came through intact.
+int ConsumeNewestFrame(void) {
+    Uint64 sequence;
+    int index;
+    const ShmRingSlot *slot = AcquireShmRingFrame(&ring, &sequence, &index);
+    Uint64 frame = slot != NULL ? sequence / 2 - 1 : lastFrame;
+    if (slot == NULL || (haveFrame && frame == lastFrame)) {
+        return 0;
+    }
+
+    // A frame larger than the ring's slots would be read past them.
+    ShmRingFrameSize size;
+    if (GetShmRingFrameSize(&ring, slot, &size) != 0) {
+        stats.invalid++;
+        lastFrame = frame;
+        haveFrame = 1;
+        return 0;
+    }
+
+    Uint64 publishNs = slot->publishNs;
+    double mean[3];
+    MeasureFrame(&size, GetShmRingSlotPixels(&ring, index), mean);
+    if (!ValidateShmRingFrame(slot, sequence)) {
+        stats.torn++;
+        return 0;
+    }
+
+    if (haveFrame && frame > lastFrame + 1) {
+        stats.skipped += frame - lastFrame - 1;
+    }
+    double ageMs = (GetShmRingClockNs() - publishNs) / 1e6;
+    stats.ageMsSum += ageMs;
+    if (ageMs > stats.ageMsMax) {
+        stats.ageMsMax = ageMs;
+    }
+    memcpy(stats.mean, mean, sizeof(mean));
+    stats.frames++;
+    totalFrames++;
+    lastFrame = frame;
+    haveFrame = 1;
+
+    return 1;
+}
+
+void PrintStats(void) {
+    double ageMs = stats.frames ? stats.ageMsSum / stats.frames : 0.0;
+
+    printf("frames: %d, skipped: %llu, torn: %d, invalid: %d, failed: %d, age "
+           "ms: %f avg %f max, mean rgb: %.1f %.1f %.1f\r",
+           stats.frames, (unsigned long long)stats.skipped, stats.torn,
+           stats.invalid, stats.failed, ageMs, stats.ageMsMax, stats.mean[0],
+           stats.mean[1], stats.mean[2]);
+    fflush(stdout);
+}
+
+int ConnectDaemon(void) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", daemonPath);
+
+    daemonSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (daemonSocket < 0 ||
+        connect(daemonSocket, (struct sockaddr *)&address, sizeof(address)) !=
+            0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Sends a request and waits for its reply. The daemon answers the requests
+// of one client in order when they are sent one at a time.
+int CallDaemon(const RenderRequest *request, RenderReply *reply) {
+    if (send(daemonSocket, request, sizeof(*request), 0) !=
+        (ssize_t)sizeof(*request)) {
+        return -1;
+    }
+
+    size_t received = 0;
+    while (received < sizeof(*reply)) {
+        ssize_t count = recv(daemonSocket, (char *)reply + received,
+                             sizeof(*reply) - received, 0);
+        if (count <= 0) {
+            return -1;
+        }
+        received += count;
+    }
+
+    return reply->magic == RENDER_DAEMON_MAGIC && reply->id == request->id
+               ? 0
+               : -1;
+}
+
+RenderRequest CreateRequest(RenderRequestKind kind, Uint64 id) {
+    RenderRequest request;
+    memset(&request, 0, sizeof(request));
+    request.magic = RENDER_DAEMON_MAGIC;
+    request.kind = kind;
+    request.id = id;
+    request.width = (Uint32)width;
+    request.height = (Uint32)height;
+    request.variant = variant;
+    snprintf(request.ring, sizeof(request.ring), "%s", ringName);
+
+    return request;
+}
+
+// The tick of the shared frame clock, the whole frames at frameRate since
+// the clock started. Seconds and the rest are scaled apart, so the product
+// can't overflow however long the machine has been up.
+Uint64 GetFrameClockTick(void) {
+    Uint64 ns = GetShmRingClockNs();
+    return ns / NS_PER_SEC * frameRate +
+           ns % NS_PER_SEC * frameRate / NS_PER_SEC;
+}
+
+// Waits for the next tick of the shared frame clock and asks the daemon for
+// the frame at that tick. The mouse variant gets a mouse moving in a circle.
+int RequestFrame(Uint64 *tick) {
+    Uint64 next;
+    while ((next = GetFrameClockTick()) <= *tick) {
+        Sleep(pollIntervalUs);
+    }
+    *tick = next;
+
+    RenderRequest request = CreateRequest(RENDER_REQUEST_FRAME, next);
+    request.time = next / (double)frameRate;
+    request.mouseX = 0.4 * cos(request.time * PI * 0.25);
+    request.mouseY = 0.4 * sin(request.time * PI * 0.25);
+
+    RenderReply reply;
+    if (CallDaemon(&request, &reply) != 0) {
+        LogError("lost the connection to %s", daemonPath);
+        return -1;
+    }
+    if (reply.status != RENDER_STATUS_OK) {
+        stats.failed++;
+    }
+
+    return 0;
+}
+
+void LogDaemonStats(void) {
+    RenderRequest request = CreateRequest(RENDER_REQUEST_STATS, 0);
+    RenderReply reply;
+    if (CallDaemon(&request, &reply) != 0) {
+        return;
+    }
+
+    const RenderClientStats *daemonStats = &reply.stats;
+    double latencyMs = daemonStats->frames ? daemonStats->latencyMsSum /
+                                                 daemonStats->frames
+                                           : 0.0;
+    LogInfo("daemon rendered %llu frames in %f s, %f frames/s, %llu shared, "
+            "%llu errors, latency %f ms avg %f ms max",
+            (unsigned long long)daemonStats->frames,
+            daemonStats->connectedSecs,
+            daemonStats->frames / daemonStats->connectedSecs,
+            (unsigned long long)daemonStats->sharedFrames,
+            (unsigned long long)daemonStats->errors, latencyMs,
+            daemonStats->latencyMsMax);
+}
+
+int main(int argc, char *argv[]) {
+    char opt;
+    while ((opt = getopt(argc, argv, ":m:i:n:o:d:w:h:r:v:")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (ParseShmRingOption(optarg, ringName, sizeof(ringName),
+                                   &ringSlots) != 0) {
+                fprintf(stderr, "invalid value for ring: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'i':
+            pollIntervalUs = strtol(optarg, (char **)NULL, 10);
+            if (pollIntervalUs <= 0) {
+                fprintf(stderr, "invalid value for poll interval: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            frameLimit = strtol(optarg, (char **)NULL, 10);
+            if (frameLimit <= 0) {
+                fprintf(stderr, "invalid value for frames: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        case 'd':
+            daemonPath = optarg;
+            break;
+        case 'w':
+            width = strtol(optarg, (char **)NULL, 10);
+            if (width <= 0 || width > MAX_RENDER_DAEMON_SIZE) {
+                fprintf(stderr, "invalid value for width: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            height = strtol(optarg, (char **)NULL, 10);
+            if (height <= 0 || height > MAX_RENDER_DAEMON_SIZE) {
+                fprintf(stderr, "invalid value for height: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            frameRate = strtol(optarg, (char **)NULL, 10);
+            if (frameRate <= 0 || frameRate > MAX_FRAME_RATE) {
+                fprintf(stderr, "invalid value for frame rate: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'v':
+            if (ParsePlasmaVariant(optarg, &variant) != 0) {
+                fprintf(stderr, "invalid value for variant: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+
+    if (ringName[0] == '\0') {
+        fprintf(stderr, "a ring name is required, -m name\n");
+        return EXIT_FAILURE;
+    }
+
+    if (daemonPath != NULL) {
+        if (CreateShmRing(&ring, ringName, ringSlots, width, height) != 0) {
+            LogError("failed to create ring %s", ringName);
+            return EXIT_FAILURE;
+        }
+        if (ConnectDaemon() != 0) {
+            LogError("failed to connect to %s", daemonPath);
+            DestroyShmRing(&ring);
+            return EXIT_FAILURE;
+        }
+        LogInfo("requesting %dx%d %s frames at %d frames/s from %s", width,
+                height, GetPlasmaVariantName(variant), frameRate, daemonPath);
+    } else {
+        // The producer may not have started yet.
+        LogInfo("waiting for ring %s", ringName);
+        while (OpenShmRing(&ring, ringName) != 0) {
+            Sleep(pollIntervalUs);
+        }
+    }
+    LogInfo("mapped ring %s, %ux%u with %u slots", ringName, ring.width,
+            ring.height, ring.slotCount);
+
+    Uint64 tick = 0;
+    Uint64 reportNs = GetShmRingClockNs();
+
+    while (!IsShmRingClosed(&ring) &&
+           (frameLimit == 0 || totalFrames < frameLimit)) {
+        if (daemonPath != NULL) {
+            if (RequestFrame(&tick) != 0) {
+                break;
+            }
+            ConsumeNewestFrame();
+        } else if (!ConsumeNewestFrame()) {
+            Sleep(pollIntervalUs);
+        }
+
+        if (GetShmRingClockNs() - reportNs > REPORT_INTERVAL_NS) {
+            PrintStats();
+            memset(&stats, 0, sizeof(stats));
+            reportNs = GetShmRingClockNs();
+        }
+    }
+    printf("\n");
+    if (IsShmRingClosed(&ring)) {
+        LogInfo("producer closed ring %s after %d frames", ringName,
+                totalFrames);
+    }
+
+    int result = EXIT_SUCCESS;
+    if (outputPath != NULL) {
+        if (SaveNewestFrame(outputPath) != 0) {
+            LogError("failed to write frame to %s", outputPath);
+            result = EXIT_FAILURE;
+        } else {
+            LogInfo("wrote frame to %s", outputPath);
+        }
+    }
+
+    if (daemonSocket >= 0) {
+        LogDaemonStats();
+        close(daemonSocket);
+    }
+    DestroyShmRing(&ring);
+
+    return result;
+}
@@ -0,0 +1,393 @@
+#ifndef SHMRING_H_INCLUDED
+#define SHMRING_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_RING_MAGIC "PLASMASR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_NAME_SIZE 64
+#define SHM_RING_PAGE_SIZE 4096
+#define MAX_SHM_RING_SLOTS 16
+#define DEFAULT_SHM_RING_SLOTS 3
+// DRM_FORMAT_XRGB8888, the layout of SDL_PIXELFORMAT_RGB888 on little endian.
+#define SHM_RING_FORMAT_XRGB8888 0x34325258
+
+// A shared memory ring publishes frames to other processes. The producer
+// writes frame n into slot n % slotCount and guards every slot with a
+// sequence number, the way a seqlock does: it is odd while the slot is being
+// written and 2n + 2 once frame n is complete. After that the header's
+// published count moves on to n + 1.
+//
+// A consumer maps the ring read only, looks up the newest frame from the
+// published count and reads it straight out of the slot. Once it is done it
+// checks the slot's sequence again; if that changed the producer lapped it
+// and whatever it read is torn. Neither side takes a lock or makes a syscall
+// per frame.
+
+typedef struct {
+    atomic_ullong sequence;
+    Uint64 frame;
+    // CLOCK_MONOTONIC when the frame was published, so consumers can measure
+    // how old a frame is against their own clock.
+    Uint64 publishNs;
+    double time;
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+    Uint32 padding[5];
+} ShmRingSlot;
+
+typedef struct {
+    char magic[8];
+    Uint32 version;
+    Uint32 format;
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+    Uint32 slotCount;
+    Uint64 slotOffset;
+    Uint64 slotBytes;
+    atomic_ullong published;
+    atomic_uint closed;
+    Uint32 padding[5];
+    ShmRingSlot slots[MAX_SHM_RING_SLOTS];
+} ShmRingHeader;
+
+typedef struct {
+    char name[SHM_RING_NAME_SIZE];
+    void *data;
+    size_t size;
+    int owner;
+    // Kept open for a ring attached to publish into, to check its size.
+    int fd;
+    ShmRingHeader *header;
+    // The geometry from the header, checked once when the ring is mapped.
+    // The header stays writable by the other side, so the slots are only
+    // ever addressed through this copy.
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+    Uint32 slotCount;
+    Uint64 slotOffset;
+    Uint64 slotBytes;
+} ShmRing;
+
+static inline Uint64 GetShmRingClockNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000000000ull + (Uint64)now.tv_nsec;
+}
+
+static inline size_t AlignShmRingSize(size_t size) {
+    return (size + SHM_RING_PAGE_SIZE - 1) / SHM_RING_PAGE_SIZE *
+           SHM_RING_PAGE_SIZE;
+}
+
+// Parses name[:slots] into a POSIX shared memory object name, which has to
+// start with a slash. Returns 0 on success, or -1 when the name is empty or
+// too long or the slot count is out of range.
+static inline int ParseShmRingOption(const char *arg, char *name,
+                                     size_t nameSize, int *slots) {
+    const char *separator = strchr(arg, ':');
+    size_t length = separator ? (size_t)(separator - arg) : strlen(arg);
+    const char *prefix = arg[0] == '/' ? "" : "/";
+
+    *slots = DEFAULT_SHM_RING_SLOTS;
+    if (separator != NULL) {
+        char *end;
+        *slots = strtol(separator + 1, &end, 10);
+        if (*end != '\0' || *slots < 2 || *slots > MAX_SHM_RING_SLOTS) {
+            return -1;
+        }
+    }
+
+    if (length == 0 || strlen(prefix) + length >= nameSize) {
+        return -1;
+    }
+    snprintf(name, nameSize, "%s%.*s", prefix, (int)length, arg);
+
+    return 0;
+}
+
+static inline Uint8 *GetShmRingSlotPixels(const ShmRing *ring, int slot) {
+    return (Uint8 *)ring->data + ring->slotOffset + ring->slotBytes * slot;
+}
+
+// Copies the geometry of a mapped ring of size bytes out of its header.
+// Returns 0 when it describes XRGB8888 slots that all lie inside the mapping,
+// past the header, or -1 otherwise.
+static inline int LoadShmRingGeometry(ShmRing *ring, size_t size) {
+    const ShmRingHeader *header = ring->header;
+    ring->width = header->width;
+    ring->height = header->height;
+    ring->pitch = header->pitch;
+    ring->slotCount = header->slotCount;
+    ring->slotOffset = header->slotOffset;
+    ring->slotBytes = header->slotBytes;
+
+    if (memcmp(header->magic, SHM_RING_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SHM_RING_VERSION ||
+        header->format != SHM_RING_FORMAT_XRGB8888 || ring->width == 0 ||
+        ring->height == 0 || ring->slotCount == 0 ||
+        ring->slotCount > MAX_SHM_RING_SLOTS ||
+        ring->pitch < (Uint64)ring->width * sizeof(Uint32) ||
+        ring->slotBytes < (Uint64)ring->pitch * ring->height ||
+        ring->slotOffset < sizeof(ShmRingHeader) || ring->slotOffset > size ||
+        ring->slotBytes > (size - ring->slotOffset) / ring->slotCount ||
+        size != ring->slotOffset + ring->slotBytes * ring->slotCount) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Creates the ring for frames of up to width x height pixels, replacing any
+// ring a previous run left behind under the same name. Returns 0 on success
+// or -1 on failure, with errno set.
+static inline int CreateShmRing(ShmRing *ring, const char *name, int slots,
+                                int width, int height) {
+    memset(ring, 0, sizeof(*ring));
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->fd = -1;
+
+    Uint32 pitch = (Uint32)width * sizeof(Uint32);
+    size_t slotOffset = AlignShmRingSize(sizeof(ShmRingHeader));
+    size_t slotBytes = AlignShmRingSize((size_t)pitch * height);
+    size_t size = slotOffset + slotBytes * slots;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name);
+        return -1;
+    }
+
+    // The object starts out zeroed, so every slot reads as empty until the
+    // header is filled in and the first frame published.
+    ShmRingHeader *header = data;
+    memcpy(header->magic, SHM_RING_MAGIC, sizeof(header->magic));
+    header->version = SHM_RING_VERSION;
+    header->format = SHM_RING_FORMAT_XRGB8888;
+    header->width = (Uint32)width;
+    header->height = (Uint32)height;
+    header->pitch = pitch;
+    header->slotCount = (Uint32)slots;
+    header->slotOffset = slotOffset;
+    header->slotBytes = slotBytes;
+
+    ring->data = data;
+    ring->size = size;
+    ring->owner = 1;
+    ring->header = header;
+    LoadShmRingGeometry(ring, size);
+
+    return 0;
+}
+
+// Copies a frame into the next slot and publishes it. Frames may be smaller
+// than the ring, when a demo lowers its internal resolution, but not larger.
+// Returns -1 when the frame doesn't fit or, for a ring attached to, when its
+// creator has shrunk the object below the mapping, where writing the slots
+// would fault.
+static inline int PublishShmRingFrame(ShmRing *ring, const Uint32 *pixels,
+                                      int width, int height, double time) {
+    ShmRingHeader *header = ring->header;
+    if ((Uint32)width > ring->width || (Uint32)height > ring->height) {
+        return -1;
+    }
+
+    struct stat info;
+    if (ring->fd >= 0 &&
+        (fstat(ring->fd, &info) != 0 || (size_t)info.st_size < ring->size)) {
+        return -1;
+    }
+
+    Uint64 frame =
+        atomic_load_explicit(&header->published, memory_order_relaxed);
+    int index = (int)(frame % ring->slotCount);
+    ShmRingSlot *slot = &header->slots[index];
+    Uint8 *target = GetShmRingSlotPixels(ring, index);
+    size_t rowBytes = (size_t)width * sizeof(*pixels);
+
+    atomic_store_explicit(&slot->sequence, 2 * frame + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (int y = 0; y < height; y++) {
+        memcpy(target + (size_t)ring->pitch * y, pixels + (size_t)width * y,
+               rowBytes);
+    }
+    slot->frame = frame;
+    slot->publishNs = GetShmRingClockNs();
+    slot->time = time;
+    slot->width = (Uint32)width;
+    slot->height = (Uint32)height;
+    slot->pitch = ring->pitch;
+
+    atomic_store_explicit(&slot->sequence, 2 * frame + 2,
+                          memory_order_release);
+    atomic_store_explicit(&header->published, frame + 1,
+                          memory_order_release);
+    return 0;
+}
+
+// Maps an existing ring. Returns 0 on success, or -1 when there is no ring
+// under that name or its header doesn't describe a valid ring of this
+// version.
+static inline int MapShmRing(ShmRing *ring, const char *name, int writable) {
+    memset(ring, 0, sizeof(*ring));
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->fd = -1;
+
+    int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        (size_t)info.st_size < sizeof(ShmRingHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *data = mmap(NULL, info.st_size, protection, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    ring->header = data;
+    if (LoadShmRingGeometry(ring, info.st_size) != 0) {
+        munmap(data, info.st_size);
+        close(fd);
+        memset(ring, 0, sizeof(*ring));
+        ring->fd = -1;
+        return -1;
+    }
+
+    if (writable) {
+        ring->fd = fd;
+    } else {
+        close(fd);
+    }
+    ring->data = data;
+    ring->size = info.st_size;
+
+    return 0;
+}
+
+// Maps a ring read only, to consume its frames.
+static inline int OpenShmRing(ShmRing *ring, const char *name) {
+    return MapShmRing(ring, name, 0);
+}
+
+// Maps a ring another process created, to publish frames into it. Only the
+// creator removes the ring again.
+static inline int AttachShmRing(ShmRing *ring, const char *name) {
+    return MapShmRing(ring, name, 1);
+}
+
+// Finds the newest complete frame. Returns its slot and stores the sequence
+// to check it against afterwards, or returns NULL when nothing has been
+// published yet or the producer is already rewriting that slot.
+static inline const ShmRingSlot *
+AcquireShmRingFrame(const ShmRing *ring, Uint64 *sequence, int *index) {
+    ShmRingHeader *header = ring->header;
+    Uint64 published =
+        atomic_load_explicit(&header->published, memory_order_acquire);
+    if (published == 0) {
+        return NULL;
+    }
+
+    Uint64 frame = published - 1;
+    *index = (int)(frame % ring->slotCount);
+    ShmRingSlot *slot = &header->slots[*index];
+    *sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (*sequence != 2 * frame + 2) {
+        return NULL;
+    }
+
+    return slot;
+}
+
+// The size of the frame in a slot.
+typedef struct {
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+} ShmRingFrameSize;
+
+// Copies the size of the frame in a slot once, since the producer can still
+// rewrite it, and checks it against the geometry checked when the ring was
+// mapped. Returns 0 when the frame lies inside its slot, or -1 otherwise.
+static inline int GetShmRingFrameSize(const ShmRing *ring,
+                                      const ShmRingSlot *slot,
+                                      ShmRingFrameSize *size) {
+    const volatile ShmRingSlot *shared = slot;
+    size->width = shared->width;
+    size->height = shared->height;
+    size->pitch = shared->pitch;
+
+    if (size->width > ring->width || size->height > ring->height ||
+        size->pitch != ring->pitch) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Returns 1 when the slot still holds the frame it held when it was acquired,
+// so everything read from it since is intact, or 0 when it was overwritten.
+static inline int ValidateShmRingFrame(const ShmRingSlot *slot,
+                                       Uint64 sequence) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) ==
+           sequence;
+}
+
+static inline int IsShmRingClosed(const ShmRing *ring) {
+    return atomic_load_explicit(&ring->header->closed, memory_order_acquire);
+}
+
+// Unmaps the ring. The producer also marks it closed for consumers still
+// mapping it and removes the name.
+static inline void DestroyShmRing(ShmRing *ring) {
+    if (ring->data == NULL) {
+        return;
+    }
+
+    if (ring->owner) {
+        atomic_store_explicit(&ring->header->closed, 1, memory_order_release);
+        shm_unlink(ring->name);
+    }
+    munmap(ring->data, ring->size);
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+#endif
@@ -0,0 +1,957 @@
+#include "benchmark.h"
+#include "cpudispatch.h"
+#include "fastmath.h"
+#include "framebuffer.h"
+#include "glmath.h"
+#include "perfcounters.h"
+#include "realtime.h"
+#include "rgb565.h"
+#include "shmring.h"
+#include "trace.h"
+#include "workers.h"
+#include <SDL2/SDL.h>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define WINDOW_TITLE "Soft Cube Plasma"
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+#define DEFAULT_REFRESH_RATE 60
+#define PI 3.1415926535897932384626433832795
+#define PLASMA_SCALE 20.0
+#define MAX_CHANNEL_VALUE 255.0
+#define TILE_SIZE 32
+#define TILE_PIXELS (TILE_SIZE * TILE_SIZE)
+#define CUBE_TRIANGLES 12
+#define CUBE_FACES 6
+#define CUBE_VERTEX_FLOATS 6
+// Faces are numbered 0 to 5, the slot after them marks pixels no triangle
+// covers and shades them black.
+#define BACKGROUND_FACE CUBE_FACES
+#define FACE_SLOTS (CUBE_FACES + 1)
+// Lets pixel centres exactly on the edge shared by a face's two triangles be
+// covered by both, so rounding can't open a crack between them.
+#define EDGE_EPSILON -1e-5f
+#define LIGHT_X 1.2
+#define LIGHT_Y 1.0
+#define LIGHT_Z 2.0
+#define AMBIENT_STRENGTH 0.05
+#define SPECULAR_STRENGTH 0.5
+
+#define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+#define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+
+// A value that varies linearly over the screen, a * x + b * y + c at the pixel
+// centre (x, y).
+typedef struct {
+    float a;
+    float b;
+    float c;
+} Plane;
+
+// A triangle after projection. The edge planes are its barycentric
+// coordinates, so a pixel is inside when all three are positive. The world
+// position is interpolated divided by w, and divided by the interpolated 1 / w
+// per pixel, which keeps it perspective correct.
+typedef struct {
+    Plane edges[3];
+    Plane depth;
+    Plane inverseW;
+    Plane position[3];
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    Uint8 face;
+} Triangle;
+
+// Everything a worker needs to draw its tiles of one frame. The face tables
+// hold what cube_plasma.frag works out from the normal of each face.
+typedef struct {
+    Triangle triangles[CUBE_TRIANGLES];
+    int triangleCount;
+    double normalX[FACE_SLOTS];
+    double normalY[FACE_SLOTS];
+    double normalZ[FACE_SLOTS];
+    double plasmaR[FACE_SLOTS];
+    double plasmaG[FACE_SLOTS];
+    double plasmaB[FACE_SLOTS];
+    double coverage[FACE_SLOTS];
+    double time;
+    double offsetX;
+    double offsetY;
+    double viewX;
+    double viewY;
+    double viewZ;
+} FrameSetup;
+
+// The depth and the attributes of the nearest triangle for every pixel of one
+// tile. It is small enough to stay in cache while it is rasterized and shaded.
+typedef struct {
+    int x0;
+    int y0;
+    int width;
+    int height;
+    float depth[TILE_PIXELS];
+    float positionX[TILE_PIXELS];
+    float positionY[TILE_PIXELS];
+    float positionZ[TILE_PIXELS];
+    Uint8 face[TILE_PIXELS];
+} Tile;
+
+typedef void (*RasterTileKernel)(const FrameSetup *setup, Tile *tile);
+typedef void (*ShadeTileKernel)(const FrameSetup *setup, const Tile *tile,
+                                Uint32 *pixels);
+typedef void (*ShadeTile16Kernel)(const FrameSetup *setup, const Tile *tile,
+                                  Uint16 *pixels);
+
+// The same cube as cube_plasma, a position and a normal per vertex and two
+// triangles per face.
+static const float cubeVertices[CUBE_TRIANGLES * 3 * CUBE_VERTEX_FLOATS] = {
+    -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f, 0.5f,  -0.5f, -0.5f,
+    0.0f,  0.0f,  -1.0f, 0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f,
+    0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f, -0.5f, 0.5f,  -0.5f,
+    0.0f,  0.0f,  -1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f,
+
+    -0.5f, -0.5f, 0.5f,  0.0f,  0.0f,  1.0f,  0.5f,  -0.5f, 0.5f,
+    0.0f,  0.0f,  1.0f,  0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+    0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  -0.5f, 0.5f,  0.5f,
+    0.0f,  0.0f,  1.0f,  -0.5f, -0.5f, 0.5f,  0.0f,  0.0f,  1.0f,
+
+    -0.5f, 0.5f,  0.5f,  -1.0f, 0.0f,  0.0f,  -0.5f, 0.5f,  -0.5f,
+    -1.0f, 0.0f,  0.0f,  -0.5f, -0.5f, -0.5f, -1.0f, 0.0f,  0.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f, 0.0f,  0.0f,  -0.5f, -0.5f, 0.5f,
+    -1.0f, 0.0f,  0.0f,  -0.5f, 0.5f,  0.5f,  -1.0f, 0.0f,  0.0f,
+
+    0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.5f,  0.5f,  -0.5f,
+    1.0f,  0.0f,  0.0f,  0.5f,  -0.5f, -0.5f, 1.0f,  0.0f,  0.0f,
+    0.5f,  -0.5f, -0.5f, 1.0f,  0.0f,  0.0f,  0.5f,  -0.5f, 0.5f,
+    1.0f,  0.0f,  0.0f,  0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+
+    -0.5f, -0.5f, -0.5f, 0.0f,  -1.0f, 0.0f,  0.5f,  -0.5f, -0.5f,
+    0.0f,  -1.0f, 0.0f,  0.5f,  -0.5f, 0.5f,  0.0f,  -1.0f, 0.0f,
+    0.5f,  -0.5f, 0.5f,  0.0f,  -1.0f, 0.0f,  -0.5f, -0.5f, 0.5f,
+    0.0f,  -1.0f, 0.0f,  -0.5f, -0.5f, -0.5f, 0.0f,  -1.0f, 0.0f,
+
+    -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  -0.5f,
+    0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+    0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  0.5f,
+    0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f};
+
+SDL_DisplayMode displayMode;
+SDL_Window *window = NULL;
+SDL_Renderer *renderer = NULL;
+SDL_Texture *texture = NULL;
+Uint32 *pixelBuffer = NULL;
+Uint16 *pixelBuffer16 = NULL;
+FrameMemory pixelMemory;
+WorkerPool workerPool;
+PerfTotals perfCounters;
+ShmRing shmRing;
+UploadStats uploadStats;
+Benchmark benchmark;
+Realtime realtime;
+JitterHistogram jitter;
+FrameSetup frameSetup;
+Mat4 projection = MAT4_ZERO_INIT;
+
+int width = DEFAULT_WIDTH;
+int height = DEFAULT_HEIGHT;
+int tileRows = 0;
+int fullscreen = 0;
+int workerCount = 0;
+int reportPlacement = 0;
+int perfEnabled = 0;
+int outputDepth = OUTPUT_DEPTH_32;
+Kernel kernel = KERNEL_GENERIC;
+int kernelOverridden = 0;
+RasterTileKernel rasterTile = NULL;
+ShadeTileKernel shadeTile = NULL;
+ShadeTile16Kernel shadeTile16 = NULL;
+const char *tracePath = NULL;
+char shmRingName[SHM_RING_NAME_SIZE] = "";
+int shmRingSlots = DEFAULT_SHM_RING_SLOTS;
+
+double Min(double value, double min) {
+    return value > min ? value : min;
+}
+
+int Get1DArrayIndex(int x, int y, int width) {
+    return (y * width) + x;
+}
+
+double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
+    return (double)(end - start) / SDL_GetPerformanceFrequency();
+}
+
+double GetElapsedTimeMs(Uint64 start, Uint64 end) {
+    return (double)((end - start) * 1000.0) / SDL_GetPerformanceFrequency();
+}
+
+int GetDisplayRefreshRate(SDL_DisplayMode displayMode) {
+    int result = displayMode.refresh_rate;
+
+    if (result == 0) {
+        return DEFAULT_REFRESH_RATE;
+    }
+
+    return result;
+}
+
+int InitSDL(void) {
+    SDL_Init(SDL_INIT_VIDEO);
+
+    if (SDL_GetDesktopDisplayMode(0, &displayMode) != 0) {
+        return -1;
+    }
+
+    window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED,
+                              SDL_WINDOWPOS_CENTERED, width, height,
+                              SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    if (window == NULL) {
+        return -1;
+    }
+    LogInfo("window created with size %dx%d", width, height);
+
+    if (fullscreen) {
+        SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
+    }
+
+    SDL_ShowCursor(SDL_DISABLE);
+
+    renderer = SDL_CreateRenderer(
+        window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == NULL) {
+        return -1;
+    }
+    LogInfo("renderer created with logical size %dx%d", width, height);
+
+    SDL_RenderSetLogicalSize(renderer, width, height);
+
+    texture = SDL_CreateTexture(renderer, GetOutputFormat(outputDepth),
+                                SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (texture == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Fills the colour and lighting tables of each face. The plasma tints the
+// channels the shader leaves at full brightness for faces facing along x, y
+// or z.
+void SetupFaces(FrameSetup *setup, Mat4 model) {
+    for (int face = 0; face < CUBE_FACES; face++) {
+        const float *vertex = &cubeVertices[face * 6 * CUBE_VERTEX_FLOATS];
+        float normal[4] = {vertex[3], vertex[4], vertex[5], 0.0f};
+
+        // The model matrix only rotates, so it transforms normals unchanged.
+        float transformed[4];
+        Mat4MulVec4(model, normal, transformed);
+        Vec3Norm(transformed);
+        setup->normalX[face] = transformed[0];
+        setup->normalY[face] = transformed[1];
+        setup->normalZ[face] = transformed[2];
+
+        int alongX = fabsf(normal[0]) == 1.0f;
+        int alongY = !alongX && fabsf(normal[1]) == 1.0f;
+        setup->plasmaR[face] = alongY ? 0.0 : 1.0;
+        setup->plasmaG[face] = alongX ? 0.0 : 1.0;
+        setup->plasmaB[face] = alongX || alongY ? 1.0 : 0.0;
+        setup->coverage[face] = 1.0;
+    }
+
+    setup->normalX[BACKGROUND_FACE] = 0.0;
+    setup->normalY[BACKGROUND_FACE] = 0.0;
+    setup->normalZ[BACKGROUND_FACE] = 0.0;
+    setup->plasmaR[BACKGROUND_FACE] = 0.0;
+    setup->plasmaG[BACKGROUND_FACE] = 0.0;
+    setup->plasmaB[BACKGROUND_FACE] = 0.0;
+    setup->coverage[BACKGROUND_FACE] = 0.0;
+}
+
+Plane InterpolatePlane(double edges[3][3], const double values[3]) {
+    Plane plane;
+    plane.a = (float)(edges[0][0] * values[0] + edges[1][0] * values[1] +
+                      edges[2][0] * values[2]);
+    plane.b = (float)(edges[0][1] * values[0] + edges[1][1] * values[1] +
+                      edges[2][1] * values[2]);
+    plane.c = (float)(edges[0][2] * values[0] + edges[1][2] * values[1] +
+                      edges[2][2] * values[2]);
+
+    return plane;
+}
+
+// Projects one triangle of the cube and sets up its planes. Returns 0 when it
+// covers no pixel centres of the frame.
+int SetupTriangle(Triangle *triangle, int index, Mat4 model, Mat4 view) {
+    double screenX[3], screenY[3], depth[3], inverseW[3];
+    double position[3][3];
+
+    for (int i = 0; i < 3; i++) {
+        int vertexIndex = index * 3 + i;
+        const float *vertex = &cubeVertices[vertexIndex * CUBE_VERTEX_FLOATS];
+        float local[4] = {vertex[0], vertex[1], vertex[2], 1.0f};
+        float world[4], eye[4], clip[4];
+        Mat4MulVec4(model, local, world);
+        Mat4MulVec4(view, world, eye);
+        Mat4MulVec4(projection, eye, clip);
+
+        // The camera never comes closer to the cube than the near plane, so
+        // nothing needs clipping.
+        inverseW[i] = 1.0 / clip[3];
+        screenX[i] = (clip[0] * inverseW[i] * 0.5 + 0.5) * width;
+        screenY[i] = (0.5 - clip[1] * inverseW[i] * 0.5) * height;
+        depth[i] = clip[2] * inverseW[i];
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis][i] = world[axis] * inverseW[i];
+        }
+    }
+
+    // Edge i is the one opposite vertex i. Its function is zero on the edge
+    // and twice the triangle's signed area at vertex i, so dividing by that
+    // area gives the barycentric coordinate whichever way it is wound.
+    double edges[3][3];
+    double area = 0.0;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        edges[i][0] = screenY[j] - screenY[k];
+        edges[i][1] = screenX[k] - screenX[j];
+        edges[i][2] = screenX[j] * screenY[k] - screenY[j] * screenX[k];
+        area += edges[i][2];
+    }
+    if (fabs(area) < 1e-9) {
+        return 0;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        // Shift to the pixel centre so the planes take integer coordinates.
+        edges[i][2] += (edges[i][0] + edges[i][1]) * 0.5;
+        for (int n = 0; n < 3; n++) {
+            edges[i][n] /= area;
+        }
+        triangle->edges[i].a = (float)edges[i][0];
+        triangle->edges[i].b = (float)edges[i][1];
+        triangle->edges[i].c = (float)edges[i][2];
+    }
+    triangle->depth = InterpolatePlane(edges, depth);
+    triangle->inverseW = InterpolatePlane(edges, inverseW);
+    for (int axis = 0; axis < 3; axis++) {
+        triangle->position[axis] = InterpolatePlane(edges, position[axis]);
+    }
+
+    double minX = fmin(screenX[0], fmin(screenX[1], screenX[2]));
+    double maxX = fmax(screenX[0], fmax(screenX[1], screenX[2]));
+    double minY = fmin(screenY[0], fmin(screenY[1], screenY[2]));
+    double maxY = fmax(screenY[0], fmax(screenY[1], screenY[2]));
+    triangle->minX = (int)fmax(ceil(minX - 0.5), 0.0);
+    triangle->maxX = (int)fmin(floor(maxX - 0.5), width - 1);
+    triangle->minY = (int)fmax(ceil(minY - 0.5), 0.0);
+    triangle->maxY = (int)fmin(floor(maxY - 0.5), height - 1);
+    triangle->face = (Uint8)(index / 2);
+
+    return triangle->minX <= triangle->maxX &&
+           triangle->minY <= triangle->maxY;
+}
+
+// Moves the camera and spins the cube exactly like cube_plasma, then projects
+// the triangles for the workers.
+void SetupFrame(FrameSetup *setup, double elapsedTimeSecs) {
+    float camX = 0.0f;
+    float camY = 0.0f;
+    float camZ = 1.5f + Min(sinf(elapsedTimeSecs * PI / 4.0) +
+                                cosf(elapsedTimeSecs * 0.5f * PI / 4.0) +
+                                sinf(elapsedTimeSecs * 0.2f * PI / 6.0),
+                            0.5);
+
+    Mat4 view = MAT4_IDENTITY_INIT;
+    Mat4LookAt((Vec3){camX, camY, camZ}, (Vec3){0.0f, 0.0f, 0.0f},
+               (Vec3){0.0f, 1.0f, 0.0f}, view);
+
+    Mat4 identity = MAT4_IDENTITY_INIT;
+    Mat4 transform = MAT4_IDENTITY_INIT;
+    float t = elapsedTimeSecs * 0.5;
+    Mat4RotateZ(identity, transform, sinf(t * PI / 2.0) + sinf(t * PI / 6.0));
+
+    Mat4 out;
+    Mat4RotateX(transform, out, cosf(t * PI / 2.0));
+
+    Mat4 model;
+    Mat4RotateY(out, model, sinf(t * PI / 4.0) + cosf(t * PI / 2.0));
+
+    SetupFaces(setup, model);
+
+    setup->triangleCount = 0;
+    for (int i = 0; i < CUBE_TRIANGLES; i++) {
+        if (SetupTriangle(&setup->triangles[setup->triangleCount], i, model,
+                          view)) {
+            setup->triangleCount++;
+        }
+    }
+
+    setup->time = elapsedTimeSecs;
+    setup->offsetX = PLASMA_SCALE * 0.5 * FastSin(elapsedTimeSecs * 0.33);
+    setup->offsetY = PLASMA_SCALE * 0.5 * FastCos(elapsedTimeSecs * 0.33);
+    setup->viewX = camX;
+    setup->viewY = camY;
+    setup->viewZ = camZ;
+}
+
+// Finds the nearest triangle at every pixel of the tile and keeps its face
+// and world position for shading. The inner loop has no branches, so it is
+// vectorized across a row of the tile.
+KERNEL_INLINE void RasterTileBody(const FrameSetup *setup, Tile *tile) {
+    for (int i = 0; i < TILE_PIXELS; i++) {
+        tile->depth[i] = 1.0f;
+        tile->positionX[i] = 0.0f;
+        tile->positionY[i] = 0.0f;
+        tile->positionZ[i] = 0.0f;
+        tile->face[i] = BACKGROUND_FACE;
+    }
+
+    for (int n = 0; n < setup->triangleCount; n++) {
+        const Triangle *triangle = &setup->triangles[n];
+        int x0 = SDL_max(triangle->minX, tile->x0);
+        int x1 = SDL_min(triangle->maxX + 1, tile->x0 + tile->width);
+        int y0 = SDL_max(triangle->minY, tile->y0);
+        int y1 = SDL_min(triangle->maxY + 1, tile->y0 + tile->height);
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+
+        const Plane e0 = triangle->edges[0];
+        const Plane e1 = triangle->edges[1];
+        const Plane e2 = triangle->edges[2];
+        const Plane z = triangle->depth;
+        const Plane w = triangle->inverseW;
+        const Plane px = triangle->position[0];
+        const Plane py = triangle->position[1];
+        const Plane pz = triangle->position[2];
+        const Uint8 face = triangle->face;
+
+        for (int y = y0; y < y1; y++) {
+            float e0Row = e0.b * y + e0.c;
+            float e1Row = e1.b * y + e1.c;
+            float e2Row = e2.b * y + e2.c;
+            float zRow = z.b * y + z.c;
+            float wRow = w.b * y + w.c;
+            float pxRow = px.b * y + px.c;
+            float pyRow = py.b * y + py.c;
+            float pzRow = pz.b * y + pz.c;
+            int rowStart = (y - tile->y0) * TILE_SIZE - tile->x0;
+
+            for (int x = x0; x < x1; x++) {
+                int index = rowStart + x;
+                float depth = z.a * x + zRow;
+                int pass = (e0.a * x + e0Row >= EDGE_EPSILON) &
+                           (e1.a * x + e1Row >= EDGE_EPSILON) &
+                           (e2.a * x + e2Row >= EDGE_EPSILON) &
+                           (depth < tile->depth[index]);
+                float toWorld = 1.0f / (w.a * x + wRow);
+
+                float worldX = (px.a * x + pxRow) * toWorld;
+                float worldY = (py.a * x + pyRow) * toWorld;
+                float worldZ = (pz.a * x + pzRow) * toWorld;
+
+                tile->depth[index] = pass ? depth : tile->depth[index];
+                tile->positionX[index] = pass ? worldX : tile->positionX[index];
+                tile->positionY[index] = pass ? worldY : tile->positionY[index];
+                tile->positionZ[index] = pass ? worldZ : tile->positionZ[index];
+                tile->face[index] = pass ? face : tile->face[index];
+            }
+        }
+    }
+}
+
+DEFINE_KERNEL_VARIANTS(RasterTileKernel, RasterTile,
+                       (const FrameSetup *setup, Tile *tile), (setup, tile));
+
+// max(value, 0) without a comparison. The compiler turns a comparison feeding
+// the lighting into a branch, which keeps the shading loop from vectorizing.
+KERNEL_INLINE double PositivePart(double value) {
+    return (value + fabs(value)) * 0.5;
+}
+
+// Converts a channel to 8 bits, rounding like a GL unorm target. Lit colors
+// are never negative but can go past one where the light is brightest.
+KERNEL_INLINE int ScaleChannel(double value) {
+    double scaled = value * MAX_CHANNEL_VALUE + 0.5;
+    return (int)(scaled < MAX_CHANNEL_VALUE ? scaled : MAX_CHANNEL_VALUE);
+}
+
+// cube_plasma.frag evaluated once per pixel of the tile: the plasma tinted by
+// face, lit by a white point light with ambient, diffuse and Phong specular
+// terms. Background pixels have no coverage and come out black. The depth is
+// a constant in each caller, so every copy only keeps one of the stores.
+KERNEL_INLINE void ShadeTilePixels(const FrameSetup *setup, const Tile *tile,
+                                   void *pixels, int depth) {
+    const int frameWidth = width;
+    const double t = setup->time;
+    const double offsetX = setup->offsetX;
+    const double offsetY = setup->offsetY;
+    const double viewX = setup->viewX;
+    const double viewY = setup->viewY;
+    const double viewZ = setup->viewZ;
+    const int tileWidth = tile->width;
+    const int tileHeight = tile->height;
+
+    for (int y = 0; y < tileHeight; y++) {
+        int rowStart = Get1DArrayIndex(tile->x0, tile->y0 + y, frameWidth);
+        Uint32 *row = (Uint32 *)pixels + rowStart;
+        Uint16 *row16 = (Uint16 *)pixels + rowStart;
+
+        // Looking the face tables up first leaves the shading loop without
+        // indexed loads, which the compiler won't vectorize as gathers.
+        double plasmaR[TILE_SIZE], plasmaG[TILE_SIZE], plasmaB[TILE_SIZE];
+        double faceNormalX[TILE_SIZE], faceNormalY[TILE_SIZE];
+        double faceNormalZ[TILE_SIZE], coverage[TILE_SIZE];
+        for (int x = 0; x < tileWidth; x++) {
+            int face = tile->face[y * TILE_SIZE + x];
+            plasmaR[x] = setup->plasmaR[face];
+            plasmaG[x] = setup->plasmaG[face];
+            plasmaB[x] = setup->plasmaB[face];
+            faceNormalX[x] = setup->normalX[face];
+            faceNormalY[x] = setup->normalY[face];
+            faceNormalZ[x] = setup->normalZ[face];
+            coverage[x] = setup->coverage[face];
+        }
+
+        for (int x = 0; x < tileWidth; x++) {
+            int index = y * TILE_SIZE + x;
+            double fragmentX = tile->positionX[index];
+            double fragmentY = tile->positionY[index];
+            double fragmentZ = tile->positionZ[index];
+
+            double coordsX = fragmentX * (PLASMA_SCALE - PLASMA_SCALE * 0.5);
+            double coordsY = fragmentY * (PLASMA_SCALE - PLASMA_SCALE * 0.5);
+            double val = FastSin(coordsY + t);
+            val += FastSin((coordsX + t) * 0.5);
+            val += FastSin((coordsX + coordsY + t) * 0.5);
+            coordsX += offsetX;
+            coordsY += offsetY;
+            val += FastSin(FastSqrt(coordsX * coordsX + coordsY * coordsY +
+                                    1.0) +
+                           t);
+            val *= 0.5;
+
+            double tint = FastSin(val * PI) - 1.0;
+            double r = (1.0 + plasmaR[x] * tint) * 0.5 + 0.5;
+            double g = (1.0 + plasmaG[x] * tint) * 0.5 + 0.5;
+            double b = (1.0 + plasmaB[x] * tint) * 0.5 + 0.5;
+
+            double normalX = faceNormalX[x];
+            double normalY = faceNormalY[x];
+            double normalZ = faceNormalZ[x];
+
+            double lightX = LIGHT_X - fragmentX;
+            double lightY = LIGHT_Y - fragmentY;
+            double lightZ = LIGHT_Z - fragmentZ;
+            double lightScale = FastRsqrt(lightX * lightX + lightY * lightY +
+                                          lightZ * lightZ);
+            lightX *= lightScale;
+            lightY *= lightScale;
+            lightZ *= lightScale;
+            double diff =
+                normalX * lightX + normalY * lightY + normalZ * lightZ;
+
+            double viewDirectionX = viewX - fragmentX;
+            double viewDirectionY = viewY - fragmentY;
+            double viewDirectionZ = viewZ - fragmentZ;
+            double viewScale = FastRsqrt(viewDirectionX * viewDirectionX +
+                                         viewDirectionY * viewDirectionY +
+                                         viewDirectionZ * viewDirectionZ);
+
+            // reflect(-light, normal) = 2 * dot(normal, light) * normal - light
+            double reflectX = 2.0 * diff * normalX - lightX;
+            double reflectY = 2.0 * diff * normalY - lightY;
+            double reflectZ = 2.0 * diff * normalZ - lightZ;
+            double spec = (viewDirectionX * reflectX +
+                           viewDirectionY * reflectY +
+                           viewDirectionZ * reflectZ) *
+                          viewScale;
+            // pow(max(spec, 0), 32) by repeated squaring.
+            spec = PositivePart(spec);
+            spec *= spec;
+            spec *= spec;
+            spec *= spec;
+            spec *= spec;
+            spec *= spec;
+
+            double light = (AMBIENT_STRENGTH + PositivePart(diff) +
+                            SPECULAR_STRENGTH * spec) *
+                           coverage[x];
+
+            int red = ScaleChannel(light * r);
+            int green = ScaleChannel(light * g);
+            int blue = ScaleChannel(light * b);
+            Uint32 color = (Uint32)((red << 16) | (green << 8) | blue);
+            if (depth == OUTPUT_DEPTH_16) {
+                row16[x] = PackRGB565(
+                    color, GetBayerThreshold(tile->x0 + x, tile->y0 + y));
+            } else {
+                row[x] = color;
+            }
+        }
+    }
+}
+
+KERNEL_INLINE void ShadeTileBody(const FrameSetup *setup, const Tile *tile,
+                                 Uint32 *pixels) {
+    ShadeTilePixels(setup, tile, pixels, OUTPUT_DEPTH_32);
+}
+
+KERNEL_INLINE void ShadeTile16Body(const FrameSetup *setup, const Tile *tile,
+                                   Uint16 *pixels) {
+    ShadeTilePixels(setup, tile, pixels, OUTPUT_DEPTH_16);
+}
+
+DEFINE_KERNEL_VARIANTS(ShadeTileKernel, ShadeTile,
+                       (const FrameSetup *setup, const Tile *tile,
+                        Uint32 *pixels),
+                       (setup, tile, pixels));
+
+DEFINE_KERNEL_VARIANTS(ShadeTile16Kernel, ShadeTile16,
+                       (const FrameSetup *setup, const Tile *tile,
+                        Uint16 *pixels),
+                       (setup, tile, pixels));
+
+// Rasterizes and shades every tile in a band of tile rows, one tile at a time.
+// Worker i always draws the same band, the rows it first touched.
+void DrawTileRows(void *data, int row0, int row1) {
+    const FrameSetup *setup = data;
+    Tile tile;
+    PerfSample start, end;
+
+    if (perfEnabled) {
+        ReadPerfCounters(&start);
+    }
+    for (int tileRow = row0; tileRow < row1; tileRow++) {
+        for (int x0 = 0; x0 < width; x0 += TILE_SIZE) {
+            tile.x0 = x0;
+            tile.y0 = tileRow * TILE_SIZE;
+            tile.width = SDL_min(TILE_SIZE, width - x0);
+            tile.height = SDL_min(TILE_SIZE, height - tile.y0);
+
+            rasterTile(setup, &tile);
+            if (outputDepth == OUTPUT_DEPTH_16) {
+                shadeTile16(setup, &tile, pixelBuffer16);
+            } else {
+                shadeTile(setup, &tile, pixelBuffer);
+            }
+        }
+    }
+    if (perfEnabled) {
+        ReadPerfCounters(&end);
+        AddPerfCounters(&perfCounters, &start, &end);
+    }
+}
+
+void DrawFrame(double elapsedTimeSecs) {
+    SetupFrame(&frameSetup, elapsedTimeSecs);
+    RunWorkers(&workerPool, DrawTileRows, &frameSetup, tileRows);
+}
+
+void DestroySDL(void) {
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+int main(int argc, char *argv[]) {
+    char opt;
+    while ((opt = getopt(argc, argv, ":w:h:fk:j:Npt:m:b:B:JR:")) != -1) {
+        switch (opt) {
+        case 'w':
+            width = strtol(optarg, (char **)NULL, 10);
+            if (width <= 0) {
+                fprintf(stderr, "invalid value for w: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            height = strtol(optarg, (char **)NULL, 10);
+            if (height <= 0) {
+                fprintf(stderr, "invalid value for h: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            fullscreen = 1;
+            break;
+        case 'k':
+            if (ParseKernel(optarg, &kernel) != 0) {
+                fprintf(stderr, "invalid value for kernel: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            kernelOverridden = 1;
+            break;
+        case 'j':
+            workerCount = strtol(optarg, (char **)NULL, 10);
+            if (workerCount <= 0 || workerCount > MAX_WORKERS) {
+                fprintf(stderr, "invalid value for j: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'N':
+            reportPlacement = 1;
+            break;
+        case 'p':
+            perfEnabled = 1;
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        case 'J':
+            jitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &realtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            jitter.enabled = 1;
+            break;
+        case 'm':
+            if (ParseShmRingOption(optarg, shmRingName, sizeof(shmRingName),
+                                   &shmRingSlots) != 0) {
+                fprintf(stderr, "invalid value for shm ring: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'B':
+            if (ParseBenchmarkFrames(optarg, &benchmark) != 0) {
+                fprintf(stderr, "invalid value for benchmark frames: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            outputDepth = strtol(optarg, (char **)NULL, 10);
+            if (outputDepth != OUTPUT_DEPTH_32 &&
+                outputDepth != OUTPUT_DEPTH_16) {
+                fprintf(stderr, "invalid value for output depth: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+
+    // The ring carries XRGB8888 frames only.
+    if (outputDepth == OUTPUT_DEPTH_16 && shmRingName[0] != '\0') {
+        fprintf(stderr, "16 bit output can not be combined with -m\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&realtime);
+
+    if (ChooseWorkerCount(&realtime, &workerCount, MAX_WORKERS) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (perfEnabled && ProbePerfCounters() != 0) {
+        perfEnabled = 0;
+    }
+
+    if (!kernelOverridden) {
+        kernel = DetectKernel();
+    } else if (!IsKernelSupported(kernel)) {
+        fprintf(stderr, "kernel %s is not supported on this cpu\n",
+                GetKernelName(kernel));
+        return EXIT_FAILURE;
+    }
+    rasterTile = RasterTileVariants[kernel];
+    shadeTile = ShadeTileVariants[kernel];
+    shadeTile16 = ShadeTile16Variants[kernel];
+    LogInfo("using %s kernels", GetKernelName(kernel));
+
+    if (InitSDL() != 0) {
+        fprintf(stderr, "error initializing SDL, %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    int refreshRate = GetDisplayRefreshRate(displayMode);
+    const double targetSecsPerFrame = 1.0 / (double)refreshRate;
+    LogInfo("display refresh rate %d, target secs per frame %f", refreshRate,
+            targetSecsPerFrame);
+
+    if (CreateWorkerPool(&workerPool, workerCount) != 0) {
+        LogError("failed to create %d workers, %s", workerCount,
+                 SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    LogInfo("rendering %dx%d tiles with %d workers", TILE_SIZE, TILE_SIZE,
+            workerCount);
+
+    // The pixel buffer is padded to whole tile rows, and first touched one
+    // tile row at a time so each band lands next to the worker drawing it.
+    tileRows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    void *pixels = AllocFrameMemory(&pixelMemory, &workerPool,
+                                    (size_t)width * TILE_SIZE *
+                                        GetOutputBytesPerPixel(outputDepth),
+                                    tileRows);
+    if (pixels == NULL) {
+        LogError("failed to allocate pixel buffer %dx%d", width, height);
+        return EXIT_FAILURE;
+    }
+    if (outputDepth == OUTPUT_DEPTH_16) {
+        pixelBuffer16 = pixels;
+    } else {
+        pixelBuffer = pixels;
+    }
+    if (reportPlacement) {
+        ReportWorkerPinning(&workerPool);
+        ReportFramePlacement("pixel buffer", &pixelMemory, &workerPool,
+                             tileRows);
+    }
+
+    if (shmRingName[0] != '\0') {
+        if (CreateShmRing(&shmRing, shmRingName, shmRingSlots, width,
+                          height) != 0) {
+            LogError("failed to create shm ring %s", shmRingName);
+            return EXIT_FAILURE;
+        }
+        LogInfo("publishing frames to shm ring %s with %d slots", shmRingName,
+                shmRingSlots);
+    }
+
+    Mat4Perspective(0.785398, (float)width / (float)height, 1.0f, 10.0f,
+                    projection);
+
+    double elapsedTimeSecs = 0.0;
+    double drawMsSum = 0.0;
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+    Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
+    int metricsFrames = 0;
+    SDL_Event event;
+    int isRunning = 1;
+    StartJitterHistogram(&jitter, targetSecsPerFrame);
+    LockRealtimeMemory(&realtime);
+    StartBenchmark(&benchmark);
+
+    while (isRunning) {
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
+                isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
+            }
+        }
+        TraceEnd("poll events", traceStart);
+
+        elapsedTimeSecs += targetSecsPerFrame;
+
+        Uint64 drawStartCounter = SDL_GetPerformanceCounter();
+        DrawFrame(elapsedTimeSecs);
+        TraceEnd("DrawFrame", drawStartCounter);
+        double drawMs =
+            GetElapsedTimeMs(drawStartCounter, SDL_GetPerformanceCounter());
+        drawMsSum += drawMs;
+        metricsFrames++;
+
+        if (shmRing.header != NULL) {
+            traceStart = TraceBegin();
+            PublishShmRingFrame(&shmRing, pixelBuffer, width, height,
+                                elapsedTimeSecs);
+            TraceEnd("shm publish", traceStart);
+        }
+
+        // Manually cap the frame rate, unless benchmarking
+        traceStart = TraceBegin();
+        if (benchmark.frames == 0) {
+            SleepUntilFrameTime(&realtime, lastCounter, targetSecsPerFrame);
+            while (GetElapsedTimeSecs(lastCounter,
+                                      SDL_GetPerformanceCounter()) <
+                   targetSecsPerFrame) {
+            }
+            assert(GetElapsedTimeSecs(lastCounter,
+                                      SDL_GetPerformanceCounter()) >=
+                   targetSecsPerFrame);
+        }
+
+        Uint64 endCounter = SDL_GetPerformanceCounter();
+        TraceEnd("pacing wait", traceStart);
+
+        traceStart = TraceBegin();
+        Uint64 uploadCounter = SDL_GetPerformanceCounter();
+        SDL_UpdateTexture(texture, NULL, pixels,
+                          width * GetOutputBytesPerPixel(outputDepth));
+        AddUploadTime(&uploadStats, GetElapsedTimeMs(
+                                        uploadCounter,
+                                        SDL_GetPerformanceCounter()));
+        TraceEnd("texture upload", traceStart);
+
+        traceStart = TraceBegin();
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+        TraceEnd("present", traceStart);
+        AddJitterFrame(&jitter, SDL_GetPerformanceCounter());
+
+        double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
+        double fps = (double)SDL_GetPerformanceFrequency() /
+                     (double)(endCounter - lastCounter);
+
+        if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
+            1000.0) {
+            char counters[256] = "";
+            if (perfEnabled) {
+                PerfSample sample;
+                TakePerfTotals(&perfCounters, &sample);
+                FormatPerfCounters(counters, sizeof(counters), &sample,
+                                   metricsFrames, (double)width * height);
+            }
+
+            char upload[64];
+            FormatUploadStats(upload, sizeof(upload), &uploadStats, width,
+                              height, outputDepth);
+
+            printf("ms/f: %f, fps: %f, draw ms/f: %f%s%s\r", msPerFrame, fps,
+                   drawMsSum / metricsFrames, upload, counters);
+            fflush(stdout);
+            drawMsSum = 0.0;
+            metricsFrames = 0;
+            metricsPrintCounter = SDL_GetPerformanceCounter();
+        }
+
+        if (AddBenchmarkFrame(&benchmark, drawMs)) {
+            isRunning = 0;
+        }
+
+        lastCounter = endCounter;
+    }
+    PrintBenchmark(&benchmark);
+    PrintJitterHistogram(&jitter);
+
+    DestroyShmRing(&shmRing);
+    FreeFrameMemory(&pixelMemory);
+    DestroyWorkerPool(&workerPool);
+
+    if (tracePath != NULL) {
+        if (WriteTrace(tracePath) != 0) {
+            LogError("failed to write trace to %s", tracePath);
+        } else {
+            LogInfo("wrote trace to %s", tracePath);
+        }
+    }
+
+    DestroySDL();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+#ifndef STRIPIMAGE_H_INCLUDED
+#define STRIPIMAGE_H_INCLUDED
+
+#include "framebuffer.h"
+#include "trace.h"
+#include "workers.h"
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A strip image is a single frame too large to keep in memory, like a 32k x
+// 32k print, rendered a horizontal strip of rows at a time and streamed out as
+// one binary PPM image. The workers split each strip into bands while a writer
+// thread writes out the strip before it, so rendering overlaps the output and
+// peak memory is STRIP_IMAGE_BUFFERS strips, set by the strip height alone.
+
+#define DEFAULT_STRIP_ROWS 64
+#define STRIP_IMAGE_BUFFERS 2
+
+// The strip handed to the render job, rows of packed RGB bytes holding the
+// image rows from y0 on. The job renders the rows [y0, y1) of the strip.
+typedef struct {
+    unsigned char *pixels;
+    size_t rowBytes;
+    int y0;
+    int rows;
+    void *data;
+} ImageStrip;
+
+typedef struct {
+    // Rows per strip.
+    int rows;
+    int width;
+    int height;
+    FrameMemory memory[STRIP_IMAGE_BUFFERS];
+    ImageStrip strips[STRIP_IMAGE_BUFFERS];
+    FILE *output;
+    const char *name;
+    // Counts the strips rendered and not written yet, and the buffers free
+    // to render into.
+    SDL_sem *rendered;
+    SDL_sem *free;
+    atomic_int failed;
+} StripImage;
+
+static inline int ParseStripRows(const char *arg, StripImage *image) {
+    char *end;
+    image->rows = strtol(arg, &end, 10);
+    return *end != '\0' || image->rows <= 0 ? -1 : 0;
+}
+
+// Writes the rendered strips in order until it is handed an empty one. After
+// a failed write it keeps taking strips without writing them, so the render
+// loop never waits on a buffer that won't be freed.
+static inline int WriteStrips(void *data) {
+    StripImage *image = data;
+    SetTraceThreadName("strip writer");
+
+    for (int strip = 0;; strip++) {
+        SDL_SemWait(image->rendered);
+        const ImageStrip *current =
+            &image->strips[strip % STRIP_IMAGE_BUFFERS];
+        if (current->rows == 0) {
+            break;
+        }
+
+        Uint64 traceStart = TraceBegin();
+        size_t bytes = current->rowBytes * current->rows;
+        if (!image->failed &&
+            fwrite(current->pixels, 1, bytes, image->output) != bytes) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "failed to write rows %d-%d to %s", current->y0,
+                         current->y0 + current->rows - 1, image->name);
+            image->failed = 1;
+        }
+        TraceEnd("write strip", traceStart);
+        SDL_SemPost(image->free);
+    }
+
+    return 0;
+}
+
+static inline void DestroyStripImage(StripImage *image) {
+    SDL_DestroySemaphore(image->free);
+    SDL_DestroySemaphore(image->rendered);
+    for (int i = 0; i < STRIP_IMAGE_BUFFERS; i++) {
+        FreeFrameMemory(&image->memory[i]);
+    }
+}
+
+// Renders the image a strip at a time, running job over the bands of each
+// strip with data in the strip's data, and writes it to path, or stdout for
+// "-".
+static inline int WriteStripImage(StripImage *image, WorkerPool *pool,
+                                  BandJob job, void *data, const char *path) {
+    size_t rowBytes = (size_t)image->width * 3;
+    int rows = image->rows < image->height ? image->rows : image->height;
+
+    image->rendered = NULL;
+    image->free = NULL;
+    for (int i = 0; i < STRIP_IMAGE_BUFFERS; i++) {
+        image->memory[i].data = NULL;
+    }
+    for (int i = 0; i < STRIP_IMAGE_BUFFERS; i++) {
+        image->strips[i].pixels =
+            AllocFrameMemory(&image->memory[i], pool, rowBytes, rows);
+        image->strips[i].rowBytes = rowBytes;
+        image->strips[i].data = data;
+        if (image->strips[i].pixels == NULL) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "failed to allocate strip %dx%d", image->width, rows);
+            DestroyStripImage(image);
+            return -1;
+        }
+    }
+
+    image->name = path;
+    image->output = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (image->output == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "failed to open %s for writing", path);
+        DestroyStripImage(image);
+        return -1;
+    }
+
+    image->failed = 0;
+    image->rendered = SDL_CreateSemaphore(0);
+    image->free = SDL_CreateSemaphore(STRIP_IMAGE_BUFFERS);
+    SDL_Thread *writer = NULL;
+    if (image->rendered != NULL && image->free != NULL) {
+        writer = SDL_CreateThread(WriteStrips, "strip writer", image);
+    }
+    if (writer == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "failed to start the strip writer, %s", SDL_GetError());
+        if (image->output != stdout) {
+            fclose(image->output);
+        }
+        DestroyStripImage(image);
+        return -1;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "rendering a %dx%d image in strips of %d rows, %f MB of "
+                "strips",
+                image->width, image->height, rows,
+                (double)rowBytes * rows * STRIP_IMAGE_BUFFERS /
+                    (1024.0 * 1024.0));
+    fprintf(image->output, "P6\n%d %d\n255\n", image->width, image->height);
+
+    // Time spent waiting for the writer to free a buffer, which is the part
+    // of the run bound by the output rather than by rendering.
+    double waitSecs = 0.0;
+    Uint64 startCounter = SDL_GetPerformanceCounter();
+    int strip = 0;
+    for (int y0 = 0; y0 < image->height && !image->failed; y0 += rows) {
+        Uint64 waitCounter = SDL_GetPerformanceCounter();
+        SDL_SemWait(image->free);
+        TraceEnd("strip wait", waitCounter);
+        waitSecs += (double)(SDL_GetPerformanceCounter() - waitCounter) /
+                    SDL_GetPerformanceFrequency();
+
+        ImageStrip *current = &image->strips[strip % STRIP_IMAGE_BUFFERS];
+        current->y0 = y0;
+        current->rows = image->height - y0 < rows ? image->height - y0 : rows;
+        Uint64 traceStart = TraceBegin();
+        RunWorkers(pool, job, current, current->rows);
+        TraceEnd("render strip", traceStart);
+        SDL_SemPost(image->rendered);
+        strip++;
+    }
+
+    // An empty strip stops the writer once it has written the others.
+    SDL_SemWait(image->free);
+    image->strips[strip % STRIP_IMAGE_BUFFERS].rows = 0;
+    SDL_SemPost(image->rendered);
+    SDL_WaitThread(writer, NULL);
+    double secs = (double)(SDL_GetPerformanceCounter() - startCounter) /
+                  SDL_GetPerformanceFrequency();
+
+    int result = image->failed ? -1 : 0;
+    if (image->output == stdout) {
+        fflush(image->output);
+    } else if (fclose(image->output) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "failed to close %s",
+                     path);
+        result = -1;
+    }
+    DestroyStripImage(image);
+
+    if (result == 0) {
+        double megapixels = (double)image->width * image->height / 1.0e6;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "rendered %f MP in %d strips in %f s, %f MP/s, waited %f "
+                    "s on the writer",
+                    megapixels, strip, secs, megapixels / secs, waitSecs);
+    }
+
+    return result;
+}
+
+#endif
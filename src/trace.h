@@ -0,0 +1,171 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRACE_EVENTS_PER_THREAD (1 << 18)
+#define MAX_TRACE_THREADS 80
+#define TRACE_THREAD_NAME_SIZE 32
+
+// Records spans into a buffer owned by the thread that records them, so
+// tracing takes no locks. Each thread allocates its buffer once, when it is
+// named or, for the thread that starts the trace, in StartTrace, so the first
+// span of a frame doesn't pay for the allocation. Threads that never name
+// themselves get a buffer the first time they record. Everything is written
+// out as Chrome trace event JSON only when the demo exits. Spans past the end
+// of a full buffer are dropped, and so are the spans of threads past
+// MAX_TRACE_THREADS.
+
+typedef struct {
+    const char *name;
+    Uint64 start;
+    Uint64 end;
+} TraceEvent;
+
+typedef struct {
+    TraceEvent *events;
+    int count;
+    int dropped;
+    char name[TRACE_THREAD_NAME_SIZE];
+} TraceBuffer;
+
+static int traceEnabled = 0;
+static Uint64 traceStartCounter = 0;
+static TraceBuffer traceBuffers[MAX_TRACE_THREADS];
+static atomic_int traceBufferCount = 0;
+// Handed to the threads past MAX_TRACE_THREADS, so they only claim a buffer
+// once. It has no events, so their spans are dropped.
+static TraceBuffer traceOverflowBuffer;
+static _Thread_local TraceBuffer *traceThreadBuffer = NULL;
+static _Thread_local char traceThreadName[TRACE_THREAD_NAME_SIZE] = "main";
+
+static inline TraceBuffer *GetTraceBuffer(void) {
+    if (traceThreadBuffer != NULL) {
+        return traceThreadBuffer;
+    }
+
+    int index = atomic_fetch_add(&traceBufferCount, 1);
+    if (index >= MAX_TRACE_THREADS) {
+        traceThreadBuffer = &traceOverflowBuffer;
+        return traceThreadBuffer;
+    }
+
+    TraceBuffer *buffer = &traceBuffers[index];
+    buffer->events = malloc(TRACE_EVENTS_PER_THREAD * sizeof(*buffer->events));
+    snprintf(buffer->name, sizeof(buffer->name), "%s", traceThreadName);
+    traceThreadBuffer = buffer;
+
+    return buffer;
+}
+
+static inline void StartTrace(void) {
+    traceEnabled = 1;
+    traceStartCounter = SDL_GetPerformanceCounter();
+    GetTraceBuffer();
+}
+
+// Names the calling thread in the trace and, when tracing, allocates its
+// buffer. Must be called before the thread records its first span.
+static inline void SetTraceThreadName(const char *name) {
+    snprintf(traceThreadName, sizeof(traceThreadName), "%s", name);
+    if (traceEnabled) {
+        GetTraceBuffer();
+    }
+}
+
+static inline Uint64 TraceBegin(void) {
+    return traceEnabled ? SDL_GetPerformanceCounter() : 0;
+}
+
+// Records a span from a counter returned by TraceBegin until now. The name
+// must outlive the trace, so it is normally a string literal.
+static inline void TraceEnd(const char *name, Uint64 start) {
+    if (!traceEnabled) {
+        return;
+    }
+
+    Uint64 end = SDL_GetPerformanceCounter();
+    TraceBuffer *buffer = GetTraceBuffer();
+    if (buffer == NULL || buffer->events == NULL) {
+        return;
+    }
+    if (buffer->count == TRACE_EVENTS_PER_THREAD) {
+        buffer->dropped++;
+        return;
+    }
+
+    TraceEvent *event = &buffer->events[buffer->count++];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+}
+
+static inline double GetTraceMicros(Uint64 counter) {
+    return (double)(counter - traceStartCounter) * 1000000.0 /
+           SDL_GetPerformanceFrequency();
+}
+
+// Writes every recorded span to a Chrome trace event JSON file, which can be
+// opened in chrome://tracing or Perfetto, and frees the buffers. Every thread
+// that recorded spans must have finished recording.
+static inline int WriteTrace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int threads = atomic_load(&traceBufferCount);
+    int untraced = threads - MAX_TRACE_THREADS;
+    if (threads > MAX_TRACE_THREADS) {
+        threads = MAX_TRACE_THREADS;
+    }
+
+    int dropped = 0;
+    const char *separator = "";
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (int tid = 0; tid < threads; tid++) {
+        TraceBuffer *buffer = &traceBuffers[tid];
+
+        fprintf(file,
+                "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                separator, tid, buffer->name);
+        separator = ",";
+
+        for (int i = 0; i < buffer->count; i++) {
+            TraceEvent *event = &buffer->events[i];
+            double start = GetTraceMicros(event->start);
+            double end = GetTraceMicros(event->end);
+
+            fprintf(file,
+                    ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, tid, start, end - start);
+        }
+
+        dropped += buffer->dropped;
+        free(buffer->events);
+        buffer->events = NULL;
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        return -1;
+    }
+    if (dropped > 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "trace buffers were full, dropped %d spans", dropped);
+    }
+    if (untraced > 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "%d threads past the first %d were not traced", untraced,
+                    MAX_TRACE_THREADS);
+    }
+
+    return 0;
+}
+
+#endif
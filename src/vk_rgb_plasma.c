@@ -0,0 +1,1153 @@
+#include "realtime.h"
+#include "trace.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_vulkan.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vulkan/vulkan.h>
+
+#define WINDOW_TITLE "VK RGB Plasma"
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+#define DEFAULT_REFRESH_RATE 60
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT 3
+#define MAX_SWAPCHAIN_IMAGES 8
+#define PLASMA_SCALE 20.0f
+#define VERTEX_SHADER_PATH "src/shaders/vk_rgb_plasma.vert.spv"
+#define FRAGMENT_SHADER_PATH "src/shaders/generated/classic.vk.frag.spv"
+
+#define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+#define LogInfo(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+
+// Resolution and scale only change with the swapchain, so they are recorded
+// into the command buffers as push constants. The time changes every frame
+// and lives in a small uniform buffer per swapchain image, which keeps the
+// command buffers valid from one frame to the next.
+typedef struct {
+    int32_t resolution[2];
+    float scale;
+} PushConstants;
+
+typedef struct {
+    float time;
+} FrameUniforms;
+
+typedef struct {
+    VkImageView view;
+    VkFramebuffer framebuffer;
+    VkCommandBuffer commandBuffer;
+    VkBuffer uniformBuffer;
+    VkDeviceMemory uniformMemory;
+    FrameUniforms *uniforms;
+    VkDescriptorSet descriptorSet;
+    VkFence inFlight;
+    // Signalled when the image is drawn and waited on by its present. The
+    // present of an image may still hold it when the next frame in flight
+    // submits, so it belongs to the image rather than to the frame.
+    VkSemaphore renderFinished;
+} SwapchainImage;
+
+SDL_DisplayMode gDisplayMode;
+SDL_Window *gWindow = NULL;
+
+VkInstance gInstance = VK_NULL_HANDLE;
+VkSurfaceKHR gSurface = VK_NULL_HANDLE;
+VkPhysicalDevice gPhysicalDevice = VK_NULL_HANDLE;
+VkDevice gDevice = VK_NULL_HANDLE;
+VkQueue gQueue = VK_NULL_HANDLE;
+uint32_t gQueueFamily = 0;
+VkCommandPool gCommandPool = VK_NULL_HANDLE;
+VkDescriptorSetLayout gDescriptorSetLayout = VK_NULL_HANDLE;
+VkPipelineLayout gPipelineLayout = VK_NULL_HANDLE;
+VkShaderModule gVertexShader = VK_NULL_HANDLE;
+VkShaderModule gFragmentShader = VK_NULL_HANDLE;
+
+VkSwapchainKHR gSwapchain = VK_NULL_HANDLE;
+VkFormat gSwapchainFormat = VK_FORMAT_UNDEFINED;
+VkExtent2D gSwapchainExtent = {0, 0};
+VkRenderPass gRenderPass = VK_NULL_HANDLE;
+VkPipeline gPipeline = VK_NULL_HANDLE;
+VkDescriptorPool gDescriptorPool = VK_NULL_HANDLE;
+SwapchainImage gImages[MAX_SWAPCHAIN_IMAGES];
+uint32_t gImageCount = 0;
+
+VkSemaphore gImageAvailable[MAX_FRAMES_IN_FLIGHT];
+VkFence gFrameFences[MAX_FRAMES_IN_FLIGHT];
+int gFrame = 0;
+
+int gWidth = DEFAULT_WIDTH;
+int gHeight = DEFAULT_HEIGHT;
+int gFullscreen = 0;
+int gFramesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+int gSwapchainStale = 0;
+VkPresentModeKHR gPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+// The CPU milliseconds DrawFrame spent updating and submitting, without the
+// waits for fences, the acquire and the present.
+double gSubmitMs = 0.0;
+const char *gTracePath = NULL;
+Realtime gRealtime = {0};
+JitterHistogram gJitter = {0};
+
+double GetElapsedTimeSecs(Uint64 start, Uint64 end) {
+    return (double)(end - start) / SDL_GetPerformanceFrequency();
+}
+
+double GetElapsedTimeMs(Uint64 start, Uint64 end) {
+    return (double)((end - start) * 1000.0) / SDL_GetPerformanceFrequency();
+}
+
+int GetDisplayRefreshRate(SDL_DisplayMode gDisplayMode) {
+    int result = gDisplayMode.refresh_rate;
+
+    if (result == 0) {
+        return DEFAULT_REFRESH_RATE;
+    }
+
+    return result;
+}
+
+int CheckVk(VkResult result, const char *call) {
+    if (result != VK_SUCCESS) {
+        LogError("%s failed, VkResult %d", call, result);
+        return -1;
+    }
+
+    return 0;
+}
+
+int InitSDL(void) {
+    SDL_Init(SDL_INIT_VIDEO);
+
+    if (SDL_GetDesktopDisplayMode(0, &gDisplayMode) != 0) {
+        return -1;
+    }
+
+    gWindow = SDL_CreateWindow(
+        WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, gWidth,
+        gHeight, SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+    if (gWindow == NULL) {
+        return -1;
+    }
+    LogInfo("window created with size %dx%d", gWidth, gHeight);
+
+    if (gFullscreen) {
+        SDL_SetWindowFullscreen(gWindow, SDL_WINDOW_FULLSCREEN_DESKTOP);
+    }
+
+    SDL_ShowCursor(SDL_DISABLE);
+
+    return 0;
+}
+
+char *ReadFile(const char *filepath, size_t *size) {
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        fileSize = ftell(file);
+    }
+    if (fileSize < 0) {
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+
+    char *buffer = malloc((fileSize + 1) * sizeof(*buffer));
+    if (buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t result = fread(buffer, 1, fileSize, file);
+    fclose(file);
+    if ((long)result != fileSize) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[fileSize] = 0;
+    *size = (size_t)fileSize;
+    return buffer;
+}
+
+int CreateShaderModule(const char *path, VkShaderModule *module) {
+    size_t size = 0;
+    char *code = ReadFile(path, &size);
+    if (code == NULL) {
+        LogError("could not read file %s", path);
+        return -1;
+    }
+
+    VkShaderModuleCreateInfo info = {0};
+    info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    info.codeSize = size;
+    info.pCode = (const uint32_t *)code;
+
+    VkResult result = vkCreateShaderModule(gDevice, &info, NULL, module);
+    free(code);
+
+    return CheckVk(result, "vkCreateShaderModule");
+}
+
+int CreateInstance(void) {
+    unsigned int extensionCount = 0;
+    if (!SDL_Vulkan_GetInstanceExtensions(gWindow, &extensionCount, NULL)) {
+        LogError("could not get vulkan instance extensions, %s",
+                 SDL_GetError());
+        return -1;
+    }
+
+    const char **extensions = malloc(extensionCount * sizeof(*extensions));
+    if (extensions == NULL) {
+        return -1;
+    }
+    SDL_Vulkan_GetInstanceExtensions(gWindow, &extensionCount, extensions);
+
+    VkApplicationInfo appInfo = {0};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = WINDOW_TITLE;
+    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    VkInstanceCreateInfo info = {0};
+    info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    info.pApplicationInfo = &appInfo;
+    info.enabledExtensionCount = extensionCount;
+    info.ppEnabledExtensionNames = extensions;
+
+    VkResult result = vkCreateInstance(&info, NULL, &gInstance);
+    free(extensions);
+    if (CheckVk(result, "vkCreateInstance") != 0) {
+        return -1;
+    }
+
+    if (!SDL_Vulkan_CreateSurface(gWindow, gInstance, &gSurface)) {
+        LogError("could not create vulkan surface, %s", SDL_GetError());
+        return -1;
+    }
+
+    return 0;
+}
+
+// Picks the first device with a queue family that can both draw and present
+// to the window, which on a machine without a GPU is lavapipe.
+int PickPhysicalDevice(void) {
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(gInstance, &deviceCount, NULL);
+    if (deviceCount == 0) {
+        LogError("no vulkan devices found");
+        return -1;
+    }
+
+    VkPhysicalDevice *devices = malloc(deviceCount * sizeof(*devices));
+    if (devices == NULL) {
+        return -1;
+    }
+    vkEnumeratePhysicalDevices(gInstance, &deviceCount, devices);
+
+    for (uint32_t i = 0;
+         i < deviceCount && gPhysicalDevice == VK_NULL_HANDLE; i++) {
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &familyCount,
+                                                 NULL);
+        VkQueueFamilyProperties *families =
+            malloc(familyCount * sizeof(*families));
+        if (families == NULL) {
+            break;
+        }
+        vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &familyCount,
+                                                 families);
+
+        for (uint32_t family = 0; family < familyCount; family++) {
+            VkBool32 canPresent = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], family, gSurface,
+                                                 &canPresent);
+            if ((families[family].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                canPresent) {
+                gPhysicalDevice = devices[i];
+                gQueueFamily = family;
+                break;
+            }
+        }
+        free(families);
+    }
+    free(devices);
+
+    if (gPhysicalDevice == VK_NULL_HANDLE) {
+        LogError("no vulkan device can present to the window");
+        return -1;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gPhysicalDevice, &properties);
+    LogInfo("using vulkan device %s", properties.deviceName);
+
+    return 0;
+}
+
+int CreateDevice(void) {
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo = {0};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = gQueueFamily;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &priority;
+
+    const char *extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    VkDeviceCreateInfo info = {0};
+    info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    info.queueCreateInfoCount = 1;
+    info.pQueueCreateInfos = &queueInfo;
+    info.enabledExtensionCount = 1;
+    info.ppEnabledExtensionNames = extensions;
+
+    if (CheckVk(vkCreateDevice(gPhysicalDevice, &info, NULL, &gDevice),
+                "vkCreateDevice") != 0) {
+        return -1;
+    }
+    vkGetDeviceQueue(gDevice, gQueueFamily, 0, &gQueue);
+
+    VkCommandPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = gQueueFamily;
+
+    return CheckVk(vkCreateCommandPool(gDevice, &poolInfo, NULL, &gCommandPool),
+                   "vkCreateCommandPool");
+}
+
+// Objects that do not depend on the swapchain: shaders, the layouts and the
+// per frame in flight synchronisation.
+int CreateFixedObjects(void) {
+    if (CreateShaderModule(VERTEX_SHADER_PATH, &gVertexShader) != 0 ||
+        CreateShaderModule(FRAGMENT_SHADER_PATH, &gFragmentShader) != 0) {
+        return -1;
+    }
+
+    VkDescriptorSetLayoutBinding binding = {0};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {0};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = 1;
+    setLayoutInfo.pBindings = &binding;
+    if (CheckVk(vkCreateDescriptorSetLayout(gDevice, &setLayoutInfo, NULL,
+                                            &gDescriptorSetLayout),
+                "vkCreateDescriptorSetLayout") != 0) {
+        return -1;
+    }
+
+    VkPushConstantRange pushRange = {0};
+    pushRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &gDescriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushRange;
+    if (CheckVk(vkCreatePipelineLayout(gDevice, &layoutInfo, NULL,
+                                       &gPipelineLayout),
+                "vkCreatePipelineLayout") != 0) {
+        return -1;
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo = {0};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkFenceCreateInfo fenceInfo = {0};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (int i = 0; i < gFramesInFlight; i++) {
+        if (CheckVk(vkCreateSemaphore(gDevice, &semaphoreInfo, NULL,
+                                      &gImageAvailable[i]),
+                    "vkCreateSemaphore") != 0 ||
+            CheckVk(vkCreateFence(gDevice, &fenceInfo, NULL, &gFrameFences[i]),
+                    "vkCreateFence") != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+const char *GetPresentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    default:
+        return "fifo";
+    }
+}
+
+// FIFO is the only present mode every device supports, so a mode asked for
+// with -p falls back to it.
+VkPresentModeKHR ChoosePresentMode(void) {
+    if (gPresentMode == VK_PRESENT_MODE_FIFO_KHR) {
+        return gPresentMode;
+    }
+
+    VkPresentModeKHR modes[16];
+    uint32_t modeCount = sizeof(modes) / sizeof(modes[0]);
+    VkResult result = vkGetPhysicalDeviceSurfacePresentModesKHR(
+        gPhysicalDevice, gSurface, &modeCount, modes);
+    if (result == VK_SUCCESS || result == VK_INCOMPLETE) {
+        for (uint32_t i = 0; i < modeCount; i++) {
+            if (modes[i] == gPresentMode) {
+                return gPresentMode;
+            }
+        }
+    }
+
+    LogInfo("warning: %s present mode not supported, using fifo",
+            GetPresentModeName(gPresentMode));
+    gPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    return gPresentMode;
+}
+
+int CreateSwapchain(void) {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gPhysicalDevice, gSurface,
+                                              &capabilities);
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(gPhysicalDevice, gSurface,
+                                         &formatCount, NULL);
+    VkSurfaceFormatKHR *formats = malloc(formatCount * sizeof(*formats));
+    if (formats == NULL || formatCount == 0) {
+        free(formats);
+        LogError("no vulkan surface formats");
+        return -1;
+    }
+    vkGetPhysicalDeviceSurfaceFormatsKHR(gPhysicalDevice, gSurface,
+                                         &formatCount, formats);
+
+    // Like the default GL framebuffer, the shader writes colors that are
+    // already gamma encoded, so a UNORM format is preferred over SRGB.
+    VkSurfaceFormatKHR format = formats[0];
+    for (uint32_t i = 0; i < formatCount; i++) {
+        if (formats[i].format == VK_FORMAT_B8G8R8A8_UNORM ||
+            formats[i].format == VK_FORMAT_R8G8B8A8_UNORM) {
+            format = formats[i];
+            break;
+        }
+    }
+    free(formats);
+    gSwapchainFormat = format.format;
+
+    if (capabilities.currentExtent.width != UINT32_MAX) {
+        gSwapchainExtent = capabilities.currentExtent;
+    } else {
+        int drawableWidth, drawableHeight;
+        SDL_Vulkan_GetDrawableSize(gWindow, &drawableWidth, &drawableHeight);
+        gSwapchainExtent.width = (uint32_t)drawableWidth;
+        gSwapchainExtent.height = (uint32_t)drawableHeight;
+    }
+
+    uint32_t imageCount = capabilities.minImageCount + 1;
+    if (capabilities.maxImageCount > 0 &&
+        imageCount > capabilities.maxImageCount) {
+        imageCount = capabilities.maxImageCount;
+    }
+    if (imageCount > MAX_SWAPCHAIN_IMAGES) {
+        imageCount = MAX_SWAPCHAIN_IMAGES;
+    }
+
+    VkSwapchainCreateInfoKHR info = {0};
+    info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    info.surface = gSurface;
+    info.minImageCount = imageCount;
+    info.imageFormat = format.format;
+    info.imageColorSpace = format.colorSpace;
+    info.imageExtent = gSwapchainExtent;
+    info.imageArrayLayers = 1;
+    info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.preTransform = capabilities.currentTransform;
+    info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    info.presentMode = ChoosePresentMode();
+    info.clipped = VK_TRUE;
+
+    if (CheckVk(vkCreateSwapchainKHR(gDevice, &info, NULL, &gSwapchain),
+                "vkCreateSwapchainKHR") != 0) {
+        return -1;
+    }
+
+    VkImage images[MAX_SWAPCHAIN_IMAGES];
+    gImageCount = MAX_SWAPCHAIN_IMAGES;
+    if (CheckVk(vkGetSwapchainImagesKHR(gDevice, gSwapchain, &gImageCount,
+                                        images),
+                "vkGetSwapchainImagesKHR") != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < gImageCount; i++) {
+        VkImageViewCreateInfo viewInfo = {0};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = images[i];
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = gSwapchainFormat;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (CheckVk(vkCreateImageView(gDevice, &viewInfo, NULL,
+                                      &gImages[i].view),
+                    "vkCreateImageView") != 0) {
+            return -1;
+        }
+    }
+
+    LogInfo("swapchain created with %u images of %ux%u, %s present mode",
+            gImageCount, gSwapchainExtent.width, gSwapchainExtent.height,
+            GetPresentModeName(info.presentMode));
+
+    return 0;
+}
+
+int CreateRenderPass(void) {
+    VkAttachmentDescription attachment = {0};
+    attachment.format = gSwapchainFormat;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorReference = {0};
+    colorReference.attachment = 0;
+    colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {0};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorReference;
+
+    // The image is acquired asynchronously, so the layout transition at the
+    // start of the pass has to wait for the acquire semaphore's stage.
+    VkSubpassDependency dependency = {0};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo info = {0};
+    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    info.attachmentCount = 1;
+    info.pAttachments = &attachment;
+    info.subpassCount = 1;
+    info.pSubpasses = &subpass;
+    info.dependencyCount = 1;
+    info.pDependencies = &dependency;
+
+    return CheckVk(vkCreateRenderPass(gDevice, &info, NULL, &gRenderPass),
+                   "vkCreateRenderPass");
+}
+
+int CreatePipeline(void) {
+    VkPipelineShaderStageCreateInfo stages[2] = {{0}, {0}};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = gVertexShader;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = gFragmentShader;
+    stages[1].pName = "main";
+
+    // The vertex shader makes a full screen triangle from the vertex index,
+    // so there is no vertex input at all.
+    VkPipelineVertexInputStateCreateInfo vertexInput = {0};
+    vertexInput.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
+    inputAssembly.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkViewport viewport = {0};
+    viewport.width = (float)gSwapchainExtent.width;
+    viewport.height = (float)gSwapchainExtent.height;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor = {{0, 0}, gSwapchainExtent};
+
+    VkPipelineViewportStateCreateInfo viewportState = {0};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = &viewport;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = &scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterization = {0};
+    rasterization.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization.cullMode = VK_CULL_MODE_NONE;
+    rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterization.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample = {0};
+    multisample.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blendAttachment = {0};
+    blendAttachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo blend = {0};
+    blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend.attachmentCount = 1;
+    blend.pAttachments = &blendAttachment;
+
+    VkGraphicsPipelineCreateInfo info = {0};
+    info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount = 2;
+    info.pStages = stages;
+    info.pVertexInputState = &vertexInput;
+    info.pInputAssemblyState = &inputAssembly;
+    info.pViewportState = &viewportState;
+    info.pRasterizationState = &rasterization;
+    info.pMultisampleState = &multisample;
+    info.pColorBlendState = &blend;
+    info.layout = gPipelineLayout;
+    info.renderPass = gRenderPass;
+    info.subpass = 0;
+
+    return CheckVk(vkCreateGraphicsPipelines(gDevice, VK_NULL_HANDLE, 1, &info,
+                                             NULL, &gPipeline),
+                   "vkCreateGraphicsPipelines");
+}
+
+int FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memory;
+    vkGetPhysicalDeviceMemoryProperties(gPhysicalDevice, &memory);
+
+    for (uint32_t i = 0; i < memory.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) &&
+            (memory.memoryTypes[i].propertyFlags & properties) == properties) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+// Creates the uniform buffer of one swapchain image, host coherent and mapped
+// for as long as it lives, so updating the time is a plain store.
+int CreateUniformBuffer(SwapchainImage *image) {
+    VkBufferCreateInfo info = {0};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = sizeof(FrameUniforms);
+    info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (CheckVk(vkCreateBuffer(gDevice, &info, NULL, &image->uniformBuffer),
+                "vkCreateBuffer") != 0) {
+        return -1;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(gDevice, image->uniformBuffer, &requirements);
+    int memoryType = FindMemoryType(requirements.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (memoryType < 0) {
+        LogError("no host visible coherent memory for uniform buffers");
+        return -1;
+    }
+
+    VkMemoryAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = (uint32_t)memoryType;
+    if (CheckVk(vkAllocateMemory(gDevice, &allocateInfo, NULL,
+                                 &image->uniformMemory),
+                "vkAllocateMemory") != 0 ||
+        CheckVk(vkBindBufferMemory(gDevice, image->uniformBuffer,
+                                   image->uniformMemory, 0),
+                "vkBindBufferMemory") != 0 ||
+        CheckVk(vkMapMemory(gDevice, image->uniformMemory, 0,
+                            sizeof(FrameUniforms), 0,
+                            (void **)&image->uniforms),
+                "vkMapMemory") != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Records the one command buffer each swapchain image ever submits. Nothing
+// in it changes until the swapchain is recreated.
+int RecordCommandBuffer(SwapchainImage *image) {
+    VkCommandBufferBeginInfo beginInfo = {0};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    if (CheckVk(vkBeginCommandBuffer(image->commandBuffer, &beginInfo),
+                "vkBeginCommandBuffer") != 0) {
+        return -1;
+    }
+
+    VkRenderPassBeginInfo passInfo = {0};
+    passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    passInfo.renderPass = gRenderPass;
+    passInfo.framebuffer = image->framebuffer;
+    passInfo.renderArea.extent = gSwapchainExtent;
+
+    PushConstants constants = {
+        {(int32_t)gSwapchainExtent.width, (int32_t)gSwapchainExtent.height},
+        PLASMA_SCALE};
+
+    vkCmdBeginRenderPass(image->commandBuffer, &passInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(image->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      gPipeline);
+    vkCmdBindDescriptorSets(image->commandBuffer,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS, gPipelineLayout, 0,
+                            1, &image->descriptorSet, 0, NULL);
+    vkCmdPushConstants(image->commandBuffer, gPipelineLayout,
+                       VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDraw(image->commandBuffer, 3, 1, 0, 0);
+    vkCmdEndRenderPass(image->commandBuffer);
+
+    return CheckVk(vkEndCommandBuffer(image->commandBuffer),
+                   "vkEndCommandBuffer");
+}
+
+int CreateImageResources(void) {
+    VkSemaphoreCreateInfo semaphoreInfo = {0};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkDescriptorPoolSize poolSize = {0};
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSize.descriptorCount = gImageCount;
+
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = gImageCount;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (CheckVk(vkCreateDescriptorPool(gDevice, &poolInfo, NULL,
+                                       &gDescriptorPool),
+                "vkCreateDescriptorPool") != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < gImageCount; i++) {
+        SwapchainImage *image = &gImages[i];
+        image->inFlight = VK_NULL_HANDLE;
+
+        VkFramebufferCreateInfo framebufferInfo = {0};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = gRenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &image->view;
+        framebufferInfo.width = gSwapchainExtent.width;
+        framebufferInfo.height = gSwapchainExtent.height;
+        framebufferInfo.layers = 1;
+        if (CheckVk(vkCreateFramebuffer(gDevice, &framebufferInfo, NULL,
+                                        &image->framebuffer),
+                    "vkCreateFramebuffer") != 0 ||
+            CheckVk(vkCreateSemaphore(gDevice, &semaphoreInfo, NULL,
+                                      &image->renderFinished),
+                    "vkCreateSemaphore") != 0) {
+            return -1;
+        }
+
+        if (CreateUniformBuffer(image) != 0) {
+            return -1;
+        }
+
+        VkDescriptorSetAllocateInfo setInfo = {0};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = gDescriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &gDescriptorSetLayout;
+        if (CheckVk(vkAllocateDescriptorSets(gDevice, &setInfo,
+                                             &image->descriptorSet),
+                    "vkAllocateDescriptorSets") != 0) {
+            return -1;
+        }
+
+        VkDescriptorBufferInfo bufferInfo = {0};
+        bufferInfo.buffer = image->uniformBuffer;
+        bufferInfo.range = sizeof(FrameUniforms);
+
+        VkWriteDescriptorSet write = {0};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = image->descriptorSet;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(gDevice, 1, &write, 0, NULL);
+
+        VkCommandBufferAllocateInfo commandInfo = {0};
+        commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandInfo.commandPool = gCommandPool;
+        commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandInfo.commandBufferCount = 1;
+        if (CheckVk(vkAllocateCommandBuffers(gDevice, &commandInfo,
+                                             &image->commandBuffer),
+                    "vkAllocateCommandBuffers") != 0) {
+            return -1;
+        }
+
+        if (RecordCommandBuffer(image) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int CreateSwapchainObjects(void) {
+    if (CreateSwapchain() != 0 || CreateRenderPass() != 0 ||
+        CreatePipeline() != 0 || CreateImageResources() != 0) {
+        return -1;
+    }
+
+    gSwapchainStale = 0;
+    return 0;
+}
+
+void DestroySwapchainObjects(void) {
+    for (uint32_t i = 0; i < gImageCount; i++) {
+        SwapchainImage *image = &gImages[i];
+
+        if (image->commandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(gDevice, gCommandPool, 1,
+                                 &image->commandBuffer);
+        }
+        vkDestroyBuffer(gDevice, image->uniformBuffer, NULL);
+        vkFreeMemory(gDevice, image->uniformMemory, NULL);
+        vkDestroySemaphore(gDevice, image->renderFinished, NULL);
+        vkDestroyFramebuffer(gDevice, image->framebuffer, NULL);
+        vkDestroyImageView(gDevice, image->view, NULL);
+        memset(image, 0, sizeof(*image));
+    }
+    gImageCount = 0;
+
+    vkDestroyDescriptorPool(gDevice, gDescriptorPool, NULL);
+    vkDestroyPipeline(gDevice, gPipeline, NULL);
+    vkDestroyRenderPass(gDevice, gRenderPass, NULL);
+    vkDestroySwapchainKHR(gDevice, gSwapchain, NULL);
+    gDescriptorPool = VK_NULL_HANDLE;
+    gPipeline = VK_NULL_HANDLE;
+    gRenderPass = VK_NULL_HANDLE;
+    gSwapchain = VK_NULL_HANDLE;
+}
+
+int RecreateSwapchainObjects(void) {
+    vkDeviceWaitIdle(gDevice);
+    DestroySwapchainObjects();
+
+    return CreateSwapchainObjects();
+}
+
+int InitVulkan(void) {
+    if (CreateInstance() != 0 || PickPhysicalDevice() != 0 ||
+        CreateDevice() != 0 || CreateFixedObjects() != 0 ||
+        CreateSwapchainObjects() != 0) {
+        return -1;
+    }
+
+    LogInfo("%d frames in flight", gFramesInFlight);
+    return 0;
+}
+
+// Submits the pre-recorded command buffer of the next swapchain image. Up to
+// gFramesInFlight frames can be queued before this waits for the oldest one,
+// and an image is never reused while an earlier frame still renders to it.
+int DrawFrame(double elapsedTimeSecs) {
+    if (gSwapchainStale) {
+        // A minimized window has no drawable area to make a swapchain for.
+        int drawableWidth, drawableHeight;
+        SDL_Vulkan_GetDrawableSize(gWindow, &drawableWidth, &drawableHeight);
+        if (drawableWidth == 0 || drawableHeight == 0) {
+            return 0;
+        }
+        if (RecreateSwapchainObjects() != 0) {
+            return -1;
+        }
+    }
+
+    Uint64 traceStart = TraceBegin();
+    vkWaitForFences(gDevice, 1, &gFrameFences[gFrame], VK_TRUE, UINT64_MAX);
+
+    uint32_t index;
+    VkResult result =
+        vkAcquireNextImageKHR(gDevice, gSwapchain, UINT64_MAX,
+                              gImageAvailable[gFrame], VK_NULL_HANDLE, &index);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        gSwapchainStale = 1;
+        return 0;
+    }
+    if (result != VK_SUBOPTIMAL_KHR &&
+        CheckVk(result, "vkAcquireNextImageKHR") != 0) {
+        return -1;
+    }
+
+    SwapchainImage *image = &gImages[index];
+    if (image->inFlight != VK_NULL_HANDLE) {
+        vkWaitForFences(gDevice, 1, &image->inFlight, VK_TRUE, UINT64_MAX);
+    }
+    TraceEnd("acquire", traceStart);
+
+    // The command buffers are recorded with the swapchain, so the CPU cost of
+    // a frame is storing the time and submitting. With FIFO the acquire and
+    // present block until a vsync, which is pacing, not work.
+    Uint64 submitStart = SDL_GetPerformanceCounter();
+    image->inFlight = gFrameFences[gFrame];
+    image->uniforms->time = (float)elapsedTimeSecs;
+
+    VkPipelineStageFlags waitStage =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &gImageAvailable[gFrame];
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &image->commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &image->renderFinished;
+
+    vkResetFences(gDevice, 1, &gFrameFences[gFrame]);
+    if (CheckVk(vkQueueSubmit(gQueue, 1, &submitInfo, gFrameFences[gFrame]),
+                "vkQueueSubmit") != 0) {
+        return -1;
+    }
+    gSubmitMs += GetElapsedTimeMs(submitStart, SDL_GetPerformanceCounter());
+    TraceEnd("submit", submitStart);
+
+    traceStart = TraceBegin();
+    VkPresentInfoKHR presentInfo = {0};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &image->renderFinished;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &gSwapchain;
+    presentInfo.pImageIndices = &index;
+
+    result = vkQueuePresentKHR(gQueue, &presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        gSwapchainStale = 1;
+    } else if (CheckVk(result, "vkQueuePresentKHR") != 0) {
+        return -1;
+    }
+    TraceEnd("present", traceStart);
+
+    gFrame = (gFrame + 1) % gFramesInFlight;
+    return 0;
+}
+
+void DestroyVulkan(void) {
+    if (gDevice != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(gDevice);
+        DestroySwapchainObjects();
+
+        for (int i = 0; i < gFramesInFlight; i++) {
+            vkDestroyFence(gDevice, gFrameFences[i], NULL);
+            vkDestroySemaphore(gDevice, gImageAvailable[i], NULL);
+        }
+        vkDestroyPipelineLayout(gDevice, gPipelineLayout, NULL);
+        vkDestroyDescriptorSetLayout(gDevice, gDescriptorSetLayout, NULL);
+        vkDestroyShaderModule(gDevice, gFragmentShader, NULL);
+        vkDestroyShaderModule(gDevice, gVertexShader, NULL);
+        vkDestroyCommandPool(gDevice, gCommandPool, NULL);
+        vkDestroyDevice(gDevice, NULL);
+    }
+    if (gInstance != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(gInstance, gSurface, NULL);
+        vkDestroyInstance(gInstance, NULL);
+    }
+}
+
+void DestroySDL(void) {
+    SDL_DestroyWindow(gWindow);
+    SDL_Quit();
+}
+
+int main(int argc, char *argv[]) {
+    char opt;
+    while ((opt = getopt(argc, argv, ":w:h:ft:q:p:JR:")) != -1) {
+        switch (opt) {
+        case 'w':
+            gWidth = strtol(optarg, (char **)NULL, 10);
+            if (gWidth == 0) {
+                fprintf(stderr, "invalid value for width: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            gHeight = strtol(optarg, (char **)NULL, 10);
+            if (gHeight == 0) {
+                fprintf(stderr, "invalid value for height: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            gFullscreen = 1;
+            break;
+        case 't':
+            gTracePath = optarg;
+            break;
+        case 'J':
+            gJitter.enabled = 1;
+            break;
+        case 'R':
+            if (ParseRealtimeCores(optarg, &gRealtime) != 0) {
+                fprintf(stderr, "invalid value for real-time cores: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            gJitter.enabled = 1;
+            break;
+        case 'p':
+            if (strcmp(optarg, "fifo") == 0) {
+                gPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+            } else if (strcmp(optarg, "mailbox") == 0) {
+                gPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else if (strcmp(optarg, "immediate") == 0) {
+                gPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else {
+                fprintf(stderr, "invalid value for present mode: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            gFramesInFlight = strtol(optarg, (char **)NULL, 10);
+            if (gFramesInFlight < 1 ||
+                gFramesInFlight > MAX_FRAMES_IN_FLIGHT) {
+                fprintf(stderr, "invalid value for frames in flight: %s\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+
+    if (gTracePath != NULL) {
+        StartTrace();
+    }
+
+    StartRealtime(&gRealtime);
+
+    if (InitSDL() != 0) {
+        fprintf(stderr, "error initializing SDL, %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    if (InitVulkan() != 0) {
+        DestroyVulkan();
+        DestroySDL();
+        return EXIT_FAILURE;
+    }
+
+    int refreshRate = GetDisplayRefreshRate(gDisplayMode);
+    const double targetSecsPerFrame = 1.0 / (double)refreshRate;
+    LogInfo("display refresh rate %d, target secs per frame %f", refreshRate,
+            targetSecsPerFrame);
+
+    double elapsedTimeSecs = 0.0;
+    int metricsFrames = 0;
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+    Uint64 metricsPrintCounter = SDL_GetPerformanceCounter();
+    SDL_Event event;
+    int isRunning = 1;
+    StartJitterHistogram(&gJitter, targetSecsPerFrame);
+    LockRealtimeMemory(&gRealtime);
+
+    while (isRunning) {
+        Uint64 traceStart = TraceBegin();
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+            case SDL_QUIT:
+                isRunning = 0;
+                break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_ESCAPE) {
+                    isRunning = 0;
+                }
+                break;
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
+                    event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    gSwapchainStale = 1;
+                }
+                break;
+            }
+        }
+        TraceEnd("poll events", traceStart);
+
+        elapsedTimeSecs += targetSecsPerFrame;
+
+        Uint64 drawStartCounter = SDL_GetPerformanceCounter();
+        if (DrawFrame(elapsedTimeSecs) != 0) {
+            isRunning = 0;
+        }
+        TraceEnd("DrawFrame", drawStartCounter);
+        AddJitterFrame(&gJitter, SDL_GetPerformanceCounter());
+        metricsFrames++;
+
+        // Manually cap the frame rate
+        traceStart = TraceBegin();
+        SleepUntilFrameTime(&gRealtime, lastCounter, targetSecsPerFrame);
+        while (GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) <
+               targetSecsPerFrame) {
+        }
+        assert(GetElapsedTimeSecs(lastCounter, SDL_GetPerformanceCounter()) >=
+               targetSecsPerFrame);
+
+        Uint64 endCounter = SDL_GetPerformanceCounter();
+        TraceEnd("pacing wait", traceStart);
+
+        double msPerFrame = GetElapsedTimeMs(lastCounter, endCounter);
+        double fps = (double)SDL_GetPerformanceFrequency() /
+                     (double)(endCounter - lastCounter);
+
+        if (GetElapsedTimeMs(metricsPrintCounter, SDL_GetPerformanceCounter()) >
+            1000.0) {
+            printf("ms/f: %f, fps: %f, cpu ms/f: %f\r", msPerFrame, fps,
+                   gSubmitMs / metricsFrames);
+            fflush(stdout);
+            gSubmitMs = 0.0;
+            metricsFrames = 0;
+            metricsPrintCounter = SDL_GetPerformanceCounter();
+        }
+
+        lastCounter = endCounter;
+    }
+    PrintJitterHistogram(&gJitter);
+
+    DestroyVulkan();
+
+    if (gTracePath != NULL) {
+        if (WriteTrace(gTracePath) != 0) {
+            LogError("failed to write trace to %s", gTracePath);
+        } else {
+            LogInfo("wrote trace to %s", gTracePath);
+        }
+    }
+
+    DestroySDL();
+
+    return EXIT_SUCCESS;
+}
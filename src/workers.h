@@ -0,0 +1,211 @@
+#ifndef WORKERS_H_INCLUDED
+#define WORKERS_H_INCLUDED
+
+#include "perfcounters.h"
+#include "trace.h"
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define MAX_WORKERS 64
+
+// Splits the rows of a frame into one horizontal band per worker. Worker i
+// always renders band i, so memory first touched by a worker stays local to
+// the core, and socket, that renders it.
+
+typedef void (*BandJob)(void *data, int y0, int y1);
+
+typedef struct WorkerPool WorkerPool;
+
+typedef struct {
+    WorkerPool *pool;
+    int index;
+    int cpu;
+} Worker;
+
+struct WorkerPool {
+    Worker workers[MAX_WORKERS];
+    SDL_Thread *threads[MAX_WORKERS];
+    int count;
+    SDL_mutex *mutex;
+    SDL_cond *startCond;
+    SDL_cond *doneCond;
+    BandJob job;
+    void *data;
+    int rows;
+    int generation;
+    int remaining;
+    int quit;
+};
+
+static inline void GetBand(int band, int bands, int rows, int *y0, int *y1) {
+    *y0 = (int)((long long)rows * band / bands);
+    *y1 = (int)((long long)rows * (band + 1) / bands);
+}
+
+// Pins the calling worker to one of the cores it is allowed to run on,
+// spreading the workers evenly over them so consecutive bands share a socket.
+// Returns the core, or -1 when the worker is left to the scheduler.
+static inline int PinWorker(int index, int count) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+
+    int allowedCount = CPU_COUNT(&allowed);
+    if (count > allowedCount) {
+        return -1;
+    }
+
+    int slot = index * allowedCount / count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || slot-- > 0) {
+            continue;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            return -1;
+        }
+        return cpu;
+    }
+
+    return -1;
+#else
+    (void)index;
+    (void)count;
+    return -1;
+#endif
+}
+
+static inline int RunWorker(void *data) {
+    Worker *worker = data;
+    WorkerPool *pool = worker->pool;
+    int generation = 0;
+
+    worker->cpu = PinWorker(worker->index, pool->count);
+
+    char name[TRACE_THREAD_NAME_SIZE];
+    snprintf(name, sizeof(name), "worker %d", worker->index);
+    SetTraceThreadName(name);
+
+    SDL_LockMutex(pool->mutex);
+    for (;;) {
+        while (pool->generation == generation && !pool->quit) {
+            SDL_CondWait(pool->startCond, pool->mutex);
+        }
+        if (pool->quit) {
+            break;
+        }
+
+        generation = pool->generation;
+        BandJob job = pool->job;
+        void *jobData = pool->data;
+        int rows = pool->rows;
+        SDL_UnlockMutex(pool->mutex);
+
+        int y0, y1;
+        GetBand(worker->index, pool->count, rows, &y0, &y1);
+        if (y0 < y1) {
+            Uint64 traceStart = TraceBegin();
+            job(jobData, y0, y1);
+            TraceEnd("band", traceStart);
+        }
+
+        SDL_LockMutex(pool->mutex);
+        pool->remaining--;
+        if (pool->remaining == 0) {
+            SDL_CondSignal(pool->doneCond);
+        }
+    }
+    SDL_UnlockMutex(pool->mutex);
+
+    ClosePerfCounters();
+    return 0;
+}
+
+// Logs how many workers PinWorker left to the scheduler, because there were
+// more workers than cores to pin them to or the host refused.
+static inline void ReportWorkerPinning(const WorkerPool *pool) {
+    int unpinned = 0;
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->workers[i].cpu < 0) {
+            unpinned++;
+        }
+    }
+
+    if (unpinned > 0) {
+        printf("%d of %d workers are not pinned to a core\n", unpinned,
+               pool->count);
+    }
+}
+
+static inline int CreateWorkerPool(WorkerPool *pool, int count) {
+    memset(pool, 0, sizeof(*pool));
+    pool->count = count;
+    pool->mutex = SDL_CreateMutex();
+    pool->startCond = SDL_CreateCond();
+    pool->doneCond = SDL_CreateCond();
+    if (pool->mutex == NULL || pool->startCond == NULL ||
+        pool->doneCond == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].cpu = -1;
+        pool->threads[i] =
+            SDL_CreateThread(RunWorker, "worker", &pool->workers[i]);
+        if (pool->threads[i] == NULL) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Runs the job over every band of a frame with the given number of rows and
+// waits for all of the bands to finish.
+static inline void RunWorkers(WorkerPool *pool, BandJob job, void *data,
+                              int rows) {
+    SDL_LockMutex(pool->mutex);
+    pool->job = job;
+    pool->data = data;
+    pool->rows = rows;
+    pool->remaining = pool->count;
+    pool->generation++;
+    SDL_CondBroadcast(pool->startCond);
+
+    while (pool->remaining > 0) {
+        SDL_CondWait(pool->doneCond, pool->mutex);
+    }
+    SDL_UnlockMutex(pool->mutex);
+}
+
+static inline void DestroyWorkerPool(WorkerPool *pool) {
+    if (pool->mutex != NULL) {
+        SDL_LockMutex(pool->mutex);
+        pool->quit = 1;
+        SDL_CondBroadcast(pool->startCond);
+        SDL_UnlockMutex(pool->mutex);
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->threads[i] != NULL) {
+            SDL_WaitThread(pool->threads[i], NULL);
+        }
+    }
+
+    SDL_DestroyCond(pool->doneCond);
+    SDL_DestroyCond(pool->startCond);
+    SDL_DestroyMutex(pool->mutex);
+}
+
+#endif